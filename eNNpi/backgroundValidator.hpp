@@ -0,0 +1,215 @@
+#ifndef _backgroundValidator_h
+#define _backgroundValidator_h
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "dataFile.hpp"
+#include "nnWeights.hpp"
+#include "testMetrics.hpp"
+
+/*
+ * backgroundValidator tests weight snapshots against a held out training file on a thread of its own, so that
+ * training never stops to validate.
+ *
+ * The trainer calls submit() with an nnWeights snapshot (see nn::snapshot) every so many epochs or rows and carries
+ * straight on. The validation thread runs every row of the validation file through the snapshot with its own
+ * scratch space, so it shares no activation state with the network being trained. If a new snapshot is submitted
+ * before the thread has got round to the previous one, the older one is dropped: validation only ever falls behind
+ * by one snapshot and submit() never waits.
+ *
+ * Each result is
+ *	- passed to the callback, on the validation thread, as soon as it is ready
+ *	- queued for poll(), so the training thread can pick the results up between epochs (e.g. for early stopping)
+ *
+ * The snapshot with the lowest validation MSE so far is kept, for best model checkpointing. Call drain() first
+ * to make sure every submitted snapshot has been tested.
+ *
+ * The validation file must not change while the validator exists.
+ */
+
+struct validationResult
+{
+	unsigned int		epoch;			// the epoch the snapshot was taken in, 1 for the first
+	unsigned long		rowsTrained;	// rows trained since the run started when the snapshot was taken
+	double				mse;
+	double				accuracy;
+	double				elapsedMs;		// the time taken to test the snapshot
+	bool				isBest;			// the lowest MSE so far
+};
+
+typedef void (*funcValidationCallback)(const validationResult &, void *);
+
+class backgroundValidator
+{
+	public:
+						backgroundValidator(trainingFile * newValidationFile, testMetrics * newMetrics, funcValidationCallback newCallback = NULL, void * data = NULL)
+						/*
+						 * newMetrics decides the classification used for the accuracy (see testMetrics). It is owned by the
+						 * validator from now on and only ever used on the validation thread.
+						 */
+						{
+							validationFile = newValidationFile;
+							metrics = newMetrics;
+							validated = newCallback;
+							callbackData = data;
+							pending = NULL;
+							best = NULL;
+							bestMse = -1.0;
+							busy = false;
+							stopping = false;
+							dropped = 0;
+
+							validator = thread(&backgroundValidator::validateLoop, this);
+						}
+
+						~backgroundValidator()
+						{
+							{
+								lock_guard<mutex> guard(validatorLock);
+								stopping = true;
+							}
+							snapshotReady.notify_all();
+							validator.join();
+
+							if (pending != NULL)
+								delete pending;
+							if (best != NULL)
+								delete best;
+							delete metrics;
+						}
+
+			void		submit(nnWeights * snapshot, unsigned int epoch, unsigned long rowsTrained)
+			/*
+			 * Hand a snapshot over to the validation thread, which deletes it. Returns straight away.
+			 */
+						{
+							{
+								lock_guard<mutex> guard(validatorLock);
+								if (pending != NULL)
+								{
+									delete pending;
+									dropped++;
+								}
+								pending = snapshot;
+								pendingEpoch = epoch;
+								pendingRows = rowsTrained;
+							}
+							snapshotReady.notify_one();
+						}
+
+			bool		poll(validationResult * result)
+			/*
+			 * Take the oldest result that has not been polled yet. Returns false if there is none.
+			 */
+						{
+							lock_guard<mutex> guard(validatorLock);
+
+							if (results.empty())
+								return false;
+							*result = results.front();
+							results.pop_front();
+							return true;
+						}
+
+			void		drain()		// wait until every submitted snapshot has been tested or dropped
+						{
+							unique_lock<mutex> guard(validatorLock);
+							validatorIdle.wait(guard, [this] { return (pending == NULL) && !busy; });
+						}
+
+	// access
+			const nnWeights * bestWeights() { return best; }		// call drain() first, NULL if nothing has been tested
+			double		bestLoss() { return bestMse; }				//	"	, -1 if nothing has been tested
+			unsigned long droppedCount() { return dropped; }		// snapshots replaced before they were tested
+
+	private:
+			void		validateLoop()
+						{
+							nnWeights * snapshot;
+							validationResult result;
+							vector<float> hiddenScratch;
+							vector<float> outputVector;
+							chrono::steady_clock::time_point started;
+							unsigned int row;
+
+							for (;;)
+							{
+								{
+									unique_lock<mutex> guard(validatorLock);
+									snapshotReady.wait(guard, [this] { return stopping || (pending != NULL); });
+									if (stopping)
+										return;
+									snapshot = pending;
+									pending = NULL;
+									result.epoch = pendingEpoch;
+									result.rowsTrained = pendingRows;
+									busy = true;
+								}
+
+								started = chrono::steady_clock::now();
+								hiddenScratch.resize(snapshot->hiddenNodes());
+								outputVector.resize(snapshot->outputNodes());
+
+								metrics->reset();
+								for (row = 0; row < validationFile->inputLines(); row++)
+								{
+									snapshot->run(validationFile->inputSet(row)->data(), hiddenScratch.data(), outputVector.data());
+									metrics->add(validationFile->outputSet(row)->data(), outputVector.data());
+								}
+
+								result.mse = metrics->mse();
+								result.accuracy = metrics->accuracy();
+								result.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+								{
+									lock_guard<mutex> guard(validatorLock);
+									result.isBest = (best == NULL) || (result.mse < bestMse);
+									if (result.isBest)
+									{
+										if (best != NULL)
+											delete best;
+										best = snapshot;
+										bestMse = result.mse;
+									}
+									else
+										delete snapshot;
+									results.push_back(result);
+								}
+
+								if (validated != NULL)
+									validated(result, callbackData);
+
+								{
+									lock_guard<mutex> guard(validatorLock);
+									busy = false;
+								}
+								validatorIdle.notify_all();
+							}
+						}
+
+	private:
+	trainingFile	*	validationFile;
+	testMetrics		*	metrics;			// only used on the validation thread
+	funcValidationCallback validated;
+	void			*	callbackData;
+
+	thread				validator;
+	mutex				validatorLock;		// guards everything below
+	condition_variable	snapshotReady;
+	condition_variable	validatorIdle;
+	bool				stopping;
+	bool				busy;				// a snapshot is being tested
+	nnWeights		*	pending;			// the next snapshot to test
+	unsigned int		pendingEpoch;
+	unsigned long		pendingRows;
+	nnWeights		*	best;
+	double				bestMse;
+	deque<validationResult> results;		// waiting for poll()
+	unsigned long		dropped;
+};
+
+#endif	// _backgroundValidator_h
@@ -0,0 +1,233 @@
+#ifndef _crossValidator_h
+#define _crossValidator_h
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "nn.hpp"
+#include "epochTrainer.hpp"
+#include "testMetrics.hpp"
+#include "threadPool.hpp"
+
+/*
+ * crossValidator runs a k-fold cross validation over folds that are already split into training files, e.g. the
+ * Shuttle Set1.tr to Set4.tr.
+ *
+ * For every fold k a copy of the base network (same topology, starting weights, learning rate and momentum, named
+ * <name>_fold<k> after the base network's own name) is trained with an epochTrainer on a trainingView of all of the
+ * other folds and then tested against fold k. The view only points at the rows of the files, nothing is copied or
+ * concatenated, so the folds are read in once and shared by every model.
+ *
+ * The folds are trained in parallel, one per worker thread. The learning parameters of the nodes are per thread
+ * (see nnNode::setLearningParameters) so each model trains with its own learning rate; the configure callback
+ *
+ *	typedef void (*funcConfigureFold)(epochTrainer & trainer, nn * foldNet, unsigned int fold, void * data);
+ *
+ * is called on the fold's worker thread before it trains, to set the epoch rules and any hyperparameters of that
+ * fold's network (e.g. foldNet->setLearningRate()).
+ *
+ * After run() each fold has its own testMetrics and the totals are merged into total(). With a save path each
+ * trained model is saved there, so the fold tag is in the file name.
+ */
+
+typedef void (*funcConfigureFold)(epochTrainer &, nn *, unsigned int, void *);
+
+const char ENN_ERR_TOO_FEW_FOLDS[] = "Cross validation needs at least two folds";
+const char ENN_ERR_FOLD_TOPOLOGY[] = "A cross validation fold does not fit the network";
+
+struct foldResult
+{
+	string				networkName;	// including the fold tag
+	unsigned int		rowsTrained;	// rows in the training view, per epoch
+	unsigned int		epochs;
+	stop_reason			reason;
+	double				trainingLoss;	// the best loss the trainer saw
+	double				elapsedMs;		// training and testing
+	testMetrics		*	metrics;		// the held out fold
+	const char		*	error;			// NULL unless the fold failed
+};
+
+class crossValidator
+{
+	public:
+						crossValidator(vector<trainingFile *> & newFolds)
+						{
+							if (newFolds.size() < 2)
+								throw format_Error(ENN_ERR_TOO_FEW_FOLDS);
+
+							folds = newFolds;
+							totals = NULL;
+							configure = NULL;
+							configureData = NULL;
+							workerCount = 0;
+						}
+
+						~crossValidator()
+						{
+							clearResults();
+						}
+
+	// setup
+			void		setConfigure(funcConfigureFold newConfigure, void * data = NULL) { configure = newConfigure; configureData = data; }
+			void		setThreads(unsigned int threads) { workerCount = threads; }		// 0 (the default) is one per fold, up to one per hardware thread
+
+	// run
+			void		run(nn * baseNet, const char * cstrSavePath = NULL, const char * cstrMetricsSpec = "argmax")
+			/*
+			 * Train and test a copy of baseNet for every fold, saving each on cstrSavePath if it is not NULL. baseNet is not changed.
+			 */
+						{
+							nnWeights * startWeights;
+							network_description baseDescription = *baseNet->networkDescription();
+							unsigned int fold;
+							unsigned int threads;
+
+							for (fold = 0; fold < folds.size(); fold++)
+								if ((folds[fold]->inputLines() == 0) || (folds[fold]->inputSet(0)->size() != baseDescription.standardInputNodes())
+										|| (folds[fold]->outputSet(0)->size() != baseDescription.outputNodes()))
+									throw format_Error(ENN_ERR_FOLD_TOPOLOGY);
+
+							clearResults();
+							results.resize(folds.size());
+							for (fold = 0; fold < folds.size(); fold++)
+								results[fold].metrics = testMetrics::fromSpec(cstrMetricsSpec, baseDescription.outputNodes());	// deleted in clearResults()
+							totals = testMetrics::fromSpec(cstrMetricsSpec, baseDescription.outputNodes());						//	"
+
+							threads = (workerCount == 0) ? threadPool::hardwareThreads() : workerCount;
+							if (threads > folds.size())
+								threads = (unsigned int)folds.size();
+
+							startWeights = baseNet->snapshot();
+							{
+								threadPool pool(threads);
+
+								pool.run(folds.size(), [&](unsigned int worker, size_t task)
+								{
+									runFold((unsigned int)task, baseDescription, startWeights, cstrSavePath);
+								});
+							}
+							delete startWeights;
+
+							for (fold = 0; fold < folds.size(); fold++)
+								if (results[fold].error == NULL)
+									totals->merge(*results[fold].metrics);
+						}
+
+	// access
+			unsigned int foldCount() { return (unsigned int)folds.size(); }
+			foldResult & result(unsigned int fold) { return results[fold]; }
+			testMetrics & total() { return *totals; }		// every held out row of every fold that did not fail
+
+			void		writeOn(ostream & outStr)
+			/*
+			 * One line per fold, the mean and standard deviation of the fold MSE and accuracy, then the summary of every held out row
+			 */
+						{
+							unsigned int fold, good = 0;
+							double sumMse = 0.0, sumMse2 = 0.0, sumAccuracy = 0.0, sumAccuracy2 = 0.0;
+							double mse, accuracy;
+
+							outStr << "Fold\tNetwork\tTrain rows\tTest rows\tEpochs\tStopped\tTrain loss\tMSE\tAccuracy\tms\n";
+							for (fold = 0; fold < results.size(); fold++)
+							{
+								foldResult & r = results[fold];
+
+								if (r.error != NULL)
+								{
+									outStr << fold + 1 << "\t" << r.networkName << "\tError: " << r.error << "\n";
+									continue;
+								}
+								mse = r.metrics->mse();
+								accuracy = r.metrics->accuracy();
+								outStr << fold + 1 << "\t" << r.networkName << "\t" << r.rowsTrained << "\t" << r.metrics->rowCount() << "\t" << r.epochs
+										<< "\t" << epochTrainer::stopReasonName(r.reason) << "\t" << r.trainingLoss << "\t" << mse << "\t" << accuracy
+										<< "\t" << r.elapsedMs << "\n";
+
+								good++;
+								sumMse += mse;
+								sumMse2 += mse * mse;
+								sumAccuracy += accuracy;
+								sumAccuracy2 += accuracy * accuracy;
+							}
+
+							if (good > 0)
+								outStr << "Mean MSE: " << sumMse / good << " sd: " << sqrt(fmax(0.0, sumMse2 / good - (sumMse / good) * (sumMse / good)))
+										<< " Mean accuracy: " << sumAccuracy / good << " sd: "
+										<< sqrt(fmax(0.0, sumAccuracy2 / good - (sumAccuracy / good) * (sumAccuracy / good))) << "\n";
+							if (totals != NULL)
+								totals->writeOn(outStr);
+						}
+
+	private:
+			void		runFold(unsigned int fold, network_description baseDescription, nnWeights * startWeights, const char * cstrSavePath)
+			/*
+			 * Runs on a worker thread. Exceptions must not escape it, a failure is recorded in the fold's result instead.
+			 */
+						{
+							foldResult & r = results[fold];
+							chrono::steady_clock::time_point started = chrono::steady_clock::now();
+							trainingView trainingRows;
+							unsigned int other;
+
+							r.networkName = baseDescription.networkName() + "_fold" + to_string(fold + 1);
+							r.error = NULL;
+							r.rowsTrained = r.epochs = 0;
+							r.reason = STOP_NONE;
+							r.trainingLoss = -1.0;
+
+							try
+							{
+								baseDescription.setNetworkName(r.networkName);
+								nn foldNet(baseDescription);
+								foldNet.setWeights(startWeights);
+
+								for (other = 0; other < folds.size(); other++)
+									if (other != fold)
+										trainingRows.add(folds[other]);
+								r.rowsTrained = trainingRows.inputLines();
+
+								epochTrainer trainer(&foldNet, trainingRows);
+								if (configure != NULL)
+									configure(trainer, &foldNet, fold, configureData);
+
+								r.reason = trainer.run();
+								r.epochs = trainer.epochsRun();
+								r.trainingLoss = trainer.bestLossSeen();
+
+								foldNet.test(folds[fold], NULL, r.metrics);
+
+								if (cstrSavePath != NULL)
+									foldNet.saveTo(cstrSavePath);
+							}
+							catch (format_Error & e)
+							{
+								r.error = e.mesg;
+							}
+							catch (internal_Error & e)
+							{
+								r.error = e.mesg;
+							}
+
+							r.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+						}
+
+			void		clearResults()
+						{
+							for (foldResult & r : results)
+								delete r.metrics;
+							results.clear();
+							if (totals != NULL)
+								delete totals;
+							totals = NULL;
+						}
+
+	private:
+	vector<trainingFile *>	folds;			// not owned
+	vector<foldResult>	results;			// written by the fold's worker thread during run()
+	testMetrics		*	totals;
+	funcConfigureFold	configure;
+	void			*	configureData;
+	unsigned int		workerCount;
+};
+
+#endif	// _crossValidator_h
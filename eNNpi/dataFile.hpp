@@ -92,8 +92,8 @@ class inputFile : public dataFile
     status_t		decodeLine(string * strLine)
                     {
     					std::string::size_type			bracketPos;
-                        string							verb = "";
-                        string							arguements = "";
+                        string						&	verb = lineVerb;
+                        string						&	arguements = lineArguements;
 
                         bracketPos = strLine->find('(', 0);
                         if (bracketPos == std::string::npos)
@@ -201,8 +201,8 @@ class trainingFile : public dataFile
     status_t		decodeLine(string * strLine)
                     {
                         std::string::size_type				bracketPos;
-                        string								verb = "";
-                        string								arguements = "";
+                        string							&	verb = lineVerb;
+                        string							&	arguements = lineArguements;
 
                         bracketPos = strLine->find('(', 0);
                         if (bracketPos == std::string::npos) throw format_Error(ENN_ERR_NON_FILE);
@@ -294,4 +294,46 @@ class trainingFile : public dataFile
 	twoDFloatArray * outputArray;
 };
 
+class trainingView
+/*
+ * A list of rows taken from one or more training files that have been read in, e.g. all of the cross validation
+ * folds but one. Only pointers to the rows are kept, the data is never copied, so the files must outlive the view.
+ *
+ * It has the same row access as trainingFile, so it can be passed to nn::trainPass().
+ */
+{
+	public:
+                    trainingView() { }
+
+                    trainingView(trainingFile * trFile) { add(trFile); }
+
+                    void					add(trainingFile * trFile)	// append every row of trFile
+                                            {
+                                                unsigned int row;
+
+                                                inputRows.reserve(inputRows.size() + trFile->inputLines());
+                                                outputRows.reserve(outputRows.size() + trFile->inputLines());
+                                                for (row = 0; row < trFile->inputLines(); row++)
+                                                {
+                                                    inputRows.push_back(trFile->inputSet(row));
+                                                    outputRows.push_back(trFile->outputSet(row));
+                                                }
+                                            }
+
+                    void					add(vector<float> * inputRow, vector<float> * outputRow)	// append one row kept elsewhere
+                                            {
+                                                inputRows.push_back(inputRow);
+                                                outputRows.push_back(outputRow);
+                                            }
+
+	public:		// access
+                    unsigned int			inputLines() { return (unsigned int)inputRows.size(); }
+                    vector<float> *			inputSet(unsigned int row) { return inputRows[row]; }
+                    vector<float> *			outputSet(unsigned int row) { return outputRows[row]; }
+
+	private:
+    vector<vector<float> *>	inputRows;
+    vector<vector<float> *>	outputRows;
+};
+
 #endif
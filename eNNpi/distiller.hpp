@@ -0,0 +1,121 @@
+#ifndef _distiller_h
+#define _distiller_h
+
+#include <math.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "nnWeights.hpp"
+#include "dataFile.hpp"
+
+/*
+ * distiller makes the training rows for a student network from a teacher network (knowledge distillation).
+ *
+ * Each input row is run through the teacher once and the teacher's outputs, its soft targets, are kept in memory with
+ * a copy of the input. Soft targets carry more than the 0/1 labels of the training file: how sure the teacher is and
+ * which classes it finds alike, so a much narrower student can learn the teacher's function from them.
+ *
+ * addSynthetic() adds rows around the data as well: copies of every data row with Gaussian noise added to each
+ * input, the noise being a fraction of that input's standard deviation over the data, labelled by the teacher. They
+ * show the student how the teacher behaves between the training rows.
+ *
+ * rows() is a trainingView of all of them, for epochTrainer or nn::trainPass(). The rows are kept in deques, so the
+ * view stays good as rows are added, for as long as the distiller lives.
+ *
+ *	distiller soft(*teacher->snapshot());
+ *	soft.addRows(trainingFile);
+ *	soft.addSynthetic(4, 0.1, seed);
+ *	epochTrainer trainer(student, soft.rows());
+ */
+
+const char ENN_ERR_DISTILL_TOPOLOGY[] = "The training file does not fit the teacher network";
+
+class distiller
+{
+	public:
+						distiller(const nnWeights & newTeacher) : teacher(newTeacher)
+						{
+							hiddenScratch.resize(teacher.hiddenNodes());
+							dataCount = syntheticCount = 0;
+						}
+
+			template <class trainingRows> void addRows(trainingRows * rows)	// a soft target for every row, call before addSynthetic()
+						{
+							unsigned int row;
+
+							if ((rows->inputLines() > 0) && (rows->inputSet(0)->size() != teacher.standardInputNodes()))
+								throw format_Error(ENN_ERR_DISTILL_TOPOLOGY);
+							for (row = 0; row < rows->inputLines(); row++)
+								addRow(rows->inputSet(row)->data());
+							dataCount = inputs.size();
+						}
+
+			void		addSynthetic(unsigned int perRow, float noise, unsigned long seed)
+			/*
+			 * perRow noisy copies of every data row added so far, with a standard deviation of noise times each
+			 * input's own
+			 */
+						{
+							mt19937 gen(seed);
+							normal_distribution<float> gaussian(0.0, 1.0);
+							vector<float> spread(teacher.standardInputNodes());
+							vector<float> jittered(teacher.standardInputNodes());
+							unsigned int row, copy, i;
+
+							inputSpread(spread);
+							for (i = 0; i < spread.size(); i++)
+								spread[i] *= noise;
+
+							for (row = 0; row < dataCount; row++)
+								for (copy = 0; copy < perRow; copy++)
+								{
+									for (i = 0; i < jittered.size(); i++)
+										jittered[i] = inputs[row][i] + spread[i] * gaussian(gen);
+									addRow(jittered.data());
+									syntheticCount++;
+								}
+						}
+
+	// access
+			trainingView & rows() { return view; }
+			unsigned int dataRows() const { return dataCount; }
+			unsigned int syntheticRows() const { return syntheticCount; }
+			const nnWeights & teacherWeights() const { return teacher; }
+
+	private:
+			void		addRow(const float * inputVector)
+						{
+							inputs.emplace_back(inputVector, inputVector + teacher.standardInputNodes());
+							targets.emplace_back(teacher.outputNodes());
+							teacher.run(inputVector, hiddenScratch.data(), targets.back().data());
+							view.add(&inputs.back(), &targets.back());
+						}
+
+			void		inputSpread(vector<float> & spread) const	// the standard deviation of each input over the data rows
+						{
+							vector<double> mean(spread.size(), 0.0), sumSquares(spread.size(), 0.0);
+							double delta;
+							unsigned int row, i;
+
+							for (row = 0; row < dataCount; row++)
+								for (i = 0; i < spread.size(); i++)
+								{
+									delta = inputs[row][i] - mean[i];
+									mean[i] += delta / (row + 1);
+									sumSquares[i] += delta * (inputs[row][i] - mean[i]);
+								}
+							for (i = 0; i < spread.size(); i++)
+								spread[i] = (dataCount > 0) ? (float)sqrt(sumSquares[i] / dataCount) : 0.0;
+						}
+
+	private:
+	nnWeights			teacher;
+	deque<vector<float> > inputs;			// the data rows first, then the synthetic ones
+	deque<vector<float> > targets;			// the teacher's outputs for each
+	trainingView		view;
+	vector<float>		hiddenScratch;
+	unsigned int		dataCount;
+	unsigned int		syntheticCount;
+};
+
+#endif	// _distiller_h
@@ -0,0 +1,434 @@
+#ifndef _ensembleEvaluator_h
+#define _ensembleEvaluator_h
+
+#include <glob.h>		// POSIX only
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "nn.hpp"
+
+/*
+ * ensembleEvaluator tests a set of saved networks (a model zoo) against one training file that is read in once.
+ *
+ * The models come from a glob pattern (e.g. "nets/shuttle*.enn") or from a manifest, @file, listing one .enn path per line
+ * (blank lines and lines starting with # are skipped, relative paths are relative to the manifest's directory).
+ *
+ * Models with the same topology are stacked (see stackedWeights): their hidden layers become one tall weight matrix,
+ * so each input row is read once and run through every model of the group in one sweep. The results are bit for bit
+ * the same as running each model on its own.
+ *
+ * The rows are shared between the workers of a threadPool a wave at a time while the calling thread adds the
+ * previous wave to the metrics in row order, so the metrics do not depend on the number of threads. Each model gets
+ * its own testMetrics. With a vote the models' outputs are also combined per row:
+ *	VOTE_AVERAGE	the mean of the models' output vectors
+ *	VOTE_MAJORITY	one hot on the class (argmax output node) picked by the most models, the lowest class on a tie
+ * and the combined output is added to ensembleMetrics() and handed to the row callback.
+ */
+
+const char ENN_ERR_NO_MODELS[] = "No network files matched";
+const char ENN_ERR_ENSEMBLE_TOPOLOGY[] = "A network does not fit the ensemble test file";
+
+enum ensemble_vote { VOTE_NONE, VOTE_AVERAGE, VOTE_MAJORITY };
+
+typedef void (*funcEnsembleCallback)(const int index, const float * outputVector, unsigned int outputs, void * data);
+
+class stackedWeights
+{
+	public:
+						stackedWeights(vector<nnWeights *> & models)
+						/*
+						 * Stack models, which must all have the same topology
+						 */
+						{
+							unsigned int m;
+
+							modelCount = (unsigned int)models.size();
+							stdInNodes = models[0]->standardInputNodes();
+							inNodes = models[0]->inputNodes();
+							hidNodes = models[0]->hiddenNodes();
+							outNodes = models[0]->outputNodes();
+							hasBias = models[0]->hasInputBiasNode();
+
+							for (m = 0; m < modelCount; m++)
+							{
+								hidWeights.insert(hidWeights.end(), models[m]->hiddenWeights(), models[m]->hiddenWeights() + hidNodes * inNodes);
+								hidBiases.insert(hidBiases.end(), models[m]->hiddenBiases(), models[m]->hiddenBiases() + hidNodes);
+								outWeights.insert(outWeights.end(), models[m]->outputWeights(), models[m]->outputWeights() + outNodes * hidNodes);
+								outBiases.insert(outBiases.end(), models[m]->outputBiases(), models[m]->outputBiases() + outNodes);
+							}
+						}
+
+			void		run(const float * inputVector, float * hiddenScratch, float * outputVectors) const
+			/*
+			 * Run one row through every model. hiddenScratch has room for models() * hiddenNodes() values and
+			 * outputVectors gets models() * outputNodes() values, model by model.
+			 */
+						{
+							unsigned int h, i, m, o;
+							const float * w;
+							const float * hidden;
+							float activationQuantity;
+
+							for (h = 0; h < modelCount * hidNodes; h++)		// every hidden node of every model, one tall matrix
+							{
+								w = &hidWeights[h * inNodes];
+								activationQuantity = 0.0;
+								for (i = 0; i < stdInNodes; i++)
+									activationQuantity += w[i] * inputVector[i];
+								if (hasBias)
+									activationQuantity += w[stdInNodes] * (float)1.0;
+
+								hiddenScratch[h] = nnWeights::f(hidBiases[h] + activationQuantity);
+							}
+
+							for (m = 0; m < modelCount; m++)
+							{
+								hidden = hiddenScratch + m * hidNodes;
+								for (o = 0; o < outNodes; o++)
+								{
+									w = &outWeights[(m * outNodes + o) * hidNodes];
+									activationQuantity = 0.0;
+									for (h = 0; h < hidNodes; h++)
+										activationQuantity += w[h] * hidden[h];
+
+									outputVectors[m * outNodes + o] = nnWeights::f(outBiases[m * outNodes + o] + activationQuantity);
+								}
+							}
+						}
+
+	// access
+			unsigned int	models() const { return modelCount; }
+			unsigned int	hiddenNodes() const { return hidNodes; }
+			unsigned int	outputNodes() const { return outNodes; }
+
+	private:
+	unsigned int		modelCount;
+	unsigned int		stdInNodes;
+	unsigned int		inNodes;
+	unsigned int		hidNodes;
+	unsigned int		outNodes;
+	bool				hasBias;
+
+	vector<float>		hidWeights;		// [model][hidden node][input node]
+	vector<float>		hidBiases;		// [model][hidden node]
+	vector<float>		outWeights;		// [model][output node][hidden node]
+	vector<float>		outBiases;		// [model][output node]
+};
+
+class ensembleEvaluator
+{
+	public:
+						ensembleEvaluator()
+						{
+							ensemble = NULL;
+						}
+
+						~ensembleEvaluator()
+						{
+							unsigned int m;
+
+							for (m = 0; m < weights.size(); m++)
+							{
+								delete weights[m];
+								if (metrics[m] != NULL)
+									delete metrics[m];
+							}
+							for (stackedWeights * group : groups)
+								delete group;
+							if (ensemble != NULL)
+								delete ensemble;
+						}
+
+	// setup
+			void		addModel(const char * cstrFilename)
+						{
+							ifstream * pFile;
+							networkFile * nFile;
+							nnWeights * newWeights;
+
+							pFile = new ifstream(cstrFilename);
+							if (!pFile->is_open())
+							{
+								delete pFile;
+								throw format_Error(ENN_ERR_NON_FILE);
+							}
+
+							nFile = new networkFile(pFile);
+							try
+							{
+								nFile->readInFile();
+								newWeights = new nnWeights(nFile);		// deleted in ~ensembleEvaluator
+							}
+							catch (format_Error & e)
+							{
+								delete nFile;
+								delete pFile;
+								throw;
+							}
+							delete nFile;
+							delete pFile;
+
+							weights.push_back(newWeights);
+							paths.push_back(cstrFilename);
+							metrics.push_back(NULL);
+						}
+
+			unsigned int addModels(const char * cstrPattern)
+			/*
+			 * Add every model matching a glob pattern, or listed in a manifest if the pattern starts with @. Returns the number added.
+			 */
+						{
+							vector<string> found;
+							glob_t matches;
+							string line, directory;
+							std::string::size_type slashPos;
+							size_t i;
+
+							if (cstrPattern[0] == '@')
+							{
+								ifstream manifest(cstrPattern + 1);
+
+								if (!manifest.is_open())
+									throw format_Error(ENN_ERR_NON_FILE);
+								directory = cstrPattern + 1;
+								slashPos = directory.rfind('/');
+								directory = (slashPos == std::string::npos) ? "" : directory.substr(0, slashPos + 1);
+
+								while (getline(manifest, line))
+								{
+									while ((line.size() > 0) && ((line.back() == '\r') || (line.back() == ' ')))
+										line.pop_back();
+									if ((line.size() == 0) || (line[0] == '#'))
+										continue;
+									found.push_back((line[0] == '/') ? line : directory + line);
+								}
+							}
+							else if (glob(cstrPattern, 0, NULL, &matches) == 0)
+							{
+								for (i = 0; i < matches.gl_pathc; i++)
+									found.push_back(matches.gl_pathv[i]);
+								globfree(&matches);
+							}
+
+							if (found.size() == 0)
+								throw format_Error(ENN_ERR_NO_MODELS);
+							for (i = 0; i < found.size(); i++)
+								addModel(found[i].c_str());
+							return (unsigned int)found.size();
+						}
+
+	// run
+			void		evaluate(trainingFile * testFile, const char * cstrMetricsSpec = "argmax", unsigned int threads = 1,
+									ensemble_vote vote = VOTE_NONE, funcEnsembleCallback rowComplete = NULL, void * data = NULL)
+			/*
+			 * Run every row of testFile through every model. rowComplete, if not NULL, is called on this thread in row
+			 * order with the combined output of each row (so only with a vote).
+			 */
+						{
+							unsigned int rows = testFile->inputLines();
+							unsigned int m, w, g;
+							size_t waveRows, first, count, r;
+							int buffer = 0;
+							vector<float> results[2];
+							vector<float> combined;
+							vector<vector<float> > hiddenScratch;
+							size_t maxHidden = 0;
+
+							if (weights.size() == 0)
+								throw format_Error(ENN_ERR_NO_MODELS);
+							outputs = weights[0]->outputNodes();
+							for (m = 0; m < weights.size(); m++)
+								if ((rows > 0) && ((testFile->inputSet(0)->size() != weights[m]->standardInputNodes()) || (testFile->outputSet(0)->size() != outputs)
+										|| (weights[m]->outputNodes() != outputs)))
+									throw format_Error(ENN_ERR_ENSEMBLE_TOPOLOGY);
+
+							stack();
+							for (m = 0; m < weights.size(); m++)
+							{
+								if (metrics[m] != NULL)
+									delete metrics[m];
+								metrics[m] = testMetrics::fromSpec(cstrMetricsSpec, outputs);	// deleted in ~ensembleEvaluator
+							}
+							if (ensemble != NULL)
+								delete ensemble;
+							ensemble = testMetrics::fromSpec(cstrMetricsSpec, outputs);			//	"
+							votes.assign(outputs, 0);
+							combined.resize(outputs);
+
+							threadPool pool(threads);
+							waveRows = parallelChunkRows * pool.workers() * 4;
+							results[0].resize(waveRows * weights.size() * outputs);
+							results[1].resize(waveRows * weights.size() * outputs);
+							for (g = 0; g < groups.size(); g++)
+								maxHidden = max(maxHidden, (size_t)groups[g]->models() * groups[g]->hiddenNodes());
+							hiddenScratch.resize(pool.workers());
+							for (w = 0; w < pool.workers(); w++)
+								hiddenScratch[w].resize(maxHidden);
+
+							auto startWave = [&](int waveBuffer, size_t waveFirst)
+							{
+								size_t waveCount = min(waveRows, (size_t)rows - waveFirst);
+
+								pool.start((waveCount + parallelChunkRows - 1) / parallelChunkRows, [&, waveBuffer, waveFirst, waveCount](unsigned int worker, size_t task)
+								{
+									size_t row;
+									size_t lastRow = min(waveCount, (task + 1) * parallelChunkRows);
+									size_t stride = weights.size() * outputs;
+									unsigned int group;
+
+									TRACE_SCOPE("ensemble chunk");
+
+									for (row = task * parallelChunkRows; row < lastRow; row++)
+										for (group = 0; group < groups.size(); group++)
+											groups[group]->run(testFile->inputSet(waveFirst + row)->data(), hiddenScratch[worker].data(),
+																results[waveBuffer].data() + row * stride + groupFirst[group] * outputs);
+								});
+							};
+
+							if (rows > 0)
+								startWave(buffer, 0);
+
+							for (first = 0; first < rows; first += count)
+							{
+								pool.wait();
+								count = min(waveRows, (size_t)rows - first);
+
+								if (first + count < rows)
+									startWave(1 - buffer, first + count);
+
+								for (r = 0; r < count; r++)
+								{
+									const float * rowResults = results[buffer].data() + r * weights.size() * outputs;
+									const float * desired = testFile->outputSet(first + r)->data();
+
+									for (m = 0; m < weights.size(); m++)
+										metrics[m]->add(desired, rowResults + slot[m] * outputs);
+
+									if (vote != VOTE_NONE)
+									{
+										combine(vote, rowResults, combined.data());
+										ensemble->add(desired, combined.data());
+										if (rowComplete != NULL)
+											rowComplete(first + r, combined.data(), outputs, data);
+									}
+								}
+
+								buffer = 1 - buffer;
+							}
+							pool.wait();
+						}
+
+	// access
+			unsigned int modelCount() { return (unsigned int)weights.size(); }
+			unsigned int groupCount() { return (unsigned int)groups.size(); }
+			const string & modelPath(unsigned int model) { return paths[model]; }
+			nnWeights	* model(unsigned int model) { return weights[model]; }
+			testMetrics * modelMetrics(unsigned int model) { return metrics[model]; }		// NULL before evaluate()
+			testMetrics * ensembleMetrics() { return ensemble; }						//	"
+
+			void		writeOn(ostream & outStr, ensemble_vote vote = VOTE_NONE)
+			/*
+			 * One line per model, then the summary of the combined outputs if there was a vote
+			 */
+						{
+							unsigned int m;
+
+							outStr << "Model\tNetwork\tVersion\tTopology\tRows\tMSE\tAccuracy\n";
+							for (m = 0; m < weights.size(); m++)
+							{
+								if (metrics[m] == NULL)
+									continue;
+								outStr << paths[m] << "\t" << weights[m]->networkName() << "\t" << weights[m]->major() << "." << weights[m]->minor() << "."
+										<< weights[m]->revis() << "\t" << weights[m]->inputNodes() << "-" << weights[m]->hiddenNodes() << "-" << weights[m]->outputNodes()
+										<< "\t" << metrics[m]->rowCount() << "\t" << metrics[m]->mse() << "\t" << metrics[m]->accuracy() << "\n";
+							}
+							if ((vote != VOTE_NONE) && (ensemble != NULL))
+							{
+								outStr << ((vote == VOTE_AVERAGE) ? "Ensemble average of " : "Ensemble majority vote of ") << weights.size() << " models\n";
+								ensemble->writeOn(outStr);
+							}
+						}
+
+	private:
+			void		stack()
+			/*
+			 * Group the models by topology and stack each group. slot[m] is model m's place in the stacked results of a row.
+			 */
+						{
+							vector<bool> placed(weights.size(), false);
+							vector<nnWeights *> members;
+							unsigned int m, n, next = 0;
+
+							for (stackedWeights * group : groups)
+								delete group;
+							groups.clear();
+							groupFirst.clear();
+							slot.assign(weights.size(), 0);
+
+							for (m = 0; m < weights.size(); m++)
+							{
+								if (placed[m])
+									continue;
+								members.clear();
+								groupFirst.push_back(next);
+								for (n = m; n < weights.size(); n++)
+									if (!placed[n] && weights[n]->sameTopology(*weights[m]) && (weights[n]->hasInputBiasNode() == weights[m]->hasInputBiasNode()))
+									{
+										placed[n] = true;
+										slot[n] = next++;
+										members.push_back(weights[n]);
+									}
+								groups.push_back(new stackedWeights(members));		// deleted in stack() or ~ensembleEvaluator
+							}
+						}
+
+			void		combine(ensemble_vote vote, const float * rowResults, float * combined)
+						{
+							unsigned int m, o, best;
+							const float * modelOut;
+
+							if (vote == VOTE_AVERAGE)
+							{
+								for (o = 0; o < outputs; o++)
+									combined[o] = 0.0;
+								for (m = 0; m < weights.size(); m++)
+									for (o = 0; o < outputs; o++)
+										combined[o] += rowResults[m * outputs + o];
+								for (o = 0; o < outputs; o++)
+									combined[o] /= weights.size();
+								return;
+							}
+
+							votes.assign(outputs, 0);
+							for (m = 0; m < weights.size(); m++)
+							{
+								modelOut = rowResults + m * outputs;
+								best = 0;
+								for (o = 1; o < outputs; o++)
+									if (modelOut[o] > modelOut[best])
+										best = o;
+								votes[best]++;
+							}
+							best = 0;
+							for (o = 1; o < outputs; o++)
+								if (votes[o] > votes[best])
+									best = o;
+							for (o = 0; o < outputs; o++)
+								combined[o] = (o == best) ? 1.0 : 0.0;
+						}
+
+	private:
+	vector<nnWeights *>	weights;			// in the order they were added
+	vector<string>		paths;
+	vector<testMetrics *> metrics;			// per model
+	testMetrics		*	ensemble;
+	unsigned int		outputs;
+
+	vector<stackedWeights *> groups;		// the models stacked by topology
+	vector<unsigned int> groupFirst;		// the slot of the first model of each group
+	vector<unsigned int> slot;				// per model
+	vector<unsigned int> votes;				// per output node, scratch for VOTE_MAJORITY
+};
+
+#endif	// _ensembleEvaluator_h
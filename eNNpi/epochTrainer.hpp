@@ -0,0 +1,370 @@
+#ifndef _epochTrainer_h
+#define _epochTrainer_h
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "nn.hpp"
+#include "backgroundValidator.hpp"
+
+/*
+ * epochTrainer trains a network for many passes (epochs) over a training file that has been read in once, or over a
+ * trainingView of rows from several files.
+ *
+ * Each epoch the rows are visited in a new random order. Only a permutation of the row indexes is shuffled,
+ * the rows themselves are never copied. After every epoch the training loss (the mean squared error of the
+ * pass, see nn::trainPass) and, if a validation file has been given, the validation loss (the mean squared
+ * error of nn::test over it) are reported to the epoch callback.
+ *
+ * The loss that decides when to stop is the validation loss if there is a validation file and the training
+ * loss if not. Training stops at the first of:
+ *
+ *	STOP_TARGET			the loss is at or below the target
+ *	STOP_PLATEAU		the loss has not improved on the best so far for patience epochs in a row
+ *	STOP_MAX_EPOCHS		maxEpochs epochs have been run
+ *	STOP_TIME_BUDGET	the wall clock time is over the budget
+ *
+ * With a decay factor set the learning rate is multiplied by it whenever the loss has not improved for
+ * decayPatience epochs in a row (patience / 2 unless set), before the plateau stops training altogether. These rules
+ * are kept by a stoppingRules object, which frozenTrainer and rpropTrainer use as well.
+ *
+ * With setBackground() the validation file is tested on a thread of its own (see backgroundValidator.hpp) against a
+ * snapshot of the weights taken every so many epochs or rows, and training carries on while it runs. The stopping
+ * rules then count validations instead of epochs: the patience is the number of validations in a row without an
+ * improvement. The results are picked up at the end of each epoch, so they can lag the training by up to an epoch,
+ * and the epoch report carries the newest one. With setKeepBest() the network ends up with the weights of the best
+ * snapshot rather than the last.
+ *
+ * run() bumps the network's revision once, however many epochs it runs.
+ */
+
+enum stop_reason { STOP_NONE, STOP_TARGET, STOP_PLATEAU, STOP_MAX_EPOCHS, STOP_TIME_BUDGET };
+
+struct epochReport
+{
+	unsigned int		epoch;				// 1 for the first epoch
+	double				trainingLoss;
+	double				validationLoss;		// -1 without a validation file, or before the first background result
+	float				learningRate;		// the rate the epoch was trained with
+	double				elapsedMs;			// since run() started
+	bool				isBest;				// the loss is the best so far (in the background, a new best arrived this epoch)
+};
+
+typedef void (*funcEpochCallback)(const epochReport &, void *);
+
+class stoppingRules
+/*
+ * The stopping rules and the learning rate decay of one training run. start() when the run starts, improved() with
+ * each loss that decides when to stop and endOfEpoch() after every epoch.
+ */
+{
+	public:
+						stoppingRules()
+						{
+							maxEpochs = 100;
+							patience = 0;
+							decayPatience = 0;
+							target = -1.0;
+							timeBudgetSeconds = 0.0;
+							decayFactor = 1.0;
+							start();
+						}
+
+	// setup
+			void		setMaxEpochs(unsigned int epochs) { maxEpochs = epochs; }
+			void		setPatience(unsigned int epochs) { patience = epochs; }				// 0 never stops on a plateau
+			void		setTarget(double targetLoss) { target = targetLoss; }				// < 0 has no target
+			void		setTimeBudget(double seconds) { timeBudgetSeconds = seconds; }		// 0 has no budget
+			void		setDecay(float factor, unsigned int epochs = 0) { decayFactor = factor; decayPatience = epochs; }
+
+	// use
+			void		start()
+						{
+							started = chrono::steady_clock::now();
+							best = -1.0;
+							sinceBest = sinceDecay = 0;
+						}
+
+			bool		improved(double loss)		// note a new loss, returns true if it is the best so far
+						{
+							if ((best < 0) || (loss < best))
+							{
+								best = loss;
+								sinceBest = sinceDecay = 0;
+								return true;
+							}
+							sinceBest++;
+							sinceDecay++;
+							return false;
+						}
+
+			stop_reason	endOfEpoch(unsigned int epoch, bool * decayDue)
+			/*
+			 * The rule that stops the run after epoch, or STOP_NONE. *decayDue is set when the run goes on and its
+			 * learning rate is to be multiplied by decay() now.
+			 */
+						{
+							*decayDue = false;
+							if ((target >= 0) && (best >= 0) && (best <= target))
+								return STOP_TARGET;
+							if ((patience > 0) && (sinceBest >= patience))
+								return STOP_PLATEAU;
+							if (epoch >= maxEpochs)
+								return STOP_MAX_EPOCHS;
+							if ((timeBudgetSeconds > 0) && (elapsedMs() >= timeBudgetSeconds * 1000))
+								return STOP_TIME_BUDGET;
+							if ((decayFactor != 1.0) && (sinceDecay >= decayEpochs()))
+							{
+								*decayDue = true;
+								sinceDecay = 0;
+							}
+							return STOP_NONE;
+						}
+
+	// access
+			double		elapsedMs() const { return chrono::duration<double, milli>(chrono::steady_clock::now() - started).count(); }
+			double		bestLoss() const { return best; }		// -1 before the first loss
+			float		decay() const { return decayFactor; }
+
+	private:
+			unsigned int decayEpochs() const
+						{
+							if (decayPatience > 0)
+								return decayPatience;
+							return (patience > 1) ? patience / 2 : 1;
+						}
+
+	private:
+	unsigned int		maxEpochs;
+	unsigned int		patience;
+	unsigned int		decayPatience;
+	double				target;
+	double				timeBudgetSeconds;
+	float				decayFactor;
+
+	chrono::steady_clock::time_point started;
+	double				best;					// the best loss so far in this run
+	unsigned int		sinceBest;				// losses since the best
+	unsigned int		sinceDecay;				// losses since the best or the last decay
+};
+
+class epochTrainer
+{
+	public:
+						epochTrainer(nn * newNet, trainingFile * newTrainingFile) : trFile(newTrainingFile)
+						{
+							initialise(newNet);
+						}
+
+						epochTrainer(nn * newNet, trainingView & newTrainingRows) : trFile(newTrainingRows)	// e.g. all of the folds but one
+						{
+							initialise(newNet);
+						}
+
+						~epochTrainer()
+						{
+							if (validationMetrics != NULL)
+								delete validationMetrics;
+							if (validator != NULL)
+								delete validator;
+						}
+
+	private:
+			void		initialise(nn * newNet)
+						{
+							theNet = newNet;
+							validationFile = NULL;
+							validationMetrics = NULL;
+							metricsSpec = "argmax";
+							backgroundEpochs = 0;
+							backgroundRows = 0;
+							keepBest = false;
+							validated = NULL;
+							validatedData = NULL;
+							validator = NULL;
+							seed = 1;
+							bestLoss = -1.0;
+							epochCount = 0;
+							epochComplete = NULL;
+							callbackData = NULL;
+						}
+
+	public:
+	// setup
+			void		setValidation(trainingFile * newValidationFile) { validationFile = newValidationFile; }
+			void		setMaxEpochs(unsigned int epochs) { rules.setMaxEpochs(epochs); }
+			void		setPatience(unsigned int epochs) { rules.setPatience(epochs); }
+			void		setTarget(double targetLoss) { rules.setTarget(targetLoss); }
+			void		setTimeBudget(double seconds) { rules.setTimeBudget(seconds); }
+			void		setDecay(float factor, unsigned int epochs = 0) { rules.setDecay(factor, epochs); }
+			void		setSeed(unsigned long newSeed) { seed = newSeed; }
+			void		setCallback(funcEpochCallback newCallback, void * data = NULL) { epochComplete = newCallback; callbackData = data; }
+			void		setMetrics(const char * cstrSpec) { metricsSpec = cstrSpec; }		// a -metrics spec for the validation accuracy
+
+			void		setBackground(unsigned int everyEpochs, unsigned int everyRows = 0, funcValidationCallback newCallback = NULL, void * data = NULL)
+			/*
+			 * Validate on a background thread against a snapshot taken every everyEpochs epochs, or every everyRows rows if
+			 * that is not 0. newCallback is called on the validation thread with each result. Both 0 validates on the
+			 * training thread after every epoch (the default).
+			 */
+						{
+							backgroundEpochs = everyEpochs;
+							backgroundRows = everyRows;
+							validated = newCallback;
+							validatedData = data;
+						}
+
+			void		setKeepBest(bool isOn) { keepBest = isOn; }		// finish with the best background snapshot's weights
+
+	// train
+			stop_reason	run()
+						{
+							mt19937 gen(seed);
+							vector<unsigned int> order(trFile.inputLines());
+							epochReport report;
+							validationResult result;
+							unsigned long rowsTrained = 0;
+							unsigned int i;
+							stop_reason reason = STOP_NONE;
+							bool decayDue;
+
+							for (i = 0; i < order.size(); i++)
+								order[i] = i;
+
+							rules.start();
+							theNet->setLearningRate(theNet->learningRate());		// make sure the nodes train with the network's rate
+
+							if ((validationFile != NULL) && ((backgroundEpochs > 0) || (backgroundRows > 0)))
+								validator = new backgroundValidator(validationFile, testMetrics::fromSpec(metricsSpec.c_str(), theNet->outputNodes()),
+																	validated, validatedData);		// deleted at the end of run()
+
+							report.validationLoss = -1.0;
+							for (report.epoch = 1; reason == STOP_NONE; report.epoch++)
+							{
+								shuffle(order.begin(), order.end(), gen);
+
+								report.learningRate = theNet->learningRate();
+								report.trainingLoss = trainEpoch(order, report.epoch, &rowsTrained);
+
+								if (validator != NULL)
+								{
+									report.isBest = false;
+									if ((backgroundRows == 0) && (report.epoch % backgroundEpochs == 0))
+										validator->submit(theNet->snapshot(), report.epoch, rowsTrained);
+									while (validator->poll(&result))
+									{
+										report.validationLoss = result.mse;
+										if (rules.improved(result.mse))
+											report.isBest = true;
+									}
+								}
+								else
+								{
+									report.validationLoss = (validationFile != NULL) ? validate() : -1.0;
+									report.isBest = rules.improved((validationFile != NULL) ? report.validationLoss : report.trainingLoss);
+								}
+								report.elapsedMs = rules.elapsedMs();
+
+								if (epochComplete != NULL)
+									epochComplete(report, callbackData);
+
+								reason = rules.endOfEpoch(report.epoch, &decayDue);
+								if (decayDue)
+									theNet->setLearningRate(theNet->learningRate() * rules.decay());
+							}
+
+							if (validator != NULL)
+							{
+								validator->drain();
+								while (validator->poll(&result))
+									rules.improved(result.mse);
+								if (keepBest && (validator->bestWeights() != NULL))
+									theNet->setWeights((nnWeights *)validator->bestWeights());
+								delete validator;
+								validator = NULL;
+							}
+
+							theNet->trainingRunComplete();
+							bestLoss = rules.bestLoss();
+							epochCount = report.epoch - 1;
+
+							return reason;
+						}
+
+	// access
+			double		bestLossSeen() { return bestLoss; }
+			unsigned int epochsRun() { return epochCount; }
+
+	static	const char *	stopReasonName(stop_reason reason)
+						{
+							switch (reason)
+							{
+								case STOP_TARGET:		return "target reached";
+								case STOP_PLATEAU:		return "no improvement within the patience";
+								case STOP_MAX_EPOCHS:	return "maximum epochs";
+								case STOP_TIME_BUDGET:	return "time budget used up";
+								default:				return "not stopped";
+							}
+						}
+
+	private:
+			double		trainEpoch(vector<unsigned int> & order, unsigned int epoch, unsigned long * rowsTrained)
+			/*
+			 * Train one epoch, submitting a snapshot to the background validator every backgroundRows rows if that is set.
+			 * Returns the training loss of the whole epoch.
+			 */
+						{
+							unsigned int first, rows;
+							double sumLoss = 0.0;
+
+							if ((validator == NULL) || (backgroundRows == 0))
+							{
+								*rowsTrained += order.size();
+								return theNet->trainPass(&trFile, order.data());
+							}
+
+							for (first = 0; first < order.size(); first += rows)
+							{
+								rows = min(backgroundRows - (unsigned int)(*rowsTrained % backgroundRows), (unsigned int)order.size() - first);
+								sumLoss += theNet->trainPass(&trFile, order.data(), first, rows) * rows;
+								*rowsTrained += rows;
+								if (*rowsTrained % backgroundRows == 0)
+									validator->submit(theNet->snapshot(), epoch, *rowsTrained);
+							}
+							return order.empty() ? 0.0 : sumLoss / order.size();
+						}
+
+			double		validate()
+						{
+							if (validationMetrics == NULL)
+								validationMetrics = testMetrics::fromSpec(metricsSpec.c_str(), theNet->outputNodes());	// deleted in ~epochTrainer
+							validationMetrics->reset();
+							theNet->test(validationFile, NULL, validationMetrics);
+							return validationMetrics->mse();
+						}
+
+	private:
+	nn				*	theNet;
+	trainingView		trFile;					// the rows to train with
+	trainingFile	*	validationFile;
+	testMetrics		*	validationMetrics;
+	string				metricsSpec;
+	backgroundValidator * validator;			// only while run() is running
+
+	unsigned int		backgroundEpochs;
+	unsigned int		backgroundRows;
+	bool				keepBest;
+	funcValidationCallback validated;
+	void			*	validatedData;
+
+	stoppingRules		rules;
+	unsigned long		seed;
+	double				bestLoss;
+	unsigned int		epochCount;
+
+	funcEpochCallback	epochComplete;
+	void			*	callbackData;
+};
+
+#endif	// _epochTrainer_h
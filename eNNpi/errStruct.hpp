@@ -19,6 +19,10 @@ const char ENN_ERR_LINE_DECODE_FAILED[] = "Did not find expected line delimiter"
 const char ENN_ERR_UNK_MODIFIER[] = "Unknown Layer Modifier";
 const char ENN_ERR_BIAS_NODE_ON_INVALID_LAYER[] = "Bias node requested on an output only node";
 const char ENN_ERR_KEY_VALUE_FORMAT_ERROR[] = "Key:Value format error";
+const char ENN_ERR_RESULT_FILE[] = "Could not create the result file";
+const char ENN_ERR_UNK_RESULT_FORMAT[] = "Unknown result format, use tsv, csv or bin";
+const char ENN_ERR_UNK_METRICS[] = "Unknown metrics, use argmax or threshold[:value] optionally followed by +sign";
+const char ENN_ERR_INCOMPLETE_NETWORK_FILE[] = "Network file is incomplete or still being written";
 
 struct format_Error
 {
@@ -37,6 +41,7 @@ struct format_Error
 const char ENN_ERR_TRAIN_WAITFORTRAIN[] = "Zero return from ResetEvent";
 const char ENN_ERR_TRAIN_TRAIN[] = "Zero return from SetEvent";
 const char ENN_ERR_TRAIN_WAITFOREVENT[] = "WAIT_FAILED return from Wait";
+const char ENN_ERR_WATCH_FAILED[] = "Could not watch the network file path";
 
 struct internal_Error
 {
@@ -0,0 +1,375 @@
+#ifndef _halfWeights_h
+#define _halfWeights_h
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HALF_X86_KERNEL
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || (defined(__ARM_NEON_FP) && (__ARM_NEON_FP & 2)))
+#include <arm_neon.h>
+#define HALF_NEON_KERNEL
+#endif
+#include "nnWeights.hpp"
+#include "networkFile.hpp"
+
+/*
+ * halfWeights is a 16 bit copy of a network's weights and biases for inference, in half (IEEE fp16) or bfloat16.
+ *
+ *	fp16	11 bits of precision, values up to 65504: the closest copy for weights of a normal size
+ *	bf16	8 bits of precision, the range of a float: for networks with very large or very small weights
+ *
+ * The weights take half the memory of nnWeights and half the bandwidth to read. Each row of weights is widened to
+ * float 8 at a time as it is used and multiplied into 8 partial sums in float:
+ *
+ *	x86		vcvtph2ps (F16C) for fp16, a zero extend and shift (AVX2) for bf16. The kernel is built for AVX2 and F16C
+ *			whatever the build flags and is used when the processor has them (checked once per copy)
+ *	NEON	vcvt_f32_f16 for fp16 and a widening shift for bf16, 4 at a time in two halves (aarch64, or 32 bit ARM
+ *			built with -mfpu=neon-fp16 or neon-vfpv4)
+ *
+ * The partial sums add the terms up in a different order from nnWeights::run(), so the results may differ from the
+ * float network's in the last bits as well as by the rounding of the weights (to the nearest, ties to even). Without
+ * a vector kernel each weight is widened on its own (in software for fp16 unless the build has -mf16c) and the sums
+ * are made in the same order as nnWeights::run(), so the only difference is the rounding of the weights.
+ *
+ * The format is chosen per network: a network file saved with -half carries a storage(fp16) or storage(bf16) line
+ * (see networkFile) after its float weights, so it still loads and trains as a float network and
+ * halfWeights(networkFile *) makes the 16 bit copy the file asks for.
+ */
+
+enum half_format {HALF_FP16, HALF_BF16};
+
+const char ENN_ERR_UNK_HALF_FORMAT[] = "Unknown 16 bit format, use fp16 or bf16";
+const char ENN_ERR_NO_HALF_STORAGE[] = "The network file has no storage line, save it with -half";
+
+class halfWeights
+{
+	public:
+	typedef float		scratchType;
+
+						halfWeights(const nnWeights & source, half_format newFormat)
+						{
+							format = newFormat;
+							setWeights(source);
+						}
+
+						halfWeights(networkFile * nFile)
+						/*
+						 * A 16 bit copy of the network in nFile, in the format of its storage line
+						 */
+						{
+							if (nFile->weightStorage().size() == 0)
+								throw format_Error(ENN_ERR_NO_HALF_STORAGE);
+							if (!formatFromName(nFile->weightStorage(), &format))
+								throw format_Error(ENN_ERR_UNK_HALF_FORMAT);
+
+							nnWeights floatWeights(nFile);
+							setWeights(floatWeights);
+						}
+
+	static	bool		formatFromName(const string & name, half_format * newFormat)
+						{
+							if (name == "fp16")
+								*newFormat = HALF_FP16;
+							else if (name == "bf16")
+								*newFormat = HALF_BF16;
+							else
+								return false;
+							return true;
+						}
+
+	static	const char * formatName(half_format aFormat) { return (aFormat == HALF_FP16) ? "fp16" : "bf16"; }
+
+	// run
+			void		run(const float * inputVector, float * scratch, float * outputVector) const
+			/*
+			 * scratch has room for scratchSize() values and outputVector for outputNodes() values
+			 */
+						{
+							if (format == HALF_FP16)
+								runAs<HALF_FP16>(inputVector, scratch, outputVector);
+							else
+								runAs<HALF_BF16>(inputVector, scratch, outputVector);
+						}
+
+	// access
+			half_format	storageFormat() const { return format; }
+			unsigned int standardInputNodes() const { return stdInNodes; }
+			unsigned int hiddenNodes() const { return hidNodes; }
+			unsigned int outputNodes() const { return outNodes; }
+			unsigned int scratchSize() const { return hidNodes; }
+
+			size_t		weightBytes() const { return (hidWeights.size() + hidBiases.size() + outWeights.size() + outBiases.size()) * sizeof(uint16_t); }
+			size_t		floatWeightBytes() const { return weightBytes() * 2; }
+
+	// conversion
+	static	uint16_t	toHalf(float value)		// IEEE fp16, round to nearest even
+						{
+							uint32_t bits, sign, mantissa;
+							int exponent;
+							uint32_t shift, halfBits, remainder, halfway;
+
+							memcpy(&bits, &value, sizeof(bits));
+							sign = (bits >> 16) & 0x8000;
+							exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+							mantissa = bits & 0x7fffff;
+
+							if (((bits >> 23) & 0xff) == 0xff)		// inf or nan
+								return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+							if (exponent >= 31)						// too big, inf
+								return (uint16_t)(sign | 0x7c00);
+							if (exponent <= 0)						// subnormal or zero
+							{
+								if (exponent < -10)
+									return (uint16_t)sign;
+								mantissa |= 0x800000;
+								shift = (uint32_t)(14 - exponent);
+								halfBits = mantissa >> shift;
+								remainder = mantissa & ((1u << shift) - 1);
+								halfway = 1u << (shift - 1);
+								if ((remainder > halfway) || ((remainder == halfway) && (halfBits & 1)))
+									halfBits++;
+								return (uint16_t)(sign | halfBits);
+							}
+
+							halfBits = ((uint32_t)exponent << 10) | (mantissa >> 13);
+							remainder = mantissa & 0x1fff;
+							if ((remainder > 0x1000) || ((remainder == 0x1000) && (halfBits & 1)))
+								halfBits++;			// may carry into the exponent, up to inf, which is right
+							return (uint16_t)(sign | halfBits);
+						}
+
+	static	float		fromHalf(uint16_t half)
+			/*
+			 * Move the exponent and mantissa into place and rebias; only infinities, nans and subnormals (rare in
+			 * weights) need more, the subnormals being normalised by a float subtraction
+			 */
+						{
+							uint32_t bits = (uint32_t)(half & 0x7fff) << 13;
+							uint32_t exponent = bits & 0x0f800000;
+							const uint32_t magicBits = 113u << 23;
+							float value, magic;
+
+							bits += (127 - 15) << 23;
+							if (exponent == 0x0f800000)			// inf or nan
+								bits += (128 - 16) << 23;
+							else if (exponent == 0)				// zero or subnormal
+							{
+								bits += 1 << 23;
+								memcpy(&value, &bits, sizeof(value));
+								memcpy(&magic, &magicBits, sizeof(magic));
+								value -= magic;
+								memcpy(&bits, &value, sizeof(bits));
+							}
+							bits |= (uint32_t)(half & 0x8000) << 16;
+							memcpy(&value, &bits, sizeof(value));
+							return value;
+						}
+
+	static	uint16_t	toBfloat16(float value)		// round to nearest even
+						{
+							uint32_t bits;
+
+							memcpy(&bits, &value, sizeof(bits));
+							if ((bits & 0x7fffffff) > 0x7f800000)		// nan stays a nan
+								return (uint16_t)((bits >> 16) | 0x40);
+							bits += 0x7fff + ((bits >> 16) & 1);
+							return (uint16_t)(bits >> 16);
+						}
+
+	static	float		fromBfloat16(uint16_t bf)
+						{
+							uint32_t bits = (uint32_t)bf << 16;
+							float value;
+
+							memcpy(&value, &bits, sizeof(value));
+							return value;
+						}
+
+	private:
+			void		setWeights(const nnWeights & source)
+						{
+							stdInNodes = source.standardInputNodes();
+							inNodes = source.inputNodes();
+							hidNodes = source.hiddenNodes();
+							outNodes = source.outputNodes();
+							hasBias = source.hasInputBiasNode();
+							vectorKernel = hasVectorKernel();
+
+							narrow(source.hiddenWeights(), hidWeights, (size_t)hidNodes * inNodes);
+							narrow(source.hiddenBiases(), hidBiases, hidNodes);
+							narrow(source.outputWeights(), outWeights, (size_t)outNodes * hidNodes);
+							narrow(source.outputBiases(), outBiases, outNodes);
+						}
+
+			void		narrow(const float * values, vector<uint16_t> & stored, size_t count)
+						{
+							size_t i;
+
+							stored.resize(count);
+							for (i = 0; i < count; i++)
+								stored[i] = (format == HALF_FP16) ? toHalf(values[i]) : toBfloat16(values[i]);
+						}
+
+			template <half_format storedAs> static float widen(uint16_t stored)
+						{
+							if (storedAs == HALF_BF16)
+								return fromBfloat16(stored);
+#ifdef __F16C__
+							return _cvtsh_ss(stored);
+#else
+							return fromHalf(stored);
+#endif
+						}
+
+			template <half_format storedAs> float rowSum(const uint16_t * w, const float * x, unsigned int count) const
+			/*
+			 * The sum of w[i] * x[i], by the vector kernel if there is one, else in order one weight at a time
+			 */
+						{
+							float sum = 0.0;
+							unsigned int i;
+
+#if defined(HALF_X86_KERNEL) || defined(HALF_NEON_KERNEL)
+							if (vectorKernel && (count >= 8))
+								return (storedAs == HALF_FP16) ? rowSumHalf(w, x, count) : rowSumBfloat16(w, x, count);
+#endif
+							for (i = 0; i < count; i++)
+								sum += widen<storedAs>(w[i]) * x[i];
+							return sum;
+						}
+
+#if defined(HALF_X86_KERNEL)
+	static	bool		hasVectorKernel() { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"); }
+
+	static	float		horizontalSum(__m256 sums) __attribute__((target("avx2")))
+						{
+							__m128 half = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+
+							half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+							half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+							return _mm_cvtss_f32(half);
+						}
+
+	static	float		rowSumHalf(const uint16_t * w, const float * x, unsigned int count) __attribute__((target("avx2,f16c")))
+						{
+							__m256 sums = _mm256_setzero_ps();
+							unsigned int i;
+							float sum;
+
+							for (i = 0; i + 8 <= count; i += 8)
+								sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(w + i))), _mm256_loadu_ps(x + i)));
+							sum = horizontalSum(sums);
+							for (; i < count; i++)
+								sum += _cvtsh_ss(w[i]) * x[i];
+							return sum;
+						}
+
+	static	float		rowSumBfloat16(const uint16_t * w, const float * x, unsigned int count) __attribute__((target("avx2")))
+						{
+							__m256 sums = _mm256_setzero_ps();
+							__m256i wide;
+							unsigned int i;
+							float sum;
+
+							for (i = 0; i + 8 <= count; i += 8)
+							{
+								wide = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(w + i))), 16);
+								sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_castsi256_ps(wide), _mm256_loadu_ps(x + i)));
+							}
+							sum = horizontalSum(sums);
+							for (; i < count; i++)
+								sum += fromBfloat16(w[i]) * x[i];
+							return sum;
+						}
+#elif defined(HALF_NEON_KERNEL)
+	static	bool		hasVectorKernel() { return true; }
+
+	static	float		horizontalSum(float32x4_t low, float32x4_t high)
+						{
+							float32x4_t sums = vaddq_f32(low, high);
+							float32x2_t half = vadd_f32(vget_low_f32(sums), vget_high_f32(sums));
+
+							return vget_lane_f32(vpadd_f32(half, half), 0);
+						}
+
+	static	float		rowSumHalf(const uint16_t * w, const float * x, unsigned int count)
+						{
+							float32x4_t low = vdupq_n_f32(0.0), high = vdupq_n_f32(0.0);
+							unsigned int i;
+							float sum;
+
+							for (i = 0; i + 8 <= count; i += 8)
+							{
+								low = vmlaq_f32(low, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(w + i))), vld1q_f32(x + i));
+								high = vmlaq_f32(high, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(w + i + 4))), vld1q_f32(x + i + 4));
+							}
+							sum = horizontalSum(low, high);
+							for (; i < count; i++)
+								sum += fromHalf(w[i]) * x[i];
+							return sum;
+						}
+
+	static	float		rowSumBfloat16(const uint16_t * w, const float * x, unsigned int count)
+						{
+							float32x4_t low = vdupq_n_f32(0.0), high = vdupq_n_f32(0.0);
+							unsigned int i;
+							float sum;
+
+							for (i = 0; i + 8 <= count; i += 8)
+							{
+								low = vmlaq_f32(low, vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(w + i), 16)), vld1q_f32(x + i));
+								high = vmlaq_f32(high, vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(w + i + 4), 16)), vld1q_f32(x + i + 4));
+							}
+							sum = horizontalSum(low, high);
+							for (; i < count; i++)
+								sum += fromBfloat16(w[i]) * x[i];
+							return sum;
+						}
+#else
+	static	bool		hasVectorKernel() { return false; }
+#endif
+
+			template <half_format storedAs> void runAs(const float * inputVector, float * hiddenVector, float * outputVector) const
+			/*
+			 * The same layers as nnWeights::run(), a row of weights at a time through rowSum()
+			 */
+						{
+							unsigned int h, o;
+							float activationQuantity;
+
+							for (h = 0; h < hidNodes; h++)
+							{
+								activationQuantity = rowSum<storedAs>(&hidWeights[(size_t)h * inNodes], inputVector, stdInNodes);
+								if (hasBias)
+									activationQuantity += widen<storedAs>(hidWeights[(size_t)h * inNodes + stdInNodes]) * (float)1.0;
+
+								hiddenVector[h] = nnWeights::f(widen<storedAs>(hidBiases[h]) + activationQuantity);
+							}
+
+							for (o = 0; o < outNodes; o++)
+							{
+								activationQuantity = rowSum<storedAs>(&outWeights[(size_t)o * hidNodes], hiddenVector, hidNodes);
+								outputVector[o] = nnWeights::f(widen<storedAs>(outBiases[o]) + activationQuantity);
+							}
+						}
+
+	private:
+	half_format			format;
+	unsigned int		stdInNodes;
+	unsigned int		inNodes;			// including any input bias node
+	unsigned int		hidNodes;
+	unsigned int		outNodes;
+	bool				hasBias;
+	bool				vectorKernel;		// rowSum() uses the AVX2 and F16C or NEON kernel
+
+	vector<uint16_t>	hidWeights;			// [hidden][input], as in nnWeights
+	vector<uint16_t>	hidBiases;
+	vector<uint16_t>	outWeights;			// [output][hidden]
+	vector<uint16_t>	outBiases;
+};
+
+#endif	// _halfWeights_h
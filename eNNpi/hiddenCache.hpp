@@ -0,0 +1,301 @@
+#ifndef _hiddenCache_h
+#define _hiddenCache_h
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "nnWeights.hpp"
+#include "epochTrainer.hpp"
+
+/*
+ * Output layer only training from cached hidden node values.
+ *
+ * hiddenCache runs every row of a training set through the hidden layer once and keeps the hidden node values as one
+ * contiguous [row][hidden node] matrix of floats, with the desired outputs in a second one. The matrix is in memory, or
+ * with a spill directory in a file there that is mapped into memory (mmap), so a cache bigger than memory is paged
+ * by the kernel. The file is unlinked as soon as it is mapped and goes when the cache does.
+ *
+ * frozenTrainer then trains the output layer of an nnWeights copy of the network from the cache, epoch after epoch,
+ * with the hidden layer frozen. Each row costs one output layer forward pass and one update; nothing of the input or
+ * hidden layer is run again. The update is the one the node and link objects make (see outputNode and nnLink), with
+ * the learning rate and momentum of the network, so the output layer trains exactly as it does in nn::train() but for
+ * the hidden layer standing still. As in outputNode the bias is adjusted once for every link into the node. For a
+ * pruned network keepPruned() leaves the output weights that are 0 at 0, as pruned links do.
+ *
+ * The epochs stop by the rules of epochTrainer (see stoppingRules), on the loss over a second cache of validation rows
+ * if setValidation() has given one and on the training loss if not. A decay multiplies the trainer's learning rate.
+ *
+ *	hiddenCache cache(*snapshot);
+ *	cache.fill(trainingFile, spillDir);		// "" to keep it in memory
+ *	frozenTrainer trainer(snapshot, &cache, learningRate, momentum);
+ *	trainer.run();
+ *	theNet->setWeights(snapshot);
+ */
+
+const char ENN_ERR_CACHE_TOPOLOGY[] = "The training file does not fit the network";
+const char ENN_ERR_CACHE_SPILL[] = "Could not create the hidden node cache file";
+
+class hiddenCache
+{
+	public:
+						hiddenCache(const nnWeights & source) : weights(source)
+						{
+							values = NULL;
+							mappedBytes = 0;
+							rowCount = 0;
+						}
+
+						~hiddenCache() { release(); }
+
+			template <class trainingRows> void fill(trainingRows * rows, const string & spillDir)
+			/*
+			 * Run every row through the hidden layer into the cache, in a mapped file in spillDir if it is not empty
+			 */
+						{
+							unsigned int row, hidNodes = weights.hiddenNodes();
+							size_t bytes;
+
+							if ((rows->inputLines() > 0) && ((rows->inputSet(0)->size() != weights.standardInputNodes())
+									|| (rows->outputSet(0)->size() != weights.outputNodes())))
+								throw format_Error(ENN_ERR_CACHE_TOPOLOGY);
+
+							release();
+							rowCount = rows->inputLines();
+							bytes = (size_t)rowCount * hidNodes * sizeof(float);
+							if (spillDir.size() > 0)
+								mapFile(spillDir, bytes);
+							else
+							{
+								inMemory.resize((size_t)rowCount * hidNodes);
+								values = inMemory.data();
+							}
+
+							desired.resize((size_t)rowCount * weights.outputNodes());
+							for (row = 0; row < rowCount; row++)
+							{
+								weights.runHidden(rows->inputSet(row)->data(), values + (size_t)row * hidNodes);
+								copy(rows->outputSet(row)->begin(), rows->outputSet(row)->end(), desired.begin() + (size_t)row * weights.outputNodes());
+							}
+						}
+
+	// access
+			unsigned int rows() const { return rowCount; }
+			unsigned int hiddenNodes() const { return weights.hiddenNodes(); }
+			unsigned int outputNodes() const { return weights.outputNodes(); }
+			const float * hiddenRow(unsigned int row) const { return values + (size_t)row * weights.hiddenNodes(); }
+			const float * desiredRow(unsigned int row) const { return desired.data() + (size_t)row * weights.outputNodes(); }
+			bool		isMapped() const { return mappedBytes > 0; }
+			size_t		bytes() const { return (size_t)rowCount * weights.hiddenNodes() * sizeof(float); }
+
+	private:
+			void		mapFile(const string & spillDir, size_t bytes)
+						{
+							string path = spillDir + "/ennHiddenXXXXXX";
+							vector<char> cstrPath(path.begin(), path.end());
+							void * mapped;
+							int fd;
+
+							cstrPath.push_back('\0');
+							if ((fd = mkstemp(cstrPath.data())) < 0)
+								throw format_Error(ENN_ERR_CACHE_SPILL);
+							unlink(cstrPath.data());
+							if (bytes == 0)
+								bytes = 1;
+							if (ftruncate(fd, bytes) != 0)
+							{
+								close(fd);
+								throw format_Error(ENN_ERR_CACHE_SPILL);
+							}
+							mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+							close(fd);		// the mapping keeps the file
+							if (mapped == MAP_FAILED)
+								throw format_Error(ENN_ERR_CACHE_SPILL);
+
+							values = (float *)mapped;
+							mappedBytes = bytes;
+						}
+
+			void		release()
+						{
+							if (mappedBytes > 0)
+								munmap(values, mappedBytes);
+							mappedBytes = 0;
+							inMemory.clear();
+							values = NULL;
+						}
+
+	private:
+	nnWeights			weights;
+	float			*	values;				// [row][hidden node], inMemory's or mapped
+	vector<float>		inMemory;
+	size_t				mappedBytes;		// 0 when not mapped
+	vector<float>		desired;			// [row][output node]
+	unsigned int		rowCount;
+};
+
+class frozenTrainer
+{
+	public:
+						frozenTrainer(nnWeights * newWeights, const hiddenCache * newCache, float newLearningRate, float newMomentum)
+						{
+							theWeights = newWeights;
+							cache = newCache;
+							learningRate = newLearningRate;
+							momentum = newMomentum;
+							lastWeightChange.assign((size_t)theWeights->outputNodes() * theWeights->hiddenNodes(), 0.0);
+							lastBiasChange.assign(theWeights->outputNodes(), 0.0);
+							outputVector.resize(theWeights->outputNodes());
+							validationCache = NULL;
+							rules.setMaxEpochs(16);
+							seed = 1;
+							epochComplete = NULL;
+							callbackData = NULL;
+						}
+
+	// setup, as for epochTrainer
+			void		setValidation(const hiddenCache * newValidationCache) { validationCache = newValidationCache; }
+			void		setMaxEpochs(unsigned int epochs) { rules.setMaxEpochs(epochs); }
+			void		setPatience(unsigned int epochs) { rules.setPatience(epochs); }
+			void		setTarget(double targetLoss) { rules.setTarget(targetLoss); }
+			void		setTimeBudget(double seconds) { rules.setTimeBudget(seconds); }
+			void		setDecay(float factor, unsigned int epochs = 0) { rules.setDecay(factor, epochs); }
+			void		setSeed(unsigned long newSeed) { seed = newSeed; }
+			void		setCallback(funcEpochCallback newCallback, void * data = NULL) { epochComplete = newCallback; callbackData = data; }
+
+			void		keepPruned()	// leave the output weights that are 0 now at 0, for a pruned network
+						{
+							size_t i;
+
+							pruned.assign(lastWeightChange.size(), false);
+							for (i = 0; i < pruned.size(); i++)
+								pruned[i] = (theWeights->outputWeights()[i] == 0.0);
+						}
+
+	// train
+			double		trainEpoch(const unsigned int * order)
+			/*
+			 * One pass over the cache in the given order (every row once). Returns the mean squared error of the pass,
+			 * taken before each row's update, as nn::trainPass() does.
+			 */
+						{
+							unsigned int i, row, h, o, hidNodes = cache->hiddenNodes(), outNodes = cache->outputNodes();
+							const float * hiddenVector;
+							const float * desiredVector;
+							float * w;
+							float * lastChange;
+							float nodeValue, outputError, change, diff;
+							double sumSquared = 0.0;
+
+							for (i = 0; i < cache->rows(); i++)
+							{
+								row = order[i];
+								hiddenVector = cache->hiddenRow(row);
+								desiredVector = cache->desiredRow(row);
+								theWeights->runOutput(hiddenVector, outputVector.data());
+
+								for (o = 0; o < outNodes; o++)
+								{
+									nodeValue = outputVector[o];
+									diff = desiredVector[o] - nodeValue;
+									sumSquared += diff * diff;
+									outputError = nodeValue * (1 - nodeValue) * diff;
+
+									w = theWeights->outputWeights() + (size_t)o * hidNodes;
+									lastChange = &lastWeightChange[(size_t)o * hidNodes];
+									for (h = 0; h < hidNodes; h++)
+									{
+										if (!pruned.empty() && pruned[(size_t)o * hidNodes + h])
+											continue;
+										change = (learningRate * hiddenVector[h]) * outputError;
+										w[h] += change + (lastChange[h] * momentum);
+										lastChange[h] = change;
+									}
+									for (h = 0; h < hidNodes; h++)		// outputNode::adjustBiasReturningOutputError() once per link
+									{
+										change = outputError * learningRate;
+										theWeights->outputBiases()[o] += change + (lastBiasChange[o] * momentum);
+										lastBiasChange[o] = change;
+									}
+								}
+							}
+
+							return (cache->rows() == 0) ? 0.0 : sumSquared / ((double)cache->rows() * outNodes);
+						}
+
+			stop_reason	run()	// shuffled epochs until a stopping rule is met, see epochTrainer
+						{
+							mt19937 gen(seed);
+							vector<unsigned int> order(cache->rows());
+							epochReport report;
+							unsigned int i;
+							stop_reason reason = STOP_NONE;
+							bool decayDue;
+
+							for (i = 0; i < order.size(); i++)
+								order[i] = i;
+
+							rules.start();
+							for (report.epoch = 1; reason == STOP_NONE; report.epoch++)
+							{
+								shuffle(order.begin(), order.end(), gen);
+								report.learningRate = learningRate;
+								report.trainingLoss = trainEpoch(order.data());
+								report.validationLoss = (validationCache != NULL) ? validate() : -1.0;
+								report.isBest = rules.improved((validationCache != NULL) ? report.validationLoss : report.trainingLoss);
+								report.elapsedMs = rules.elapsedMs();
+
+								if (epochComplete != NULL)
+									epochComplete(report, callbackData);
+
+								reason = rules.endOfEpoch(report.epoch, &decayDue);
+								if (decayDue)
+									learningRate *= rules.decay();
+							}
+							return reason;
+						}
+
+			double		validate()		// the mean squared error of the output layer over the validation cache
+						{
+							unsigned int row, o, outNodes = validationCache->outputNodes();
+							const float * desiredVector;
+							float diff;
+							double sumSquared = 0.0;
+
+							for (row = 0; row < validationCache->rows(); row++)
+							{
+								theWeights->runOutput(validationCache->hiddenRow(row), outputVector.data());
+								desiredVector = validationCache->desiredRow(row);
+								for (o = 0; o < outNodes; o++)
+								{
+									diff = desiredVector[o] - outputVector[o];
+									sumSquared += diff * diff;
+								}
+							}
+							return (validationCache->rows() == 0) ? 0.0 : sumSquared / ((double)validationCache->rows() * outNodes);
+						}
+
+			double		bestLossSeen() const { return rules.bestLoss(); }
+
+	private:
+	nnWeights		*	theWeights;			// the output layer is trained in place
+	const hiddenCache *	cache;
+	float				learningRate;
+	float				momentum;
+	vector<float>		lastWeightChange;	// [output][hidden], for the momentum
+	vector<float>		lastBiasChange;
+	vector<bool>		pruned;				// [output][hidden], empty unless keepPruned()
+	vector<float>		outputVector;
+	const hiddenCache *	validationCache;	// NULL stops on the training loss
+
+	stoppingRules		rules;
+	unsigned long		seed;
+	funcEpochCallback	epochComplete;
+	void			*	callbackData;
+};
+
+#endif	// _hiddenCache_h
@@ -0,0 +1,308 @@
+#ifndef _hotNetwork_h
+#define _hotNetwork_h
+
+#include <sys/stat.h>		// POSIX only
+#include <sys/inotify.h>	// Linux only
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <fstream>
+#include "networkFile.hpp"
+#include "nnWeights.hpp"
+
+typedef void (*funcReloadCallback)(const nnWeights *, void *);
+
+/*
+ * hotNetwork keeps a long running process up to date with the newest saved version of a network.
+ *
+ * Give it either a .enn file or a directory. A background thread watches the directory with inotify and
+ * whenever a .enn file is closed after writing, or moved into the directory, it is read in through
+ * networkFile. If the file is complete, belongs to the same network (same name) and has a newer
+ * major/minor/revision than the one being served, its weights are published by swapping a single atomic
+ * pointer.
+ *
+ * Readers call current() (or run()) which takes a reference counted pointer to the published weights, so:
+ *	- nobody waits for a reload, the reload thread does all the parsing
+ *	- a run that started on the old weights finishes on the old weights, which are freed when the last
+ *	  reader lets go of them (RCU style)
+ *	- a half written file is never published, networkFile::isComplete() must pass first
+ *
+ * A new major version may change the topology. Each nnWeights object carries its own topology so callers
+ * should size their output vectors from the weights they actually ran on; run() does this for you.
+ *
+ *	typedef void (*funcReloadCallback)(const nnWeights * newWeights, void * thisObject);
+ *	is called on the reload thread after every publish (including the first load)
+ */
+
+class hotNetwork
+{
+	public:
+						hotNetwork(const char * cstrPath, funcReloadCallback reloaded = NULL, void * callerData = NULL)
+						{
+							struct stat fileAtt;
+							string strPath = cstrPath;
+							std::string::size_type slashPos;
+
+							reloadComplete = reloaded;
+							reloadData = callerData;
+							reloadCount = 0;
+							stopWatching = false;
+							watchFd = -1;
+
+							if (stat(cstrPath, &fileAtt) != 0)
+								throw format_Error(ENN_ERR_NON_FILE);
+
+							if (S_ISDIR(fileAtt.st_mode))
+							{
+								watchDir = strPath;
+								watchFile = "";
+							}
+							else
+							{
+								slashPos = strPath.rfind('/');
+								if (slashPos == std::string::npos)
+								{
+									watchDir = ".";
+									watchFile = strPath;
+								}
+								else
+								{
+									watchDir = strPath.substr(0, slashPos);
+									watchFile = strPath.substr(slashPos + 1);
+								}
+							}
+
+							if (!loadNewest())
+								throw format_Error(ENN_ERR_NON_FILE);
+
+							watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+							if (watchFd < 0)
+								throw internal_Error(ENN_ERR_WATCH_FAILED);
+							if (inotify_add_watch(watchFd, watchDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+							{
+								close(watchFd);
+								throw internal_Error(ENN_ERR_WATCH_FAILED);
+							}
+
+							watcher = thread(&hotNetwork::watch, this);
+						}
+
+						~hotNetwork()
+						{
+							stopWatching = true;
+							if (watcher.joinable())
+								watcher.join();
+							if (watchFd >= 0)
+								close(watchFd);
+						}
+
+	// run
+			shared_ptr<const nnWeights> current() const
+			/*
+			 * Return the weights being served right now. Hold on to the pointer for as long as you need a
+			 * consistent set of weights, e.g. for one request.
+			 */
+						{
+							return atomic_load(&published);
+						}
+
+			status_t	run(vector<float> * inputVector, vector<float> * outputVector)
+			/*
+			 * Run inputVector through the current weights. outputVector is resized to the output width of the
+			 * weights that were actually used. Returns FAILURE if the input vector does not fit the network.
+			 *
+			 * Safe to call from any number of threads at once.
+			 */
+						{
+							static thread_local vector<float> hiddenScratch;
+							shared_ptr<const nnWeights> theWeights = current();
+
+							if (inputVector->size() != theWeights->standardInputNodes())
+								return FAILURE;
+
+							if (hiddenScratch.size() < theWeights->hiddenNodes())
+								hiddenScratch.resize(theWeights->hiddenNodes());
+							if (outputVector->size() != theWeights->outputNodes())
+								outputVector->resize(theWeights->outputNodes());
+
+							theWeights->run(inputVector->data(), hiddenScratch.data(), outputVector->data());
+							return SUCCESS;
+						}
+
+	// reload
+			bool		reload(const char * cstrFilename)
+			/*
+			 * Read cstrFilename and publish it if it is a complete, newer version of the network being served.
+			 * Returns true if the new weights were published. Called by the watch thread but safe to call directly.
+			 */
+						{
+							ifstream * pFile;
+							networkFile * nFile;
+							shared_ptr<const nnWeights> newWeights;
+							shared_ptr<const nnWeights> oldWeights;
+
+							pFile = new ifstream(cstrFilename);
+							if (!pFile->is_open())
+							{
+								delete pFile;
+								return false;
+							}
+
+							nFile = new networkFile(pFile);
+							try
+							{
+								nFile->readInFile();
+								newWeights = make_shared<const nnWeights>(nFile);
+							}
+							catch (format_Error & e)
+							{
+								// a damaged or half written file, keep serving what we have
+							}
+							delete nFile;
+							delete pFile;
+
+							if (!newWeights)
+								return false;
+
+							lock_guard<mutex> publishing(reloadLock);	// only reloads wait on this, readers never do
+
+							oldWeights = current();
+							if (oldWeights)
+								if ((newWeights->networkName() != oldWeights->networkName()) || !newWeights->isNewerThan(*oldWeights))
+									return false;
+
+							atomic_store(&published, newWeights);
+							reloadCount++;
+
+							if (reloadComplete != NULL)
+								reloadComplete(newWeights.get(), reloadData);
+
+							return true;
+						}
+
+			unsigned int reloads() { return reloadCount; }	// the number of times new weights have been published
+
+	static	bool		splitDefaultName(const string & fileName, string & netName, unsigned int & major, unsigned int & minor, unsigned int & revis)
+			/*
+			 * Split a file name made by nn::defaultName(), <network Name>_<majorVersion>_<minorVersion>_<revision>.enn
+			 * The network name may itself contain underscores.
+			 */
+						{
+							std::string::size_type namePos[3];
+							std::string::size_type endPos;
+							int i;
+
+							if ((fileName.size() < 4) || (fileName.compare(fileName.size() - 4, 4, ".enn") != 0))
+								return false;
+
+							endPos = fileName.size() - 4;
+							for (i = 2; i >= 0; i--)
+							{
+								namePos[i] = fileName.rfind('_', endPos - 1);
+								if ((namePos[i] == std::string::npos) || (namePos[i] == 0))
+									return false;
+								endPos = namePos[i];
+							}
+
+							netName = fileName.substr(0, namePos[0]);
+							major = atoi(fileName.c_str() + namePos[0] + 1);
+							minor = atoi(fileName.c_str() + namePos[1] + 1);
+							revis = atoi(fileName.c_str() + namePos[2] + 1);
+
+							return true;
+						}
+
+	private:
+			bool		wanted(const char * cstrName)
+						{
+							std::string::size_type nameLength = strlen(cstrName);
+
+							if (watchFile.size() > 0)
+								return watchFile == cstrName;
+
+							return (nameLength > 4) && (strcmp(cstrName + nameLength - 4, ".enn") == 0);
+						}
+
+			bool		loadNewest()
+			/*
+			 * Load the watched file, or the .enn file in the watched directory with the highest version in its name
+			 */
+						{
+							DIR * theDir;
+							struct dirent * entry;
+							string netName, bestName, bestFile;
+							unsigned int major, minor, revis;
+							unsigned int bestMajor = 0, bestMinor = 0, bestRevis = 0;
+							bool found = false;
+
+							if (watchFile.size() > 0)
+								return reload((watchDir + "/" + watchFile).c_str());
+
+							if ((theDir = opendir(watchDir.c_str())) == NULL)
+								return false;
+
+							while ((entry = readdir(theDir)) != NULL)
+								if (splitDefaultName(entry->d_name, netName, major, minor, revis))
+									if (!found || (major > bestMajor) || ((major == bestMajor) && ((minor > bestMinor) || ((minor == bestMinor) && (revis > bestRevis)))))
+									{
+										found = true;
+										bestFile = entry->d_name;
+										bestMajor = major;
+										bestMinor = minor;
+										bestRevis = revis;
+									}
+							closedir(theDir);
+
+							if (!found)
+								return false;
+
+							return reload((watchDir + "/" + bestFile).c_str());
+						}
+
+			void		watch()		// the reload thread
+						{
+							char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+							const struct inotify_event * event;
+							struct pollfd pollFd;
+							ssize_t length;
+							char * pos;
+
+							pollFd.fd = watchFd;
+							pollFd.events = POLLIN;
+
+							while (!stopWatching)
+							{
+								if (poll(&pollFd, 1, 200) <= 0)
+									continue;	// timed out, check stopWatching again
+
+								while ((length = read(watchFd, buffer, sizeof(buffer))) > 0)
+									for (pos = buffer; pos < buffer + length; pos += sizeof(struct inotify_event) + event->len)
+									{
+										event = (const struct inotify_event *)pos;
+										if ((event->len > 0) && wanted(event->name))
+											reload((watchDir + "/" + event->name).c_str());
+									}
+							}
+						}
+
+	private:
+	shared_ptr<const nnWeights>	published;		// only ever read or written with atomic_load and atomic_store
+	string					watchDir;
+	string					watchFile;		// empty if the whole directory is being watched
+	int						watchFd;
+	thread					watcher;
+	atomic<bool>			stopWatching;
+	atomic<unsigned int>	reloadCount;
+	mutex					reloadLock;		// serialises reloads so an older file can never overwrite a newer one
+
+	funcReloadCallback		reloadComplete;
+	void				*	reloadData;
+};
+
+#endif	// _hotNetwork_h
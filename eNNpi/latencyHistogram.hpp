@@ -0,0 +1,185 @@
+#ifndef _latencyHistogram_h
+#define _latencyHistogram_h
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std ;
+
+/*
+ * latencyHistogram counts latencies in log spaced buckets, in the style of an HDR histogram.
+ *
+ * Values below 32ns have a bucket each. Above that every power of two is split into 16 buckets, so a value is
+ * never more than 1/16 (6.25%) below the top of its bucket, from nanoseconds up to a couple of days. The
+ * largest value is also kept exactly. The percentiles report the top of the bucket the percentile falls in.
+ *
+ * A histogram has one writer: record() is a relaxed load and store, no lock and no read-modify-write, and
+ * nothing is allocated. Other threads can read it (e.g. to merge it) at any time and see counts that are at
+ * most a few rows out of date.
+ *
+ * latencyRecorder holds one histogram per thread (slot) so that threads never share one. merged() adds them
+ * up on demand.
+ */
+
+const unsigned int latencySubBuckets = 16;
+const unsigned int latencyBuckets = 32 + latencySubBuckets * 44;		// up to 2^48 ns
+
+class latencyHistogram
+{
+	public:
+						latencyHistogram()
+						{
+							reset();
+						}
+
+						latencyHistogram(const latencyHistogram & other)
+						{
+							reset();
+							merge(other);
+						}
+
+			void		reset()
+						{
+							unsigned int i;
+
+							for (i = 0; i < latencyBuckets; i++)
+								counts[i].store(0, memory_order_relaxed);
+							total.store(0, memory_order_relaxed);
+							largest.store(0, memory_order_relaxed);
+						}
+
+			void		record(unsigned long long ns)		// only call from the thread that owns this histogram
+						{
+							unsigned int i = bucket(ns);
+
+							counts[i].store(counts[i].load(memory_order_relaxed) + 1, memory_order_relaxed);
+							total.store(total.load(memory_order_relaxed) + 1, memory_order_relaxed);
+							if (ns > largest.load(memory_order_relaxed))
+								largest.store(ns, memory_order_relaxed);
+						}
+
+			void		merge(const latencyHistogram & other)	// add other into this, this must not be being recorded into
+						{
+							unsigned int i;
+
+							for (i = 0; i < latencyBuckets; i++)
+								counts[i].store(counts[i].load(memory_order_relaxed) + other.counts[i].load(memory_order_relaxed), memory_order_relaxed);
+							total.store(total.load(memory_order_relaxed) + other.total.load(memory_order_relaxed), memory_order_relaxed);
+							if (other.largest.load(memory_order_relaxed) > largest.load(memory_order_relaxed))
+								largest.store(other.largest.load(memory_order_relaxed), memory_order_relaxed);
+						}
+
+	// access
+			unsigned long long count() const { return total.load(memory_order_relaxed); }
+			unsigned long long max() const { return largest.load(memory_order_relaxed); }
+
+			unsigned long long percentile(double p) const
+			/*
+			 * The top of the bucket holding the p'th percentile (p in 0..100), or max() if that is lower
+			 */
+						{
+							unsigned long long rank, seen = 0;
+							unsigned long long top;
+							unsigned int i;
+
+							if (count() == 0)
+								return 0;
+							rank = (unsigned long long)(p / 100.0 * count());
+							if (rank >= count())
+								rank = count() - 1;
+
+							for (i = 0; i < latencyBuckets; i++)
+							{
+								seen += counts[i].load(memory_order_relaxed);
+								if (seen > rank)
+									break;
+							}
+							top = bucketTop(i);
+							return (top < max()) ? top : max();
+						}
+
+	static	void		writeTitle(ostream & outStr)
+						{
+							outStr << "Latency\tRows\tp50 us\tp90 us\tp99 us\tp99.9 us\tmax us\n";
+						}
+
+			void		writeOn(ostream & outStr, const char * label) const		// one row of the percentile table
+						{
+							outStr << label << "\t" << count() << "\t" << percentile(50) / 1e3 << "\t" << percentile(90) / 1e3 << "\t"
+									<< percentile(99) / 1e3 << "\t" << percentile(99.9) / 1e3 << "\t" << max() / 1e3 << "\n";
+						}
+
+	static	unsigned int bucket(unsigned long long ns)
+						{
+							unsigned int msb, shift;
+
+							if (ns < 32)
+								return (unsigned int)ns;
+							msb = 63 - __builtin_clzll(ns);
+							shift = msb - 4;
+							if (latencySubBuckets * shift + (ns >> shift) >= latencyBuckets)
+								return latencyBuckets - 1;
+							return latencySubBuckets * shift + (unsigned int)(ns >> shift);
+						}
+
+	static	unsigned long long bucketTop(unsigned int i)
+						{
+							unsigned int shift;
+
+							if (i < 32)
+								return i;
+							shift = i / latencySubBuckets - 1;
+							return (((unsigned long long)(i % latencySubBuckets + latencySubBuckets + 1)) << shift) - 1;
+						}
+
+	private:
+	atomic<unsigned long long>	counts[latencyBuckets];
+	atomic<unsigned long long>	total;
+	atomic<unsigned long long>	largest;
+};
+
+class latencyRecorder
+{
+	public:
+						latencyRecorder(unsigned int slotCount = 1)
+						{
+							slots(slotCount);
+						}
+
+			void		slots(unsigned int slotCount)	// make sure there are at least slotCount slots, call before the threads start
+						{
+							while (histograms.size() < slotCount)
+								histograms.push_back(unique_ptr<latencyHistogram>(new latencyHistogram()));
+						}
+
+			latencyHistogram & slot(unsigned int i) { return *histograms[i]; }
+
+			latencyHistogram merged() const
+						{
+							latencyHistogram all;
+
+							for (const unique_ptr<latencyHistogram> & h : histograms)
+								all.merge(*h);
+							return all;
+						}
+
+			void		reset()
+						{
+							for (unique_ptr<latencyHistogram> & h : histograms)
+								h->reset();
+						}
+
+	static	unsigned long long now()
+						{
+							return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+						}
+
+	private:
+	vector<unique_ptr<latencyHistogram> >	histograms;
+};
+
+#endif	// _latencyHistogram_h
@@ -1,18 +1,96 @@
 
 #include "nn.hpp"
+#include "epochTrainer.hpp"
+#include "crossValidator.hpp"
+#include "sweepEngine.hpp"
+#include "ensembleEvaluator.hpp"
+#include "hotNetwork.hpp"
+#include "modelStore.hpp"
+#include "quantizedWeights.hpp"
+#include "halfWeights.hpp"
+#include "sparseWeights.hpp"
+#include "nodeActivity.hpp"
+#include "distiller.hpp"
+#include "outputSolver.hpp"
+#include "hiddenCache.hpp"
+#include "rpropTrainer.hpp"
+#include "resultSink.hpp"
+
+resultSink * theSink = NULL;		// created by openSink() once -o has been given, deleted at the end of main
+string sinkPath;
+string sinkFormat = "tsv";
+bool sinkBackground = false;
+string metricsSpec;				// set by -metrics, empty for the old row by row -test output
+bool rowsWanted = false;			// write each -test row to standard output as well as the metrics summary
+unsigned int threadCount = 1;		// set by -threads and passed to the network before each -run and -test
+unsigned int maxEpochs = 0;		// set by -epochs, 0 trains one pass per -t as before
+unsigned int epochPatience = 0;		// -patience
+double epochTarget = -1.0;			// -target
+double epochBudget = 0.0;			// -budget, in seconds
+float epochDecay = 1.0;				// -decay
+bool rpropAlgorithm = false;		// -algo rprop: -t trains by iRPROP+ rather than by the network's own SGD
+string validationPath;				// -validate
+unsigned int backgroundEpochs = 0;	// -vasync %n, 0 validates on the training thread
+unsigned int backgroundRows = 0;	// -vasync %nr
+bool keepBest = false;				// -best+ OR -best-
+ensemble_vote ensembleVote = VOTE_NONE;	// -vote
+quantizedWeights * theQuantized = NULL;	// set by -quantize or -int8, compared with the float network after each -test
+halfWeights * theHalf = NULL;			// set by -half or -f16,	"
+unsigned int sweepSamples = 0;		// -samples, 0 sweeps the whole grid
+unsigned int sweepRungEpochs = 1;	// -rung
+bool latencyWanted = false;		// set by -latency: write a latency percentile table after each -t, -run and -test
+string statsDest;					// set by -stats: - for standard output or the name of a JSON file
+
+resultSink * openSink()
+/*
+ * Return the result sink for -run and -test or NULL if results go to standard output
+ */
+{
+	if ((theSink == NULL) && (sinkPath.size() > 0))
+	{
+		if (sinkFormat == "tsv")
+			theSink = new textSink(sinkPath.c_str(), '\t', sinkBackground);
+		else if (sinkFormat == "csv")
+			theSink = new textSink(sinkPath.c_str(), ',', sinkBackground);
+		else if (sinkFormat == "bin")
+			theSink = new binarySink(sinkPath.c_str(), sinkBackground);
+		else
+			throw format_Error(ENN_ERR_UNK_RESULT_FORMAT);
+	}
+	return theSink;
+}
+
+void closeSink()	// the next -run or -test will open a new sink with the current settings
+{
+	if (theSink != NULL)
+	{
+		if (theSink->failed())
+			cout << "Error: not all of the results could be written to " << sinkPath << "\n";
+		delete theSink;
+		theSink = NULL;
+	}
+}
 
 void callback_RunComplete(const int index, void * caller)
 {
-	vector<float> * resVec;	// created by the net
+	static vector<float> resVec;	// reused for every row
 	unsigned int i;
 
-	resVec = new vector<float>(((nn*)caller)->outputNodes());
-	resVec = ((nn*)caller)->runResult(resVec);
+	resVec.resize(((nn*)caller)->outputNodes());
+	((nn*)caller)->runResult(&resVec);
 	cout << "Index: " << index << " results -";
-	for(i = 0; i< resVec->size(); i++)
-		cout << " " << i << ": " << (*resVec)[i];
+	for(i = 0; i< resVec.size(); i++)
+		cout << " " << i << ": " << resVec[i];
 	cout << "\n";
-	delete resVec;
+}
+
+void callback_RunToSink(const int index, void * caller)
+{
+	static vector<float> resVec;	// reused for every row
+
+	resVec.resize(((nn*)caller)->outputNodes());
+	((nn*)caller)->runResult(&resVec);
+	theSink->runRow(index, resVec.data(), resVec.size());
 }
 
 void callback_TrainingComplete(void * caller)
@@ -65,6 +143,777 @@ void callback_TestComplete(const int index, vector<float>* inputVector, vector<f
 	cout << "\n";
 }
 
+void callback_Reloaded(const nnWeights * newWeights, void * caller)
+{
+	cerr << "Serving " << newWeights->networkName() << " version " << newWeights->major() << "." << newWeights->minor() << "." << newWeights->revis() << "\n";
+}
+
+void callback_EpochComplete(const epochReport & report, void * caller)
+{
+	cout << "Epoch: " << report.epoch << " training loss: " << report.trainingLoss;
+	if (report.validationLoss >= 0)
+		cout << " validation loss: " << report.validationLoss;
+	cout << " learning rate: " << report.learningRate << " ms: " << report.elapsedMs << (report.isBest ? " best" : "") << "\n";
+}
+
+void callback_Validated(const validationResult & result, void * caller)	// called on the validation thread
+{
+	char buffer[160];
+
+	snprintf(buffer, sizeof(buffer), "Validation: epoch %u rows %lu MSE: %g accuracy: %g ms: %g%s\n", result.epoch, result.rowsTrained,
+				result.mse, result.accuracy, result.elapsedMs, result.isBest ? " best" : "");
+	cout << buffer << flush;		// one write so that it does not split an epoch line
+}
+
+class loadedTrainingFile
+/*
+ * A training file read whole into memory, freed with its stream when this goes out of scope
+ */
+{
+	public:
+		loadedTrainingFile() {}
+		loadedTrainingFile(const char * cstrFilename) { load(cstrFilename); }
+
+		void load(const char * cstrFilename)
+		{
+			file.reset();
+			stream.reset(new ifstream(cstrFilename));
+			if (!stream->is_open())
+				throw format_Error(ENN_ERR_NON_FILE);
+			file.reset(new trainingFile(stream.get()));
+			file->readInFile();
+		}
+
+		trainingFile * get() const { return file.get(); }		// NULL if nothing has been loaded
+
+	private:
+		unique_ptr<ifstream>		stream;		// declared first so that it outlives file
+		unique_ptr<trainingFile>	file;
+};
+
+void trainEpochs(nn * theNet, const char * cstrFilename)
+/*
+ * -t with -epochs: read the training file (and any -validate file) once and train until one of the stopping rules is met
+ */
+{
+	loadedTrainingFile trFile(cstrFilename);
+	loadedTrainingFile validation;
+	stop_reason reason;
+
+	if (validationPath.size() > 0)
+		validation.load(validationPath.c_str());
+
+	epochTrainer trainer(theNet, trFile.get());
+	trainer.setValidation(validation.get());
+	trainer.setMaxEpochs(maxEpochs);
+	trainer.setPatience(epochPatience);
+	trainer.setTarget(epochTarget);
+	trainer.setTimeBudget(epochBudget);
+	trainer.setDecay(epochDecay);
+	trainer.setCallback(&callback_EpochComplete);
+	if (metricsSpec.size() > 0)
+		trainer.setMetrics(metricsSpec.c_str());
+	trainer.setBackground(backgroundEpochs, backgroundRows, &callback_Validated);
+	trainer.setKeepBest(keepBest);
+
+	reason = trainer.run();
+	cout << "Stopped: " << epochTrainer::stopReasonName(reason) << " best loss: " << trainer.bestLossSeen() << "\n";
+}
+
+void trainRprop(nn * theNet, const char * cstrFilename)
+/*
+ * -t with -algo rprop: read the training file (and any -validate file) once and train a copy of the weights by full
+ * batch iRPROP+ for the -epochs rules (16 epochs if none), carrying on from the network's last rprop run
+ */
+{
+	loadedTrainingFile trFile(cstrFilename);
+	loadedTrainingFile validation;
+	stop_reason reason;
+
+	if (validationPath.size() > 0)
+		validation.load(validationPath.c_str());
+
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	rpropTrainer trainer(snapshot.get(), theNet->rpropTrainingState());
+	trainer.setValidation(validation.get());
+	trainer.setMaxEpochs((maxEpochs > 0) ? maxEpochs : 16);
+	trainer.setPatience(epochPatience);
+	trainer.setTarget(epochTarget);
+	trainer.setTimeBudget(epochBudget);
+	trainer.setDecay(epochDecay);
+	trainer.setThreads(threadCount);
+	trainer.setCallback(&callback_EpochComplete);
+	if (theNet->prunedLinks() > 0)
+		trainer.keepPruned();
+
+	reason = trainer.run(trFile.get());
+	cout << "Stopped: " << epochTrainer::stopReasonName(reason) << " best loss: " << trainer.bestLossSeen() << "\n";
+
+	theNet->setWeights(snapshot.get());
+	theNet->trainingRunComplete();
+}
+
+void configureFold(epochTrainer & trainer, nn * foldNet, unsigned int fold, void * data)	// called on the fold's worker thread
+{
+	trainer.setMaxEpochs((maxEpochs > 0) ? maxEpochs : 1);
+	trainer.setPatience(epochPatience);
+	trainer.setTarget(epochTarget);
+	trainer.setTimeBudget(epochBudget);
+	trainer.setDecay(epochDecay);
+	trainer.setSeed(fold + 1);
+}
+
+void crossValidate(nn * theNet, const char * cstrFoldList, const char * cstrSavePath)
+/*
+ * -cv: read every fold file in the comma separated list once, then train and test a copy of theNet per fold in parallel
+ */
+{
+	string foldList = cstrFoldList;
+	vector<string> foldPaths;
+	vector<trainingFile *> folds;
+	std::string::size_type start = 0, comma;
+	unsigned int fold;
+
+	do
+	{
+		comma = foldList.find(',', start);
+		foldPaths.push_back(foldList.substr(start, (comma == std::string::npos) ? std::string::npos : comma - start));
+		start = comma + 1;
+	}
+	while (comma != std::string::npos);
+
+	vector<loadedTrainingFile> loaded(foldPaths.size());
+	for (fold = 0; fold < foldPaths.size(); fold++)
+	{
+		loaded[fold].load(foldPaths[fold].c_str());
+		folds.push_back(loaded[fold].get());
+	}
+
+	crossValidator validator(folds);
+	validator.setConfigure(&configureFold);
+	validator.run(theNet, (strcmp(cstrSavePath, "-") == 0) ? NULL : cstrSavePath, (metricsSpec.size() > 0) ? metricsSpec.c_str() : "argmax");
+	validator.writeOn(cout);
+}
+
+void sweep(nn * theNet, const char * cstrSpace, const char * cstrFilename, unsigned int bestCount, const char * cstrSavePath)
+/*
+ * -sweep: race the candidates in the space with successive halving on a single read of the training (and -validate) file
+ */
+{
+	network_description * base = theNet->networkDescription();
+	sweepPoint basePoint;
+	vector<sweepPoint> points;
+
+	sweepSpace space(cstrSpace);
+	basePoint.hidden = base->hiddenNodes();
+	basePoint.learningRate = base->trainingLearningRate();
+	basePoint.momentum = base->trainingMomentum();
+	basePoint.biasNode = base->hasInputLayerBiasNode();
+	points = (sweepSamples > 0) ? space.sample(basePoint, sweepSamples, 1) : space.grid(basePoint);
+
+	loadedTrainingFile trFile(cstrFilename);
+	loadedTrainingFile validation;
+	if (validationPath.size() > 0)
+		validation.load(validationPath.c_str());
+
+	sweepEngine engine(trFile.get(), validation.get());
+	engine.setSchedule(sweepRungEpochs, (maxEpochs > 0) ? maxEpochs : 16);
+	engine.run(theNet, points);
+	engine.writeOn(cout);
+	if (strcmp(cstrSavePath, "-") != 0)
+		cout << "Saved: " << engine.saveBest(bestCount, cstrSavePath) << "\n";
+}
+
+void callback_EnsembleRow(const int index, const float * outputVector, unsigned int outputs, void * data)
+{
+	unsigned int i;
+
+	if (theSink != NULL)
+		theSink->runRow(index, outputVector, outputs);
+	else
+	{
+		cout << "Index: " << index << " results -";
+		for (i = 0; i < outputs; i++)
+			cout << " " << i << ": " << outputVector[i];
+		cout << "\n";
+	}
+}
+
+void evaluateEnsemble(const char * cstrModels, const char * cstrFilename)
+/*
+ * -ensemble: read the test file once and run every model matching cstrModels over it
+ */
+{
+	funcEnsembleCallback rowCallback = NULL;
+
+	ensembleEvaluator evaluator;
+	evaluator.addModels(cstrModels);
+
+	loadedTrainingFile testFile(cstrFilename);
+	if ((openSink() != NULL) || rowsWanted)
+		rowCallback = &callback_EnsembleRow;
+	evaluator.evaluate(testFile.get(), (metricsSpec.size() > 0) ? metricsSpec.c_str() : "argmax", threadCount, ensembleVote, rowCallback);
+	evaluator.writeOn(cout, ensembleVote);
+}
+
+void quantize(nn * theNet, const char * cstrFilename, const char * cstrPath)
+/*
+ * -quantize: calibrate an int8 copy of the network on a training file and save the network with its quantized section
+ */
+{
+	stringstream quantizedSection;
+	string strContent;
+	char cstrFileName[255];
+	char cstrPathFile[512];
+
+	loadedTrainingFile calibration(cstrFilename);
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	unique_ptr<quantizedWeights> calibrated(new quantizedWeights(*snapshot));
+	calibrated->calibrate(calibration.get());
+	if (theQuantized != NULL)
+		delete theQuantized;
+	theQuantized = calibrated.release();
+
+	cout << "Quantized: int8 weight bytes: " << theQuantized->weightBytes() << " float weight bytes: " << theQuantized->floatWeightBytes()
+			<< " input scale: " << theQuantized->inputScale() << " hidden scale: " << theQuantized->hiddenScale() << "\n";
+
+	if (strcmp(cstrPath, "-") != 0)
+	{
+		theNet->saveOn(&strContent);
+		theQuantized->saveOn(quantizedSection);
+		strContent += quantizedSection.str();
+
+		snprintf(cstrPathFile, sizeof(cstrPathFile), "%s//%s", cstrPath, theNet->defaultName(cstrFileName));
+		ofstream outFile(cstrPathFile);
+		if (!outFile.is_open())
+			throw format_Error(ENN_ERR_NON_FILE);
+		outFile << strContent;
+	}
+}
+
+void loadQuantized(const char * cstrFilename)
+/*
+ * -int8: read the quantized section of a network file
+ */
+{
+	ifstream netFile(cstrFilename);
+	networkFile nFile(&netFile);
+
+	if (!netFile.is_open())
+		throw format_Error(ENN_ERR_NON_FILE);
+	nFile.readInFile();
+
+	quantizedWeights * loaded = new quantizedWeights(&nFile);
+	if (theQuantized != NULL)
+		delete theQuantized;
+	theQuantized = loaded;
+}
+
+template <class reducedWeights> void testReduced(nn * theNet, const char * cstrFilename, reducedWeights * reduced, const char * cstrLabel)
+/*
+ * After -test: run the test file through the float weights and a reduced copy of them (int8, 16 bit or CSR) and compare them
+ */
+{
+	unique_ptr<testMetrics> floatMetrics, reducedMetrics;
+	vector<float> hiddenScratch, outputVector;
+	vector<typename reducedWeights::scratchType> reducedScratch;
+	chrono::steady_clock::time_point started;
+	double floatNs = 0.0, reducedNs = 0.0;
+	unsigned int row;
+
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	if ((snapshot->standardInputNodes() != reduced->standardInputNodes()) || (snapshot->hiddenNodes() != reduced->hiddenNodes())
+			|| (snapshot->outputNodes() != reduced->outputNodes()))
+	{
+		cout << "The " << cstrLabel << " network does not have the same topology as the network, make it again\n";
+		return;
+	}
+
+	loadedTrainingFile loaded(cstrFilename);
+	trainingFile * testFile = loaded.get();
+
+	floatMetrics.reset(testMetrics::fromSpec((metricsSpec.size() > 0) ? metricsSpec.c_str() : "argmax", snapshot->outputNodes()));
+	reducedMetrics.reset(testMetrics::fromSpec((metricsSpec.size() > 0) ? metricsSpec.c_str() : "argmax", snapshot->outputNodes()));
+	hiddenScratch.resize(snapshot->hiddenNodes());
+	outputVector.resize(snapshot->outputNodes());
+	reducedScratch.resize(reduced->scratchSize());
+
+	for (row = 0; row < testFile->inputLines(); row++)
+	{
+		started = chrono::steady_clock::now();
+		snapshot->run(testFile->inputSet(row)->data(), hiddenScratch.data(), outputVector.data());
+		floatNs += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+		floatMetrics->add(testFile->outputSet(row)->data(), outputVector.data());
+
+		started = chrono::steady_clock::now();
+		reduced->run(testFile->inputSet(row)->data(), reducedScratch.data(), outputVector.data());
+		reducedNs += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+		reducedMetrics->add(testFile->outputSet(row)->data(), outputVector.data());
+	}
+
+	if (testFile->inputLines() > 0)
+	{
+		cout << "Float MSE: " << floatMetrics->mse() << " accuracy: " << floatMetrics->accuracy() << " weight bytes: " << reduced->floatWeightBytes()
+				<< " ns per row: " << floatNs / testFile->inputLines() << "\n";
+		cout << cstrLabel << " MSE: " << reducedMetrics->mse() << " accuracy: " << reducedMetrics->accuracy() << " weight bytes: " << reduced->weightBytes()
+				<< " ns per row: " << reducedNs / testFile->inputLines() << "\n";
+		cout << cstrLabel << " accuracy loss: " << floatMetrics->accuracy() - reducedMetrics->accuracy() << " MSE increase: "
+				<< reducedMetrics->mse() - floatMetrics->mse() << "\n";
+	}
+}
+
+void makeHalf(nn * theNet, const char * cstrFormat, const char * cstrPath)
+/*
+ * -half: make a 16 bit copy of the network and save the network with a storage line asking for it
+ */
+{
+	half_format format;
+	string strContent;
+	char cstrFileName[255];
+	char cstrPathFile[512];
+
+	if (!halfWeights::formatFromName(cstrFormat, &format))
+		throw format_Error(ENN_ERR_UNK_HALF_FORMAT);
+
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	if (theHalf != NULL)
+		delete theHalf;
+	theHalf = new halfWeights(*snapshot, format);
+
+	cout << "16 bit (" << cstrFormat << ") weight bytes: " << theHalf->weightBytes() << " float weight bytes: " << theHalf->floatWeightBytes() << "\n";
+
+	if (strcmp(cstrPath, "-") != 0)
+	{
+		theNet->saveOn(&strContent);
+		strContent += "storage(";
+		strContent += cstrFormat;
+		strContent += ")\n";
+
+		snprintf(cstrPathFile, sizeof(cstrPathFile), "%s//%s", cstrPath, theNet->defaultName(cstrFileName));
+		ofstream outFile(cstrPathFile);
+		if (!outFile.is_open())
+			throw format_Error(ENN_ERR_NON_FILE);
+		outFile << strContent;
+	}
+}
+
+void loadHalf(const char * cstrFilename)
+/*
+ * -f16: read a network file with a storage line into a 16 bit copy
+ */
+{
+	ifstream netFile(cstrFilename);
+	networkFile nFile(&netFile);
+
+	if (!netFile.is_open())
+		throw format_Error(ENN_ERR_NON_FILE);
+	nFile.readInFile();
+
+	halfWeights * loaded = new halfWeights(&nFile);
+	if (theHalf != NULL)
+		delete theHalf;
+	theHalf = loaded;
+}
+
+void prune(nn * theNet, const char * cstrSpec)
+/*
+ * -prune: prune the links under a threshold (%f) or all but the largest k into each node (top:%k)
+ */
+{
+	string spec = cstrSpec;
+	unsigned int pruned;
+
+	if (spec.compare(0, 4, "top:") == 0)
+		pruned = theNet->pruneToTop(atoi(spec.c_str() + 4));
+	else
+		pruned = theNet->pruneBelow(atof(cstrSpec));
+
+	cout << "Pruned links: " << pruned << " of " << theNet->links() << " density: " << (double)(theNet->links() - pruned) / theNet->links() << "\n";
+}
+
+void shrink(nn * theNet, const char * cstrFilename, double tolerance, const char * cstrPath)
+/*
+ * -shrink: measure each hidden node's activity over a training file, remove the dead nodes and save the narrower network
+ */
+{
+	vector<bool> dead;
+	unsigned int deadCount, oldHidden;
+
+	unique_ptr<nodeActivity> activity;
+	{
+		loadedTrainingFile trFile(cstrFilename);
+		unique_ptr<nnWeights> snapshot(theNet->snapshot());
+		activity.reset(new nodeActivity(*snapshot));
+		activity->analyse(trFile.get());
+	}
+
+	activity->writeOn(cout, tolerance);
+	deadCount = activity->deadNodes(tolerance, &dead);
+	oldHidden = theNet->hiddenNodes();
+	if ((deadCount == 0) || (theNet->removeHiddenNodes(dead, activity->means()) != SUCCESS))
+		cout << "No dead hidden nodes in " << activity->rows() << " rows\n";
+	else
+	{
+		cout << "Removed " << deadCount << " of " << oldHidden << " hidden nodes, " << theNet->hiddenNodes() << " left\n";
+		if (strcmp(cstrPath, "-") != 0)
+			theNet->saveTo(cstrPath);
+	}
+}
+
+void distillReport(const nnWeights & teacher, const nnWeights & student, trainingFile * testFile)
+/*
+ * -distill: the teacher and the student side by side on testFile's labels, and how closely the student follows the teacher
+ */
+{
+	const nnWeights * nets[2] = { &teacher, &student };
+	const char * labels[2] = { "Teacher", "Student" };
+	unique_ptr<testMetrics> metrics[2], agreement;
+	vector<float> hiddenScratch, outputs[2];
+	chrono::steady_clock::time_point started;
+	double ns[2] = { 0.0, 0.0 };
+	unsigned int row, n;
+	size_t weightBytes;
+	const char * cstrSpec = (metricsSpec.size() > 0) ? metricsSpec.c_str() : "argmax";
+
+	hiddenScratch.resize(max(teacher.hiddenNodes(), student.hiddenNodes()));
+	for (n = 0; n < 2; n++)
+	{
+		metrics[n].reset(testMetrics::fromSpec(cstrSpec, teacher.outputNodes()));
+		outputs[n].resize(teacher.outputNodes());
+	}
+	agreement.reset(testMetrics::fromSpec(cstrSpec, teacher.outputNodes()));
+
+	for (row = 0; row < testFile->inputLines(); row++)
+	{
+		for (n = 0; n < 2; n++)
+		{
+			started = chrono::steady_clock::now();
+			nets[n]->run(testFile->inputSet(row)->data(), hiddenScratch.data(), outputs[n].data());
+			ns[n] += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+			metrics[n]->add(testFile->outputSet(row)->data(), outputs[n].data());
+		}
+		agreement->add(outputs[0].data(), outputs[1].data());
+	}
+
+	if (testFile->inputLines() > 0)
+	{
+		cout << "\tTopology\tAccuracy\tMSE\tns per row\tWeight bytes\n";
+		for (n = 0; n < 2; n++)
+		{
+			weightBytes = ((size_t)nets[n]->hiddenNodes() * (nets[n]->inputNodes() + 1) + (size_t)nets[n]->outputNodes() * (nets[n]->hiddenNodes() + 1)) * sizeof(float);
+			cout << labels[n] << "\t" << nets[n]->standardInputNodes() << "-" << nets[n]->hiddenNodes() << "-" << nets[n]->outputNodes() << "\t"
+					<< metrics[n]->accuracy() << "\t" << metrics[n]->mse() << "\t" << ns[n] / testFile->inputLines() << "\t" << weightBytes << "\n";
+		}
+		cout << "Student agreement with the teacher: " << agreement->accuracy() << " MSE from the soft targets: " << agreement->mse()
+				<< " accuracy loss: " << metrics[0]->accuracy() - metrics[1]->accuracy() << " speed up: " << ns[0] / ns[1] << "\n";
+	}
+}
+
+nn * distill(nn * teacher, const char * cstrFilename, unsigned int hiddenNodes, const char * cstrSynthetic, const char * cstrPath)
+/*
+ * -distill: train a new student network with hiddenNodes hidden nodes on the teacher's outputs for every row of a training
+ * file, plus %n noisy copies of each row if cstrSynthetic is %n or %n:%noise. Returns the student.
+ */
+{
+	network_description studentDescription;
+	string synthetic = cstrSynthetic;
+	unsigned int perRow = atoi(cstrSynthetic);
+	float noise = 0.1;
+	stop_reason reason;
+
+	if (synthetic.find(':') != string::npos)
+		noise = atof(synthetic.c_str() + synthetic.find(':') + 1);
+
+	loadedTrainingFile trFile(cstrFilename);
+	unique_ptr<nnWeights> teacherWeights(teacher->snapshot());
+	distiller soft(*teacherWeights);
+	soft.addRows(trFile.get());
+	soft.addSynthetic(perRow, noise, 1);
+	cout << "Soft targets: " << soft.dataRows() << " rows and " << soft.syntheticRows() << " synthetic rows\n";
+
+	loadedTrainingFile validation;
+	if (validationPath.size() > 0)
+		validation.load(validationPath.c_str());
+
+	studentDescription = *teacher->networkDescription();
+	studentDescription.setHiddenNodes(hiddenNodes);
+	studentDescription.setNetworkName(studentDescription.networkName() + "_student");
+	unique_ptr<nn> student(new nn(studentDescription));
+
+	epochTrainer trainer(student.get(), soft.rows());
+	trainer.setValidation(validation.get());
+	trainer.setMaxEpochs((maxEpochs > 0) ? maxEpochs : 16);
+	trainer.setPatience(epochPatience);
+	trainer.setTarget(epochTarget);
+	trainer.setTimeBudget(epochBudget);
+	trainer.setDecay(epochDecay);
+	trainer.setCallback(&callback_EpochComplete);
+	if (metricsSpec.size() > 0)
+		trainer.setMetrics(metricsSpec.c_str());
+	reason = trainer.run();
+	cout << "Stopped: " << epochTrainer::stopReasonName(reason) << " best loss: " << trainer.bestLossSeen() << "\n";
+
+	unique_ptr<nnWeights> studentWeights(student->snapshot());
+	distillReport(*teacherWeights, *studentWeights, (validation.get() != NULL) ? validation.get() : trFile.get());
+
+	if (strcmp(cstrPath, "-") != 0)
+		student->saveTo(cstrPath);
+	return student.release();
+}
+
+void solveOutputs(nn * theNet, const char * cstrFilename, double lambda)
+/*
+ * -solve: fit the output layer to a training file in closed form, keeping the hidden layer
+ */
+{
+	testMetrics before(theNet->outputNodes()), after(theNet->outputNodes());
+	chrono::steady_clock::time_point started;
+	double passMs, solveMs;
+
+	loadedTrainingFile trFile(cstrFilename);
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	outputSolver solver(*snapshot, lambda);
+
+	theNet->setThreads(threadCount);
+	theNet->test(trFile.get(), NULL, &before);
+
+	started = chrono::steady_clock::now();
+	solver.accumulate(trFile.get(), threadCount);
+	passMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+	started = chrono::steady_clock::now();
+	solver.solve();
+	solveMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+	solver.writeInto(snapshot.get());
+	theNet->setWeights(snapshot.get());
+	theNet->trainingRunComplete();
+	theNet->test(trFile.get(), NULL, &after);
+
+	cout << "Output layer solved from " << solver.rows() << " rows, pass ms: " << passMs << " solve ms: " << solveMs << "\n";
+	cout << "Training MSE before: " << before.mse() << " after: " << after.mse() << "\n";
+}
+
+void trainFrozen(nn * theNet, const char * cstrFilename, const char * cstrSpillDir)
+/*
+ * -frozen: train only the output layer for the -epochs rules, from hidden node values cached once for the training file
+ * (and for any -validate file, always in memory)
+ */
+{
+	unique_ptr<hiddenCache> validationCache;
+	string spillDir = (strcmp(cstrSpillDir, "-") == 0) ? "" : cstrSpillDir;
+	chrono::steady_clock::time_point started;
+	double cacheMs;
+	stop_reason reason;
+
+	loadedTrainingFile trFile(cstrFilename);
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	hiddenCache cache(*snapshot);
+
+	started = chrono::steady_clock::now();
+	cache.fill(trFile.get(), spillDir);
+	cacheMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+	cout << "Cached " << cache.rows() << " rows of hidden node values, " << cache.bytes() << " bytes"
+			<< (cache.isMapped() ? " mapped" : " in memory") << ", ms: " << cacheMs << "\n";
+
+	loadedTrainingFile validation;
+	if (validationPath.size() > 0)
+	{
+		validation.load(validationPath.c_str());
+		validationCache.reset(new hiddenCache(*snapshot));
+		validationCache->fill(validation.get(), "");
+	}
+
+	frozenTrainer trainer(snapshot.get(), &cache, theNet->learningRate(), theNet->momentum());
+	trainer.setValidation(validationCache.get());
+	trainer.setMaxEpochs((maxEpochs > 0) ? maxEpochs : 16);
+	trainer.setPatience(epochPatience);
+	trainer.setTarget(epochTarget);
+	trainer.setTimeBudget(epochBudget);
+	trainer.setDecay(epochDecay);
+	trainer.setCallback(&callback_EpochComplete);
+	if (theNet->prunedLinks() > 0)
+		trainer.keepPruned();
+
+	reason = trainer.run();
+	cout << "Stopped: " << epochTrainer::stopReasonName(reason) << " best loss: " << trainer.bestLossSeen() << "\n";
+
+	theNet->setWeights(snapshot.get());
+	theNet->trainingRunComplete();
+}
+
+void testSparse(nn * theNet, const char * cstrFilename)
+/*
+ * After -test on a pruned network: compare the CSR copy of its weights with the float network
+ */
+{
+	unique_ptr<nnWeights> snapshot(theNet->snapshot());
+	sparseWeights sparse(*snapshot);
+
+	snapshot.reset();
+	cout << "CSR links: " << sparse.links() << " density: " << sparse.density() << "\n";
+	testReduced(theNet, cstrFilename, &sparse, "CSR");
+}
+
+void latencyStart(nn * theNet)
+{
+	theNet->setLatency(latencyWanted);
+}
+
+void latencyEnd(nn * theNet)
+{
+	if (latencyWanted)
+	{
+		theNet->latencyReport(cout);
+		theNet->resetLatency();
+	}
+}
+
+void serve(const char * cstrPath)
+/*
+ * Read input vectors from standard input, one per line, either as inputVector(a,b,...) or just a,b,...
+ * and write each result vector to standard output. The network is reloaded in the background whenever
+ * a newer version is saved in cstrPath (a .enn file or a directory of them).
+ */
+{
+	hotNetwork hotNet(cstrPath, &callback_Reloaded);
+	vector<float> inVec;
+	vector<float> outVec;
+	string line;
+	const char * pos;
+	char * endPos;
+	unsigned int i;
+	int index = 0;
+
+	while (getline(cin, line))
+	{
+		pos = line.c_str();
+		if (strchr(pos, '(') != NULL)
+			pos = strchr(pos, '(') + 1;
+
+		inVec.clear();
+		for (;;)
+		{
+			inVec.push_back(strtof(pos, &endPos));
+			if (endPos == pos)
+			{
+				inVec.pop_back();
+				break;
+			}
+			pos = endPos;
+			while ((*pos == ',') || (*pos == ' '))
+				pos++;
+		}
+
+		if (inVec.size() == 0)
+			continue;
+
+		if (hotNet.run(&inVec, &outVec) == SUCCESS)
+		{
+			cout << "Index: " << index << " results -";
+			for(i = 0; i< outVec.size(); i++)
+				cout << " " << i << ": " << outVec[i];
+			cout << "\n";
+		}
+		else
+			cout << "Index: " << index << " wrong number of inputs\n";
+		cout.flush();
+		index++;
+	}
+}
+
+const unsigned int storeBatchRows = 256;	// -store runs the requests in batches of up to this many lines
+
+void serveStore(const char * cstrPattern, size_t budgetKB)
+/*
+ * -store: load every network matching cstrPattern into a modelStore with a budget of budgetKB (0 for none) and serve
+ * requests from standard input, one per line, as
+ *	<model> a,b,...
+ * where <model> is a network name (its newest version) or <name>_<major>_<minor>_<revision>. The lines are run in
+ * batches of up to storeBatchRows; a blank line, or the end of the input, runs the lines read so far.
+ */
+{
+	modelStore store(budgetKB * 1024);
+	vector<storeRequest> requests;
+	vector<vector<float> > inVecs(storeBatchRows);
+	vector<vector<float> > outVecs(storeBatchRows);
+	string line, modelKey, netName;
+	const char * pos;
+	char * endPos;
+	unsigned int i, major, minor, revis;
+	size_t r;
+	int index = 0;
+	bool more = true;
+
+	store.addAll(cstrPattern);
+	store.writeStats(cout);
+
+	while (more)
+	{
+		requests.clear();
+		while ((requests.size() < storeBatchRows) && (more = (bool)getline(cin, line)) && (line.size() > 0))
+		{
+			storeRequest request;
+			vector<float> & inVec = inVecs[requests.size()];
+
+			pos = line.c_str();
+			while (*pos == ' ')
+				pos++;
+			modelKey.clear();
+			while ((*pos != '\0') && (*pos != ' ') && (*pos != ':'))
+				modelKey += *pos++;
+			while ((*pos == ' ') || (*pos == ':'))
+				pos++;
+
+			request.model = store.find(modelKey);
+			if ((request.model == noModel) && hotNetwork::splitDefaultName(modelKey + ".enn", netName, major, minor, revis))
+				request.model = store.find(netName, major, minor, revis);
+
+			inVec.clear();
+			for (;;)
+			{
+				inVec.push_back(strtof(pos, &endPos));
+				if (endPos == pos)
+				{
+					inVec.pop_back();
+					break;
+				}
+				pos = endPos;
+				while ((*pos == ',') || (*pos == ' '))
+					pos++;
+			}
+			if ((request.model != noModel) && (inVec.size() != store.standardInputs(request.model)))
+				request.model = noModel;
+
+			if (request.model != noModel)
+				outVecs[requests.size()].resize(store.outputNodes(request.model));
+			request.input = inVec.data();
+			request.output = outVecs[requests.size()].data();
+			requests.push_back(request);
+		}
+
+		store.runBatch(requests.data(), requests.size());
+
+		for (r = 0; r < requests.size(); r++, index++)
+			if (requests[r].status == SUCCESS)
+			{
+				cout << "Index: " << index << " model: " << store.modelName(requests[r].model) << " results -";
+				for (i = 0; i < store.outputNodes(requests[r].model); i++)
+					cout << " " << i << ": " << outVecs[r][i];
+				cout << "\n";
+			}
+			else
+				cout << "Index: " << index << " unknown model or wrong number of inputs\n";
+		cout.flush();
+	}
+
+	store.writeStats(cout);
+}
+
+void callback_TestToSink(const int index, vector<float>* inputVector, vector<float>* desiredOutput, vector<float>* actualOutput, vector<float> * errVec, void * caller)
+{
+	theSink->testRow(index, inputVector->data(), inputVector->size(), desiredOutput->data(), actualOutput->data(), errVec->data(), errVec->size());
+}
+
 int main(int argc, char *argv[])
 {
 	nn * theNet = NULL;
@@ -114,7 +963,14 @@ int main(int argc, char *argv[])
 				else
 					try
 					{
-						theNet->train(argv[++i], &callback_TrainingComplete);
+						latencyStart(theNet);
+						if (rpropAlgorithm)
+							trainRprop(theNet, argv[++i]);
+						else if (maxEpochs > 0)
+							trainEpochs(theNet, argv[++i]);
+						else
+							theNet->train(argv[++i], &callback_TrainingComplete);
+						latencyEnd(theNet);
 
 						if (!quiet)
 							cout << "Done with -t\n";
@@ -134,7 +990,10 @@ int main(int argc, char *argv[])
 					else
 						try
 						{
-							theNet->run(argv[++i], &callback_RunComplete);
+							theNet->setThreads(threadCount);
+							latencyStart(theNet);
+							theNet->run(argv[++i], (openSink() != NULL) ? &callback_RunToSink : &callback_RunComplete);
+							latencyEnd(theNet);
 
 							if (!quiet)
 								cout << "Done with -r or -run\n";
@@ -291,7 +1150,32 @@ int main(int argc, char *argv[])
 											else
 												try
 												{
-													theNet->test(argv[++i], callback_TestComplete);
+													theNet->setThreads(threadCount);
+													latencyStart(theNet);
+
+													if (metricsSpec.size() == 0)
+														theNet->test(argv[++i], (openSink() != NULL) ? &callback_TestToSink : &callback_TestComplete);
+													else
+													{
+														unique_ptr<testMetrics> metrics(testMetrics::fromSpec(metricsSpec.c_str(), theNet->outputNodes()));
+														funcTestCallback rowCallback = NULL;
+
+														if (openSink() != NULL)
+															rowCallback = &callback_TestToSink;
+														else if (rowsWanted)
+															rowCallback = &callback_TestComplete;
+
+														theNet->test(argv[++i], rowCallback, metrics.get());
+														metrics->writeOn(cout);
+													}
+													latencyEnd(theNet);
+
+													if (theQuantized != NULL)
+														testReduced(theNet, argv[i], theQuantized, "Int8");
+													if (theHalf != NULL)
+														testReduced(theNet, argv[i], theHalf, (theHalf->storageFormat() == HALF_FP16) ? "FP16" : "BF16");
+													if (theNet->prunedLinks() > 0)
+														testSparse(theNet, argv[i]);
 
 													if (!quiet)
 														cout << "Done with -test\n";
@@ -312,6 +1196,461 @@ int main(int argc, char *argv[])
 													quiet = false;
 													cout << "Done with -q-\n";
 												}
+												else if (argvI == "-o")
+												{
+													closeSink();
+													sinkPath = argv[++i];
+
+													if (!quiet)
+														cout << "Done with -o\n";
+												}
+												else if (argvI == "-format")
+												{
+													closeSink();
+													sinkFormat = argv[++i];
+
+													if (!quiet)
+														cout << "Done with -format\n";
+												}
+												else if (argvI == "-bg+")
+													sinkBackground = true;
+												else if (argvI == "-bg-")
+													sinkBackground = false;
+												else if (argvI == "-metrics")
+												{
+													metricsSpec = argv[++i];
+													if (metricsSpec == "off")
+														metricsSpec = "";
+
+													if (!quiet)
+														cout << "Done with -metrics\n";
+												}
+												else if (argvI == "-rows+")
+													rowsWanted = true;
+												else if (argvI == "-rows-")
+													rowsWanted = false;
+												else if (argvI == "-threads")
+												{
+													threadCount = atoi(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -threads\n";
+												}
+												else if (argvI == "-epochs")
+												{
+													maxEpochs = atoi(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -epochs\n";
+												}
+												else if (argvI == "-algo")
+												{
+													string algorithm = argv[++i];
+
+													if (algorithm == "rprop")
+														rpropAlgorithm = true;
+													else if (algorithm == "sgd")
+														rpropAlgorithm = false;
+													else
+														cout << "Unknown training algorithm " << algorithm << ", use sgd or rprop\n";
+
+													if (!quiet)
+														cout << "Done with -algo\n";
+												}
+												else if (argvI == "-patience")
+												{
+													epochPatience = atoi(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -patience\n";
+												}
+												else if (argvI == "-target")
+												{
+													epochTarget = atof(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -target\n";
+												}
+												else if (argvI == "-budget")
+												{
+													epochBudget = atof(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -budget\n";
+												}
+												else if (argvI == "-decay")
+												{
+													epochDecay = (float)atof(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -decay\n";
+												}
+												else if (argvI == "-validate")
+												{
+													validationPath = argv[++i];
+													if (validationPath == "off")
+														validationPath = "";
+
+													if (!quiet)
+														cout << "Done with -validate\n";
+												}
+												else if (argvI == "-lr")
+												{
+													fVal = (float)atof(argv[++i]);
+													if (theNet == NULL)
+														cout << "A network must be loaded before its learning rate is set.\n";
+													else
+														theNet->setLearningRate(fVal);
+
+													if (!quiet)
+														cout << "Done with -lr\n";
+												}
+												else if (argvI == "-cv")
+												{
+													const char * cstrFolds = argv[++i];
+													const char * cstrSavePath = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before it is cross validated.\n";
+													else
+														try
+														{
+															crossValidate(theNet, cstrFolds, cstrSavePath);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -cv\n";
+												}
+												else if (argvI == "-ensemble")
+												{
+													const char * cstrModels = argv[++i];
+													const char * cstrFile = argv[++i];
+
+													try
+													{
+														evaluateEnsemble(cstrModels, cstrFile);
+													}
+													catch (format_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+
+													if (!quiet)
+														cout << "Done with -ensemble\n";
+												}
+												else if (argvI == "-vote")
+												{
+													string vote = argv[++i];
+
+													if (vote == "average")
+														ensembleVote = VOTE_AVERAGE;
+													else if (vote == "majority")
+														ensembleVote = VOTE_MAJORITY;
+													else
+														ensembleVote = VOTE_NONE;
+
+													if (!quiet)
+														cout << "Done with -vote\n";
+												}
+												else if (argvI == "-sweep")
+												{
+													const char * cstrSpace = argv[++i];
+													const char * cstrFile = argv[++i];
+													unsigned int bestCount = atoi(argv[++i]);
+													const char * cstrSavePath = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before a sweep.\n";
+													else
+														try
+														{
+															sweep(theNet, cstrSpace, cstrFile, bestCount, cstrSavePath);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -sweep\n";
+												}
+												else if (argvI == "-samples")
+												{
+													sweepSamples = atoi(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -samples\n";
+												}
+												else if (argvI == "-rung")
+												{
+													sweepRungEpochs = atoi(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -rung\n";
+												}
+												else if (argvI == "-vasync")
+												{
+													string every = argv[++i];
+
+													backgroundEpochs = backgroundRows = 0;
+													if ((every.size() > 0) && (every[every.size() - 1] == 'r'))
+														backgroundRows = atoi(every.c_str());
+													else
+														backgroundEpochs = atoi(every.c_str());
+
+													if (!quiet)
+														cout << "Done with -vasync\n";
+												}
+												else if (argvI == "-best+")
+												{
+													keepBest = true;
+
+													if (!quiet)
+														cout << "Done with -best+\n";
+												}
+												else if (argvI == "-best-")
+												{
+													keepBest = false;
+
+													if (!quiet)
+														cout << "Done with -best-\n";
+												}
+												else if (argvI == "-latency")
+												{
+													latencyWanted = true;
+
+													if (!quiet)
+														cout << "Done with -latency\n";
+												}
+												else if (argvI == "-stats")
+												{
+													statsDest = argv[++i];
+#ifdef _STATS_
+													runStats::global().enable();
+
+													if (!quiet)
+														cout << "Done with -stats\n";
+#else
+													cout << "The statistics were not compiled in, build eNNpi_instrumented (make eNNpi_instrumented) to use -stats\n";
+#endif
+												}
+												else if (argvI == "-trace")
+												{
+#ifdef _TRACE_
+													traceLog::global().enable(argv[++i]);
+
+													if (!quiet)
+														cout << "Done with -trace\n";
+#else
+													i++;
+													cout << "The tracer was not compiled in, build eNNpi_instrumented (make eNNpi_instrumented) to use -trace\n";
+#endif
+												}
+												else if (argvI == "-prune")
+												{
+													const char * cstrSpec = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before it is pruned.\n";
+													else
+														prune(theNet, cstrSpec);
+
+													if (!quiet)
+														cout << "Done with -prune\n";
+												}
+												else if (argvI == "-shrink")
+												{
+													const char * cstrFile = argv[++i];
+													double tolerance = atof(argv[++i]);
+													const char * cstrSavePath = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before it is shrunk.\n";
+													else
+														try
+														{
+															shrink(theNet, cstrFile, tolerance, cstrSavePath);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -shrink\n";
+												}
+												else if (argvI == "-distill")
+												{
+													const char * cstrFile = argv[++i];
+													unsigned int studentHidden = atoi(argv[++i]);
+													const char * cstrSynthetic = argv[++i];
+													const char * cstrSavePath = argv[++i];
+													nn * student;
+
+													if (theNet == NULL)
+														cout << "A teacher network must be loaded before distilling.\n";
+													else
+														try
+														{
+															student = distill(theNet, cstrFile, studentHidden, cstrSynthetic, cstrSavePath);
+															delete theNet;
+															theNet = student;
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -distill\n";
+												}
+												else if (argvI == "-solve")
+												{
+													const char * cstrFile = argv[++i];
+													double lambda = atof(argv[++i]);
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before its output layer is solved.\n";
+													else
+														try
+														{
+															solveOutputs(theNet, cstrFile, lambda);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -solve\n";
+												}
+												else if (argvI == "-frozen")
+												{
+													const char * cstrFile = argv[++i];
+													const char * cstrSpillDir = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before its output layer is trained.\n";
+													else
+														try
+														{
+															trainFrozen(theNet, cstrFile, cstrSpillDir);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -frozen\n";
+												}
+												else if (argvI == "-quantize")
+												{
+													const char * cstrFile = argv[++i];
+													const char * cstrSavePath = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before it is quantized.\n";
+													else
+														try
+														{
+															quantize(theNet, cstrFile, cstrSavePath);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -quantize\n";
+												}
+												else if (argvI == "-int8")
+												{
+													try
+													{
+														loadQuantized(argv[++i]);
+													}
+													catch (format_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+
+													if (!quiet)
+														cout << "Done with -int8\n";
+												}
+												else if (argvI == "-half")
+												{
+													const char * cstrFormat = argv[++i];
+													const char * cstrSavePath = argv[++i];
+
+													if (theNet == NULL)
+														cout << "A network must be loaded before it is stored in 16 bits.\n";
+													else
+														try
+														{
+															makeHalf(theNet, cstrFormat, cstrSavePath);
+														}
+														catch (format_Error & e)
+														{
+															cout << e.mesg << "\n";
+														}
+
+													if (!quiet)
+														cout << "Done with -half\n";
+												}
+												else if (argvI == "-f16")
+												{
+													try
+													{
+														loadHalf(argv[++i]);
+													}
+													catch (format_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+
+													if (!quiet)
+														cout << "Done with -f16\n";
+												}
+												else if (argvI == "-store")
+												{
+													const char * cstrPattern = argv[++i];
+													size_t budgetKB = atol(argv[++i]);
+
+													try
+													{
+														serveStore(cstrPattern, budgetKB);
+													}
+													catch (format_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+
+													if (!quiet)
+														cout << "Done with -store\n";
+												}
+												else if (argvI == "-serve")
+												{
+													try
+													{
+														serve(argv[++i]);
+
+														if (!quiet)
+															cout << "Done with -serve\n";
+													}
+													catch (format_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+													catch (internal_Error & e)
+													{
+														cout << e.mesg << "\n";
+													}
+												}
 												else
 												{
 													unknownFlag = true;
@@ -331,10 +1670,63 @@ int main(int argc, char *argv[])
 		cout << "-c %i %h %o %n create a new randomised network with %i input nodes %h hidden nodes %o output nodes, called %n (with a learning rate of 0.1)\n";
 		cout << "-at %i %h %o alter the topology to be %i input nodes %h hidden nodes %o output nodes\n";
 		cout << "-am 1 (biasNode:true OR biasNode:false) add or remove an input bias node to layer one\n";
+		cout << "-o %file write the results of -run and -test to %file instead of standard output\n";
+		cout << "-format (tsv | csv | bin) the layout used by -o: tab separated, comma separated or raw float32 rows (default tsv)\n";
+		cout << "-bg+ OR -bg- write the -o file from a background thread (-bg+) or from the main thread (-bg-, the default)\n";
+		cout << "-metrics %m make -test write a summary (accuracy, MSE, MAE, max error and a confusion matrix) instead of every row. %m is argmax, threshold or threshold:%f, add +sign for -1/+1 desired values e.g. argmax+sign. -metrics off goes back to every row\n";
+		cout << "-rows+ OR -rows- also write every -test row to standard output when -metrics is on (-rows+) or just the summary (-rows-, the default)\n";
+		cout << "-threads %n share the rows of -run and -test between %n threads, 0 for one per core (default 1). Results are still written in row order\n";
+		cout << "-serve %path run input vectors from standard input until it closes, reloading the network whenever a newer version is saved as %path (a .enn file or a directory)\n";
+		cout << "-epochs %n make each following -t read its file once and train for up to %n shuffled passes, bumping the revision once. 0 goes back to one pass per -t\n";
+		cout << "-patience %n stop -epochs training when the loss has not improved for %n epochs (default 0, never)\n";
+		cout << "-target %f stop -epochs training when the loss is at or below %f\n";
+		cout << "-budget %s stop -epochs training after %s seconds\n";
+		cout << "-decay %f multiply the learning rate by %f when the loss has not improved for half the patience\n";
+		cout << "-validate %file use the mean squared error over training file %file as the -epochs loss instead of the training loss. -validate off goes back to the training loss\n";
+		cout << "-lr %f set the learning rate of the current network\n";
+		cout << "-algo (sgd | rprop) train each following -t by the network's own stochastic gradient descent (sgd, the default) or by full batch iRPROP+ (rprop), which needs no learning rate and moves every weight by its own adaptive step. rprop keeps to the -epochs, -patience, -target, -budget, -validate and -decay rules (16 epochs if no -epochs; -decay scales the step sizes), shares the gradient between -threads threads and carries its step sizes over to the next -t on the same network, but not into the saved file\n";
+		cout << "-cv %files %path k-fold cross validate a copy of the current network: %files is a comma separated list of training files, one per fold. Each fold is tested on a copy trained on all of the other folds (using the -epochs rules, 1 epoch if -epochs is 0), with the folds trained in parallel. Writes per fold and total metrics (see -metrics) and saves each copy, named <name>_fold<k>, on %path (- not to save)\n";
+		cout << "-prune (%f | top:%k) prune the links of the network whose weights are under %f in magnitude, or all but the %k largest into each hidden and output node. Pruned links stay at 0 when the network is trained again, to fine tune the rest, and the network is saved sparse (pruned links left out of the file). Each -test of a pruned network also compares a compressed sparse row copy of it with the float network\n";
+		cout << "-shrink %file %f %path run training file %file through the network, write each hidden node's mean, standard deviation and largest output weight, and remove the nodes whose largest output weight times standard deviation is under %f, adding their mean contribution to the output biases. The narrower network has a new major version and is saved on %path (- not to save). Follow with -t to fine tune it\n";
+		cout << "-distill %file %h %n %path train a student copy of the current network with %h hidden nodes on the current network's outputs (soft targets) for every row of training file %file, plus %n noisy copies of each row (%n:%f sets the noise to %f standard deviations of each input, 0.1 by default; 0 for none). Trains for -epochs (16 if 0) with the other -epochs settings, writes the teacher and the student's accuracy, MSE and time per row side by side (over the -validate file if set) and saves the student on %path (- not to save). The student becomes the current network\n";
+		cout << "-solve %file %f fit the output layer's weights and biases to training file %file in one pass and a least squares solve (ridge %f, e.g. 0.001), keeping the hidden layer as it is. Uses -threads for the pass and writes the training MSE before and after\n";
+		cout << "-frozen %file %path train only the output layer on training file %file for the -epochs, -patience, -target, -budget, -validate and -decay rules (16 epochs if no -epochs), running the hidden layer once per row and reusing the cached hidden node values every epoch. The cache is in memory, or with %path a directory, in a file there mapped into memory; - for memory\n";
+		cout << "-quantize %file %path make an int8 copy of the network, calibrating the input and hidden value ranges on training file %file, and save the network with its quantized section on %path (- not to save). Each -test after this also compares the int8 MSE, accuracy and time per row with the float network's\n";
+		cout << "-int8 %file.enn read the quantized section of a network file saved by -quantize, for the -test comparison\n";
+		cout << "-half (fp16 | bf16) %path make a 16 bit copy of the network's weights, rounded to half or bfloat16, and save the network on %path (- not to save) with a storage line asking for that format. Each -test after this also compares the 16 bit MSE, accuracy and time per row with the float network's\n";
+		cout << "-f16 %file.enn read a network file saved by -half into a 16 bit copy in the format its storage line asks for, for the -test comparison\n";
+		cout << "-store %models %kb serve many networks at once from standard input, one request per line as '%model a,b,...' where %model is a network name (its newest version) or name_major_minor_revision. %models is a glob pattern such as 'nets/*.enn' (quote it). The weights are packed into one store of at most %kb kilobytes (0 for no limit), the least recently used networks being paged out and read back in from their files when needed. Writes the store's memory use when it starts and when the input closes. Lines are run in batches of up to 256, a blank line runs those read so far\n";
+		cout << "-ensemble %models %file test every network in %models against training file %file, which is read once. %models is a glob pattern such as 'nets/*.enn' (quote it) or @%manifest, a file listing one .enn per line. Networks with the same topology run as one stacked batch and the rows are shared between the -threads. Writes the MSE and accuracy (see -metrics) of each network\n";
+		cout << "-vote (off | average | majority) also combine the -ensemble outputs of each row by averaging them or by a majority vote on the argmax class, and write the metrics of the combination. The combined rows go to the -o file, or to standard output with -rows+\n";
+		cout << "-sweep %space %file %n %path train candidate copies of the current network on training file %file, all at once on every core, dropping the worse half after each rung of epochs (successive halving) until one is left or -epochs (16 if 0) epochs are spent. The loss is the MSE over the -validate file if set, else the training loss. %space is e.g. hidden=2,4,8;lr=0.01:1;momentum=0,0.9;bias=0,1, a key left out keeps the current network's value. Writes a summary table and saves the best %n candidates on %path (- not to save)\n";
+		cout << "-samples %n make -sweep try %n random points of the space (lo:hi ranges allowed) instead of every combination of its lists (0, the default)\n";
+		cout << "-rung %n the epochs each -sweep candidate trains in the first rung, doubled each rung after (default 1)\n";
+		cout << "-vasync %n test the -validate file on a background thread against a snapshot of the weights taken every %n epochs, or every %n rows with %nr e.g. 5000r, while training carries on. The -patience then counts validations. 0 validates after every epoch on the training thread (the default)\n";
+		cout << "-best+ OR -best- finish -vasync training with the weights of the snapshot with the lowest validation MSE (-best+) or with the last weights (-best-, the default)\n";
+		cout << "-latency time every row of each following -t, -run and -test and write a table of the p50, p90, p99, p99.9 and max latency in microseconds after each one\n";
+		cout << "-stats (- | %file) time each phase (open, parse, build, randomise, train, run, test, callback, save, write) and count rows, links and bytes from here on. At the end write them with the process CPU, memory and page fault figures to standard output (-) or as JSON to %file\n";
+		cout << "-trace %file record a timeline of the epochs, train batches, run and test chunks, parse chunks and saves on every thread and write it to %file in Chrome trace JSON at the end (or whenever the process gets SIGUSR1). Give it before -threads work starts\n";
 		cout << "-q+ OR -q- Switch quiet mode on (-q+) or off (-q-) +q+ supresses the 'Done with...' after each command line arguement\n";
 	}
+	closeSink();
 	if (theNet != NULL)
 		delete theNet;
+	if (theQuantized != NULL)
+		delete theQuantized;
+	if (theHalf != NULL)
+		delete theHalf;
+
+#ifdef _STATS_
+	if (statsDest == "-")
+		runStats::global().writeOn(cout);
+	else if (statsDest.size() > 0)
+		if (!runStats::global().writeJson(statsDest.c_str()))
+			cout << "Error: could not write the statistics to " << statsDest << "\n";
+#endif
+#ifdef _TRACE_
+	if (!traceLog::global().writeJson())
+		cout << "Error: could not write the trace\n";
+#endif
 
 	return 1;
 }
@@ -0,0 +1,596 @@
+#ifndef _modelStore_h
+#define _modelStore_h
+
+#include <stdint.h>
+#include <glob.h>		// POSIX only
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "hotNetwork.hpp"
+#include "networkFile.hpp"
+#include "nnWeights.hpp"
+
+/*
+ * modelStore serves many small networks (thousands of per device models) from one packed arena of floats.
+ *
+ * An nn object costs far more memory than its weights (node and link objects, vectors, strings, virtual bases) and
+ * even an nnWeights object carries four vectors, a network_description and two strings. The store keeps only the
+ * weights of each model, back to back in one arena:
+ *
+ *	[hidden weights: hidden x inputs][hidden biases][output weights: outputs x hidden][output biases]
+ *
+ * laid out as in nnWeights (the input bias node, if any, is the last input), plus a fixed 48 byte record and the name.
+ * A name is stored once for all of its versions.
+ *
+ * Models are indexed by name and version, following nn::defaultName(): find(name) gives the newest version loaded and
+ * find(name, major, minor, revision) a particular one. Each model remembers the directory it came from, so its file
+ * <name>_<major>_<minor>_<revision>.enn can be read in again.
+ *
+ * With a memory budget the arena is kept under it by paging: when a model has to be brought in and there is no room,
+ * the least recently used models are evicted (their arena blocks freed, their records kept), and an evicted model is
+ * read back in from its file the next time it is run. Freed blocks are reused by models of the same size; when
+ * there is no room left at the end of the arena, models are evicted down to 7/8 of the budget and the arena is compacted.
+ *
+ * runBatch() takes many requests at once, sorts them by topology and model and runs each model's requests back to
+ * back, so the loop bounds, the scratch space and the model's weights stay put while its requests run. The results are
+ * bit for bit the same as nnWeights::run().
+ *
+ * A store is not thread safe; give each serving thread its own or guard it with a lock.
+ */
+
+const char ENN_ERR_STORE_FULL[] = "The model store budget is too small for the model";
+const char ENN_ERR_STORE_CHANGED[] = "A paged out network file has changed topology";
+
+const uint32_t noModel = 0xffffffff;
+
+struct storeRequest
+{
+	uint32_t			model;			// from find()
+	const float		*	input;			// standardInputs() values
+	float			*	output;			// room for outputNodes() values
+	status_t			status;			// set by runBatch(), FAILURE if the model could not be run
+};
+
+class modelStore
+{
+	public:
+						modelStore(size_t budgetBytes = 0)		// 0 has no budget, nothing is ever paged out
+						{
+							budget = budgetBytes / sizeof(float);
+							arenaUsed = 0;
+							freeFloats = 0;
+							lruHead = lruTail = noModel;
+							residentCount = 0;
+							pageIns = evictions = compactions = 0;
+						}
+
+	// setup
+			uint32_t	add(const char * cstrFilename)
+			/*
+			 * Load the network in cstrFilename, which must be named as by nn::defaultName(). Returns its model id, the
+			 * existing id if that version is already in the store.
+			 */
+						{
+							string path = cstrFilename;
+							string fileName, directory, netName;
+							std::string::size_type slashPos;
+							unsigned int major, minor, revis;
+							nnWeights * theWeights;
+							storedModel record;
+							uint32_t id, older;
+
+							slashPos = path.rfind('/');
+							directory = (slashPos == std::string::npos) ? "." : path.substr(0, slashPos);
+							fileName = (slashPos == std::string::npos) ? path : path.substr(slashPos + 1);
+							if (!hotNetwork::splitDefaultName(fileName, netName, major, minor, revis))
+								throw format_Error(ENN_ERR_NON_FILE);
+
+							older = find(netName);
+							if ((id = find(netName, major, minor, revis)) != noModel)
+								return id;
+
+							theWeights = readWeights(cstrFilename);
+
+							record.nameId = nameId(netName);
+							record.directoryId = directoryId(directory);
+							record.major = major;
+							record.minor = minor;
+							record.revision = revis;
+							record.inputs = (uint16_t)theWeights->standardInputNodes();
+							record.hidden = (uint16_t)theWeights->hiddenNodes();
+							record.outputs = (uint16_t)theWeights->outputNodes();
+							record.hasBias = theWeights->hasInputBiasNode() ? 1 : 0;
+							record.resident = 0;
+							record.offset = 0;
+							record.lruPrev = record.lruNext = noModel;
+							record.olderVersion = noModel;
+
+							id = (uint32_t)models.size();
+							models.push_back(record);
+
+							try
+							{
+								pageIn(id, theWeights);
+							}
+							catch (format_Error & e)
+							{
+								models.pop_back();
+								delete theWeights;
+								throw;
+							}
+							delete theWeights;
+
+							if ((older == noModel) || isNewer(models[id], models[older]))
+							{
+								models[id].olderVersion = older;
+								newest[names[record.nameId]] = id;
+							}
+							else
+							{
+								while ((models[older].olderVersion != noModel) && isNewer(models[models[older].olderVersion], models[id]))
+									older = models[older].olderVersion;
+								models[id].olderVersion = models[older].olderVersion;
+								models[older].olderVersion = id;
+							}
+
+							return id;
+						}
+
+			unsigned int addAll(const char * cstrPattern)	// add every .enn matching a glob pattern, returns how many
+						{
+							glob_t matches;
+							size_t i;
+							unsigned int added = 0;
+
+							if (glob(cstrPattern, 0, NULL, &matches) == 0)
+							{
+								for (i = 0; i < matches.gl_pathc; i++, added++)
+									add(matches.gl_pathv[i]);
+								globfree(&matches);
+							}
+							return added;
+						}
+
+			void		evict(uint32_t model)		// free the model's weights, it is read in again when it is next run
+						{
+							if (model >= models.size())
+								return;
+
+							storedModel & record = models[model];
+
+							if (!record.resident)
+								return;
+							unlinkLru(model);
+							freeBlocks[blockSize(record)].push_back(record.offset);
+							freeFloats += blockSize(record);
+							record.resident = 0;
+							residentCount--;
+							evictions++;
+						}
+
+	// find
+			uint32_t	find(const string & netName)		// the newest version of netName, or noModel
+						{
+							unordered_map<string_view, uint32_t>::iterator found = newest.find(netName);
+
+							return (found == newest.end()) ? noModel : found->second;
+						}
+
+			uint32_t	find(const string & netName, unsigned int major, unsigned int minor, unsigned int revis)
+						{
+							uint32_t id;
+
+							for (id = find(netName); id != noModel; id = models[id].olderVersion)
+								if ((models[id].major == major) && (models[id].minor == minor) && (models[id].revision == revis))
+									return id;
+							return noModel;
+						}
+
+	// run
+			status_t	run(uint32_t model, const float * inputVector, unsigned int inputs, float * outputVector)
+			/*
+			 * Run one row through a model, paging it in if it has been evicted. outputVector needs room for outputNodes(model) values.
+			 * FAILURE for an unknown model, such as noModel from a find() that missed.
+			 */
+						{
+							if (model >= models.size())
+								return FAILURE;
+
+							storedModel & record = models[model];
+
+							if (inputs != record.inputs)
+								return FAILURE;
+							use(model);
+							if (scratch.size() < record.hidden)
+								scratch.resize(record.hidden);
+							runModel(record, inputVector, scratch.data(), outputVector);
+							return SUCCESS;
+						}
+
+			void		runBatch(storeRequest * requests, size_t count)
+			/*
+			 * Run a batch of requests, grouped by topology and model. Every request's status says whether it ran.
+			 */
+						{
+							size_t r, first;
+							uint32_t model;
+
+							batchOrder.clear();
+							for (r = 0; r < count; r++)
+							{
+								requests[r].status = FAILURE;
+								if (requests[r].model < models.size())
+									batchOrder.push_back((uint32_t)r);
+							}
+							sort(batchOrder.begin(), batchOrder.end(), [&](uint32_t a, uint32_t b)
+							{
+								const storedModel & ma = models[requests[a].model];
+								const storedModel & mb = models[requests[b].model];
+
+								if (topologyKey(ma) != topologyKey(mb))
+									return topologyKey(ma) < topologyKey(mb);
+								if (requests[a].model != requests[b].model)
+									return requests[a].model < requests[b].model;
+								return a < b;
+							});
+
+							for (first = 0; first < batchOrder.size(); first = r)
+							{
+								model = requests[batchOrder[first]].model;
+								storedModel & record = models[model];
+
+								for (r = first; (r < batchOrder.size()) && (requests[batchOrder[r]].model == model); r++)
+									;
+								try
+								{
+									use(model);
+								}
+								catch (format_Error & e)		// leave this model's requests failed and carry on with the rest
+								{
+									continue;
+								}
+								if (scratch.size() < record.hidden)
+									scratch.resize(record.hidden);
+								for (r = first; (r < batchOrder.size()) && (requests[batchOrder[r]].model == model); r++)
+								{
+									runModel(record, requests[batchOrder[r]].input, scratch.data(), requests[batchOrder[r]].output);
+									requests[batchOrder[r]].status = SUCCESS;
+								}
+							}
+						}
+
+	// access
+			size_t		modelCount() { return models.size(); }
+			size_t		residentModels() { return residentCount; }
+			string		modelName(uint32_t model) { return string(names[models[model].nameId]); }
+			unsigned int standardInputs(uint32_t model) { return models[model].inputs; }
+			unsigned int outputNodes(uint32_t model) { return models[model].outputs; }
+			unsigned long pageInCount() { return pageIns; }
+			unsigned long evictionCount() { return evictions; }
+
+			size_t		weightBytes()		// the weights of the resident models
+						{
+							return (arenaUsed - freeFloats) * sizeof(float);
+						}
+
+			size_t		overheadBytes()		// everything but the weights: the records, names, index and free space in the arena
+						{
+							size_t bytes = models.capacity() * sizeof(storedModel) + freeFloats * sizeof(float);
+
+							for (const string & n : names)
+								bytes += sizeof(string) + ((n.capacity() > 15) ? n.capacity() + 1 : 0);
+							for (const string & d : directories)
+								bytes += sizeof(string) + d.capacity() + 1;
+							bytes += newest.size() * (sizeof(string_view) + sizeof(uint32_t) + 2 * sizeof(void *)) + newest.bucket_count() * sizeof(void *);
+							return bytes;
+						}
+
+			void		writeStats(ostream & outStr)
+						{
+							outStr << "Models: " << models.size() << " resident: " << residentCount << " weight bytes: " << weightBytes()
+									<< " overhead bytes: " << overheadBytes() << " bytes per model: "
+									<< ((models.size() > 0) ? (double)(weightBytes() + overheadBytes()) / models.size() : 0.0)
+									<< " page ins: " << pageIns << " evictions: " << evictions << " compactions: " << compactions << "\n";
+						}
+
+	private:
+	struct storedModel
+	{
+		uint64_t			offset;			// into the arena, in floats
+		uint32_t			nameId;
+		uint32_t			major;
+		uint32_t			minor;
+		uint32_t			revision;
+		uint32_t			olderVersion;	// the next older version of the same name, or noModel
+		uint32_t			lruPrev;		// towards the most recently used
+		uint32_t			lruNext;		// towards the least recently used
+		uint16_t			directoryId;
+		uint16_t			inputs;			// standard input nodes
+		uint16_t			hidden;
+		uint16_t			outputs;
+		uint8_t				hasBias;
+		uint8_t				resident;
+	};
+
+	static	size_t		blockSize(const storedModel & m)
+						{
+							return (size_t)m.hidden * (m.inputs + m.hasBias) + m.hidden + (size_t)m.outputs * m.hidden + m.outputs;
+						}
+
+	static	uint64_t	topologyKey(const storedModel & m)
+						{
+							return ((uint64_t)m.inputs << 40) | ((uint64_t)m.hasBias << 32) | ((uint64_t)m.hidden << 16) | m.outputs;
+						}
+
+	static	bool		isNewer(const storedModel & a, const storedModel & b)
+						{
+							if (a.major != b.major)
+								return a.major > b.major;
+							if (a.minor != b.minor)
+								return a.minor > b.minor;
+							return a.revision > b.revision;
+						}
+
+			void		runModel(const storedModel & m, const float * inputVector, float * hiddenVector, float * outputVector)
+			/*
+			 * The same arithmetic, in the same order, as nnWeights::runHidden() and runOutput()
+			 */
+						{
+							unsigned int h, i, o;
+							unsigned int inNodes = m.inputs + m.hasBias;
+							const float * hidWeights = &arena[m.offset];
+							const float * hidBiases = hidWeights + (size_t)m.hidden * inNodes;
+							const float * outWeights = hidBiases + m.hidden;
+							const float * outBiases = outWeights + (size_t)m.outputs * m.hidden;
+							const float * w;
+							float activationQuantity;
+
+							for (h = 0; h < m.hidden; h++)
+							{
+								w = &hidWeights[h * inNodes];
+								activationQuantity = 0.0;
+								for (i = 0; i < m.inputs; i++)
+									activationQuantity += w[i] * inputVector[i];
+								if (m.hasBias)
+									activationQuantity += w[m.inputs] * (float)1.0;
+
+								hiddenVector[h] = nnWeights::f(hidBiases[h] + activationQuantity);
+							}
+
+							for (o = 0; o < m.outputs; o++)
+							{
+								w = &outWeights[o * m.hidden];
+								activationQuantity = 0.0;
+								for (h = 0; h < m.hidden; h++)
+									activationQuantity += w[h] * hiddenVector[h];
+
+								outputVector[o] = nnWeights::f(outBiases[o] + activationQuantity);
+							}
+						}
+
+			void		use(uint32_t model)		// page the model in if need be and make it the most recently used
+						{
+							nnWeights * theWeights;
+							char cstrFileName[512];
+							storedModel & record = models[model];
+
+							if (record.resident)
+							{
+								unlinkLru(model);
+								linkLru(model);
+								return;
+							}
+
+							snprintf(cstrFileName, sizeof(cstrFileName), "%s/%s_%u_%u_%u.enn", directories[record.directoryId].c_str(),
+										names[record.nameId].c_str(), record.major, record.minor, record.revision);
+							theWeights = readWeights(cstrFileName);
+							if ((theWeights->standardInputNodes() != record.inputs) || (theWeights->hiddenNodes() != record.hidden)
+									|| (theWeights->outputNodes() != record.outputs) || (theWeights->hasInputBiasNode() != (record.hasBias != 0)))
+							{
+								delete theWeights;
+								throw format_Error(ENN_ERR_STORE_CHANGED);
+							}
+							try
+							{
+								pageIn(model, theWeights);
+							}
+							catch (format_Error & e)
+							{
+								delete theWeights;
+								throw;
+							}
+							delete theWeights;
+						}
+
+			void		pageIn(uint32_t model, nnWeights * theWeights)
+			/*
+			 * Find room for the model, evicting the least recently used models if the budget needs it, and copy its weights in
+			 */
+						{
+							storedModel & record = models[model];
+							size_t size = blockSize(record);
+							bool placed;
+							size_t hidSize = (size_t)record.hidden * theWeights->inputNodes();
+							float * block;
+
+							if (!(placed = takeFreeBlock(size, &record.offset)))
+							{
+								if ((budget > 0) && (arenaUsed + size > budget))
+								{
+									// no room at the end of the arena: evict down to 7/8 of the budget, so the compaction that
+									// follows leaves room for the next few models too
+									if (arenaUsed - freeFloats + size > budget)
+										while ((arenaUsed - freeFloats + size > budget - budget / 8) && (lruTail != noModel))
+											evict(lruTail);
+									if (!(placed = takeFreeBlock(size, &record.offset)))
+										compact();
+									if (!placed && (arenaUsed + size > budget))
+										throw format_Error(ENN_ERR_STORE_FULL);
+								}
+								if (!placed)
+								{
+									record.offset = arenaUsed;
+									arenaUsed += size;
+									if (arena.size() < arenaUsed)
+										arena.resize(max(arenaUsed, (budget > 0) ? min(budget, arena.size() * 2) : arena.size() * 2));
+								}
+							}
+
+							block = &arena[record.offset];
+							copy(theWeights->hiddenWeights(), theWeights->hiddenWeights() + hidSize, block);
+							copy(theWeights->hiddenBiases(), theWeights->hiddenBiases() + record.hidden, block + hidSize);
+							copy(theWeights->outputWeights(), theWeights->outputWeights() + (size_t)record.outputs * record.hidden, block + hidSize + record.hidden);
+							copy(theWeights->outputBiases(), theWeights->outputBiases() + record.outputs,
+									block + hidSize + record.hidden + (size_t)record.outputs * record.hidden);
+
+							record.resident = 1;
+							residentCount++;
+							pageIns++;
+							linkLru(model);
+						}
+
+			bool		takeFreeBlock(size_t size, uint64_t * offset)
+						{
+							unordered_map<size_t, vector<uint64_t> >::iterator found = freeBlocks.find(size);
+
+							if ((found == freeBlocks.end()) || found->second.empty())
+								return false;
+							*offset = found->second.back();
+							found->second.pop_back();
+							freeFloats -= size;
+							return true;
+						}
+
+			void		compact()		// slide the resident models down over the free blocks
+						{
+							vector<uint32_t> order;
+							uint32_t id;
+							uint64_t next = 0;
+							size_t size;
+
+							for (id = 0; id < models.size(); id++)
+								if (models[id].resident)
+									order.push_back(id);
+							sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return models[a].offset < models[b].offset; });
+
+							for (uint32_t m : order)
+							{
+								size = blockSize(models[m]);
+								if (models[m].offset != next)
+									copy(arena.begin() + models[m].offset, arena.begin() + models[m].offset + size, arena.begin() + next);
+								models[m].offset = next;
+								next += size;
+							}
+
+							arenaUsed = next;
+							freeBlocks.clear();
+							freeFloats = 0;
+							compactions++;
+						}
+
+			void		linkLru(uint32_t model)		// at the most recently used end
+						{
+							models[model].lruPrev = noModel;
+							models[model].lruNext = lruHead;
+							if (lruHead != noModel)
+								models[lruHead].lruPrev = model;
+							lruHead = model;
+							if (lruTail == noModel)
+								lruTail = model;
+						}
+
+			void		unlinkLru(uint32_t model)
+						{
+							storedModel & record = models[model];
+
+							if (record.lruPrev != noModel)
+								models[record.lruPrev].lruNext = record.lruNext;
+							else
+								lruHead = record.lruNext;
+							if (record.lruNext != noModel)
+								models[record.lruNext].lruPrev = record.lruPrev;
+							else
+								lruTail = record.lruPrev;
+							record.lruPrev = record.lruNext = noModel;
+						}
+
+			uint32_t	nameId(const string & netName)
+						{
+							uint32_t id = find(netName);
+
+							if (id != noModel)
+								return models[id].nameId;
+							names.push_back(netName);		// a deque, so the string_view keys of newest stay valid
+							return (uint32_t)names.size() - 1;
+						}
+
+			uint16_t	directoryId(const string & directory)
+						{
+							uint16_t id;
+
+							for (id = 0; id < directories.size(); id++)
+								if (directories[id] == directory)
+									return id;
+							directories.push_back(directory);
+							return id;
+						}
+
+	static	nnWeights *	readWeights(const char * cstrFilename)		// the caller deletes the result
+						{
+							ifstream * pFile;
+							networkFile * nFile;
+							nnWeights * theWeights;
+
+							pFile = new ifstream(cstrFilename);
+							if (!pFile->is_open())
+							{
+								delete pFile;
+								throw format_Error(ENN_ERR_NON_FILE);
+							}
+
+							nFile = new networkFile(pFile);
+							try
+							{
+								nFile->readInFile();
+								theWeights = new nnWeights(nFile);
+							}
+							catch (format_Error & e)
+							{
+								delete nFile;
+								delete pFile;
+								throw;
+							}
+							delete nFile;
+							delete pFile;
+
+							return theWeights;
+						}
+
+	private:
+	vector<float>		arena;
+	size_t				arenaUsed;			// in floats, the high water mark of the arena
+	size_t				freeFloats;			// in the free blocks
+	size_t				budget;				// in floats, 0 for none
+	unordered_map<size_t, vector<uint64_t> > freeBlocks;	// offsets of freed blocks by size
+
+	vector<storedModel>	models;				// by model id, never removed
+	deque<string>		names;				// one per network name
+	vector<string>		directories;
+	unordered_map<string_view, uint32_t> newest;	// name to the id of its newest version
+
+	uint32_t			lruHead;			// most recently used resident model
+	uint32_t			lruTail;			// least recently used
+	size_t				residentCount;
+	unsigned long		pageIns;
+	unsigned long		evictions;
+	unsigned long		compactions;
+
+	vector<float>		scratch;			// the hidden node values of the model being run
+	vector<uint32_t>	batchOrder;
+};
+
+#endif	// _modelStore_h
@@ -19,7 +19,13 @@ enum layer_modifier { BIAS_NODE };
 class network_description
 {
 	public:
-                        network_description() { }
+                        network_description()
+                        {
+                            inputNodeCount = hiddenNodeCount = outputNodeCount = 0;
+                            inputLayerBiasNode = false;
+                            learningRate = (float)0.1;
+                            momentum = (float)0.0;
+                        }
 
                         network_description(int inputNodes, int hiddenNodes, int outputNodes, float newLearningRate)
                         {
@@ -27,6 +33,7 @@ class network_description
                             hiddenNodeCount = hiddenNodes;
                             outputNodeCount = outputNodes;
                             learningRate = newLearningRate;
+                            momentum = (float)0.0;
                             name = "network-addTopology";
                             inputLayerBiasNode = false;
                         }
@@ -37,6 +44,7 @@ class network_description
                             hiddenNodeCount = hiddenNodes;
                             outputNodeCount = outputNodes;
                             learningRate = newLearningRate;
+                            momentum = (float)0.0;
                             name = netName;
                             inputLayerBiasNode = false;
                         }
@@ -17,6 +17,20 @@
  * default file extension for a network file is .enn
  *
  * You should not have to edit a .enn file directly yourself.
+ *
+ * A network file may also carry an int8 quantized copy of its weights (see quantizedWeights.hpp) after the float
+ * weights:
+ *
+ *	quantScale(layer,scale)					the activation scale of the input (0) or hidden (1) layer
+ *	quantRow(layer,node,scale,q0,q1,...)	the int8 weights into a hidden (1) or output (2) node and their scale
+ *
+ * The float weights are read as before and the quantized section is only kept for quantizedWeights.
+ *
+ * A storage(fp16) or storage(bf16) line asks for the weights to be run in 16 bits (see halfWeights.hpp).
+ *
+ * A network with pruned links (see nn::pruneBelow() and nn::pruneToTop()) is saved sparse: a sparse(count) line before
+ * the links gives the number of link lines that follow and the pruned links are left out. They read back as 0 and
+ * linkMask() says which links were there, so that nn can keep the rest pruned.
  */
 
 class networkFile : public NNFile
@@ -27,6 +41,11 @@ class networkFile : public NNFile
                             hiddenBiases = NULL;
                             outputBiases = NULL;
                             hasInputBiasNode = false;
+                            linksRead = nodesRead = 0;
+                            nameRead = false;
+                            quantScales[0] = quantScales[1] = 0.0;
+                            sparseLinks = 0;
+                            sparse = false;
                         }
 
                         networkFile() : NNFile()
@@ -34,6 +53,11 @@ class networkFile : public NNFile
                             hiddenBiases = NULL;
                             outputBiases = NULL;
                             hasInputBiasNode = false;
+                            linksRead = nodesRead = 0;
+                            nameRead = false;
+                            quantScales[0] = quantScales[1] = 0.0;
+                            sparseLinks = 0;
+                            sparse = false;
                         }
 
                         virtual ~networkFile() //: ~NNFile()
@@ -50,6 +74,15 @@ class networkFile : public NNFile
                                 delete hiddenBiases;
                             if (outputBiases != NULL)
                                 delete outputBiases;
+                            hiddenBiases = outputBiases = NULL;
+                            linksRead = nodesRead = 0;
+                            nameRead = false;
+                            quantScales[0] = quantScales[1] = 0.0;
+                            quantRows[0].clear();
+                            quantRows[1].clear();
+                            storage.clear();
+                            sparseLinks = 0;
+                            sparse = false;
                             NNFile::setTo(theFile);
                         }
 
@@ -62,6 +95,64 @@ class networkFile : public NNFile
 		unsigned int	minorVersion() { return minor; }	// minor versions have different starting point for training
 		unsigned int	revision() { return revis; }		// revisions have different amounts of training
 
+        bool			isComplete()
+        				/*
+        				 * Return true if every link and node promised by the networkTopology line has been read. A file
+        				 * that is still being written by another process will usually fail this check.
+        				 */
+                        {
+                            if ((hiddenBiases == NULL) || !nameRead)
+                                return false;
+
+                            if (sparse)
+                                return (linksRead == sparseLinks) && (nodesRead == net.hiddenNodes() + net.outputNodes());
+                            return (linksRead == (net.inputNodes() * net.hiddenNodes()) + (net.hiddenNodes() * net.outputNodes()))
+                                    && (nodesRead == net.hiddenNodes() + net.outputNodes());
+                        }
+
+        bool			hasQuantized()		// true if every quantized row and scale promised by the topology has been read
+                        {
+                            unsigned int node;
+
+                            if ((hiddenBiases == NULL) || (quantScales[0] <= 0.0) || (quantScales[1] <= 0.0)
+                                    || (quantRows[0].size() != net.hiddenNodes()) || (quantRows[1].size() != net.outputNodes()))
+                                return false;
+                            for (node = 0; node < net.hiddenNodes(); node++)
+                                if (quantRows[0][node].size() != net.standardInputNodes() + 1)
+                                    return false;
+                            for (node = 0; node < net.outputNodes(); node++)
+                                if (quantRows[1][node].size() != net.hiddenNodes() + 1)
+                                    return false;
+                            return true;
+                        }
+
+        bool			isSparse() { return sparse; }
+
+        twoDFloatArray *linkMask(unsigned int layer)
+        				/*
+        				 * For a sparse file, 1 for each link that was read and 0 for each one left out (pruned), dimensioned
+        				 * as linkWeights(layer)
+        				 */
+                        {
+                            if (layer > 1)
+                                throw format_Error(ENN_ERR_LINK_ON_OUTPUT);
+                            return &linkMasks[layer];
+                        }
+
+        const string &	weightStorage() { return storage; }		// fp16, bf16 or empty for float
+
+        float			quantizedScale(unsigned int layer) { return quantScales[layer]; }	// 0 input, 1 hidden
+
+        vector<float> *	quantizedRow(unsigned int layer, unsigned int node)
+        				/*
+        				 * The int8 values of the weights into node of layer 1 (hidden) or 2 (output), followed by their scale
+        				 */
+                        {
+                            if ((layer < 1) || (layer > 2))
+                                throw format_Error(ENN_ERR_LAYER_DOES_NOT_EXIST);
+                            return &quantRows[layer - 1][node];
+                        }
+
         void			networkDescription(network_description * netDes)	// structure passed in by the caller
                         {
                             (*netDes) = net;
@@ -111,8 +202,8 @@ class networkFile : public NNFile
 	private:
         status_t		decodeLine(string * strLine)
                         {
-                            string verb = "";
-                            string arguements = "";
+                            string & verb = lineVerb;
+                            string & arguements = lineArguements;
 
                             if (verbArguement(strLine, verb, arguements))
                             {
@@ -170,6 +261,23 @@ class networkFile : public NNFile
 #endif
                                     return decodeLearning(&arguements);
                                 }
+                                if (verb == "storage")
+                                {
+                                    storage = arguements.substr(1, arguements.find(')') - 1);
+                                    return SUCCESS;
+                                }
+                                if (verb == "sparse")
+                                {
+                                    std::string::size_type startPos = 1;
+
+                                    sparseLinks = nextUIValue(&arguements, startPos, ')');
+                                    sparse = true;
+                                    return SUCCESS;
+                                }
+                                if (verb == "quantScale")
+                                    return decodeQuantScale(&arguements);
+                                if (verb == "quantRow")
+                                    return decodeQuantRow(&arguements);
                                 if (verb == "layerModifier")
                                 {
 #ifdef _DEBUG_
@@ -205,13 +313,17 @@ class networkFile : public NNFile
 #ifdef _DEBUG_
                                         	cout << "Link: layer-" << layer << " innode-" << node << " outnode-" << link << " weight: " << linkWeight << "\n";
 #endif
+                            linksRead++;
+
                             switch (layer)
                             {
                                 case 0:
                                     inputLinkWghts.set(node, link, linkWeight);
+                                    linkMasks[0].set(node, link, 1.0);
                                     break;
                                 case 1:
                                     hiddenLinkWghts.set(node, link, linkWeight);
+                                    linkMasks[1].set(node, link, 1.0);
                                     break;
                                 case 2:
                                     throw format_Error(ENN_ERR_LINK_ON_OUTPUT);
@@ -238,6 +350,8 @@ class networkFile : public NNFile
 #ifdef _DEBUG_
                                         	cout << "Node: layer-" << layer << " node-" << node << " bias-" << nodeBias << "\n";
 #endif
+                            nodesRead++;
+
                             switch (layer)
                             {
                                 case 0:
@@ -256,6 +370,60 @@ class networkFile : public NNFile
                             return SUCCESS;
                         }
 
+        status_t		decodeQuantScale(string * strBracket)
+                        {
+                            unsigned int layer;
+                            std::string::size_type		 startPos = 1;
+
+                            layer = nextUIValue(strBracket, startPos);
+                            if (layer > 1)
+                                throw format_Error(ENN_ERR_TOO_MANY_LAYERS);
+                            quantScales[layer] = nextFValue(strBracket, startPos, ')');
+
+                            return SUCCESS;
+                        }
+
+        status_t		decodeQuantRow(string * strBracket)
+                        {
+                            unsigned int layer;
+                            unsigned int node;
+                            unsigned int count, i;
+                            vector<float> * row;
+                            std::string::size_type		 startPos = 1;
+
+                            if (hiddenBiases == NULL)
+                                throw format_Error(ENN_ERR_CONTENT_IN_NETWORK_FILE);
+
+                            layer = nextUIValue(strBracket, startPos);
+                            node = nextUIValue(strBracket, startPos);
+                            switch (layer)
+                            {
+                                case 1:
+                                    count = net.standardInputNodes();
+                                    if (node >= net.hiddenNodes())
+                                        throw format_Error(ENN_ERR_CONTENT_IN_NETWORK_FILE);
+                                    quantRows[0].resize(net.hiddenNodes());
+                                    break;
+                                case 2:
+                                    count = net.hiddenNodes();
+                                    if (node >= net.outputNodes())
+                                        throw format_Error(ENN_ERR_CONTENT_IN_NETWORK_FILE);
+                                    quantRows[1].resize(net.outputNodes());
+                                    break;
+                                default:
+                                    throw format_Error(ENN_ERR_LAYER_DOES_NOT_EXIST);
+                            }
+
+                            row = &quantRows[layer - 1][node];
+                            row->resize(count + 1);
+                            (*row)[count] = nextFValue(strBracket, startPos);		// the scale is first in the file, kept last
+                            for (i = 0; i + 1 < count; i++)
+                                (*row)[i] = nextFValue(strBracket, startPos);
+                            (*row)[count - 1] = nextFValue(strBracket, startPos, ')');
+
+                            return SUCCESS;
+                        }
+
         status_t		decodeName(string * strBracket)
                         {
 							std::string::size_type		startPos;
@@ -270,6 +438,7 @@ class networkFile : public NNFile
                             major = nextUIValue(strBracket, startPos);
                             minor = nextUIValue(strBracket, startPos);
                             revis = nextUIValue(strBracket, startPos, ')');
+                            nameRead = true;
 
 #ifdef _DEBUG_
                                         	cout << "Name: " << name << " major-" << major << " minor-" << minor << " revision" << revis << "\n";
@@ -287,6 +456,8 @@ class networkFile : public NNFile
                             outputBiases = new vector<float>(net.outputNodes());
                             inputLinkWghts.dimension(net.inputNodes(), net.hiddenNodes());
                             hiddenLinkWghts.dimension(net.hiddenNodes(), net.outputNodes());
+                            linkMasks[0].dimension(net.inputNodes(), net.hiddenNodes());
+                            linkMasks[1].dimension(net.hiddenNodes(), net.outputNodes());
 
                             return returnVal;
                         }
@@ -325,6 +496,7 @@ class networkFile : public NNFile
 									if (value == "true")
 									{
 										inputLinkWghts.redimension(net.standardInputNodes() + 1, net.hiddenNodes());
+										linkMasks[0].redimension(net.standardInputNodes() + 1, net.hiddenNodes());
 										net.setInputLayerBiasNode(true);
 //										cout << "Input layer has bias node.\n";
 									}
@@ -354,6 +526,15 @@ class networkFile : public NNFile
 		vector<float> *	hiddenBiases;		// created on readIn deleted at destruction
 		vector<float> * outputBiases;		//	"
 		bool			hasInputBiasNode;	// true if the input layer has a unaryBiasNode i.e. layerModifier(0, biasNode:true)
+		unsigned int	linksRead;			// counted so that a partially written file can be detected
+		unsigned int	nodesRead;			//	"
+		bool			nameRead;
+		float			quantScales[2];		// input and hidden activation scales, 0 if there is no quantized section
+		vector<vector<float> > quantRows[2];	// into the hidden and output nodes, the int8 values then the scale
+		string			storage;			// the 16 bit format of a storage line, empty if there is none
+		bool			sparse;				// true if there was a sparse line
+		unsigned int	sparseLinks;		// the number of link lines it promised
+		twoDFloatArray	linkMasks[2];		// 1 for each link read, see linkMask()
 
         string 			name;
 };
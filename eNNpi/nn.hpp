@@ -2,17 +2,41 @@
 #define _nn_h
 
 #include <sys/stat.h> // POSIX only
+#include <limits.h>
 
 #include <sstream>
 #include <random>
+#include <algorithm>
 #include "networkFile.hpp"
 #include "dataFile.hpp"
 #include "nnLayer.hpp"
+#include "nnWeights.hpp"
+#include "testMetrics.hpp"
+#include "threadPool.hpp"
+#include "latencyHistogram.hpp"
 
 typedef void (*funcRunCallback)(const int, void *);
 typedef void (*funcTrainCallback)(void *);
 typedef void (*funcTestCallback)(const int, vector<float>*, vector<float>*, vector<float>*, vector<float>*, void *);
 
+const size_t parallelChunkRows = 256;		// the number of rows a worker runs in one go when setThreads() > 1
+
+enum latency_site { LATENCY_RUN, LATENCY_TEST, LATENCY_TRAIN, LATENCY_SITES };	// see setLatency()
+
+struct rpropState
+/*
+ * What the last rpropTrainer run learnt about each weight and bias of a network, so that the next -t carries on from
+ * it rather than from the initial step sizes (see rpropTrainer). It lives as long as the network but is not saved in
+ * its file.
+ */
+{
+	vector<float>		stepSize;
+	vector<double>		lastGradient;
+	vector<float>		lastChange;
+	double				lastLoss = -1.0;
+	vector<float>		trainedWeights;			// the weights and biases the run ended with
+};
+
 class nn
 {
 	public:
@@ -52,8 +76,6 @@ class nn
                          *
                          */
                         {
-                        	newNet.setMomentum((float)0.0);
-
                             setup(newNet);
                             majorVersion = minorVersion = revision = 0;
                             networkName = newNet.networkName();
@@ -80,9 +102,8 @@ class nn
                         	ifstream * pFile;
                         	networkFile * nFile;
 
-                            if (checkExists(cstrFilename))
+                            if ((pFile = openFile(cstrFilename)) != NULL)
 							{
-								pFile = new ifstream(cstrFilename);
 								nFile = new networkFile(pFile);
 								nFile->readInFile();
 								setNetworkFile(nFile);
@@ -113,6 +134,9 @@ class nn
                          */
                         {
                         	delete errorVector;
+                        	if (pool != NULL)
+                        		delete pool;
+                        	setLatency(false);
                             delete theInputLayer;
                             delete theHiddenLayer;
                             delete theOutputLayer;
@@ -136,9 +160,8 @@ class nn
                             inputFile * inFile;
                             ifstream * pFile;
 
-                            if (checkExists(cstrFilename))
+                            if ((pFile = openFile(cstrFilename)) != NULL)
 							{
-								pFile = new ifstream(cstrFilename);
 								inFile = new inputFile(pFile);
 								inFile->readInFile();
 								run(inFile, runComplete);
@@ -179,13 +202,38 @@ class nn
 			 *
 			 *	Call ((nn*)theNetwork)->runResult(vector<float>* existingVector) to retrieve the result
 			 *
+			 *	If setThreads() has been given more than one thread the rows are shared out between the threads,
+			 *	but runComplete is still called on this thread once for each row, in row order.
+			 *
 			 */
                         {
                             unsigned int i;
 
+                            STATS_PHASE(PHASE_RUN);
+                            TRACE_SCOPE("run");
+                            STATS_COUNT(COUNT_ROWS_RUN, inFile->inputLines());
+                            STATS_COUNT(COUNT_LINKS_VISITED, inFile->inputLines() * linksPerRow());
+
+                            if (workerCount > 1)
+                            {
+                            	runParallel(inFile, LATENCY_RUN, [&](unsigned int row, const float * result)
+                            	{
+                            		if (runComplete != NULL)
+                            		{
+                            			STATS_PHASE(PHASE_CALLBACK);
+                            			dispatchedResult = result;
+                            			runComplete(row, (void*)this);
+                            			dispatchedResult = NULL;
+                            		}
+                            	});
+                            	return;
+                            }
+
+                            TRACE_CHUNKS(runChunks, "run chunk", parallelChunkRows);
                             for (i = 0; i < inFile->inputLines(); i++)
                             {
                                 run(inFile->inputSet(i), runComplete, i);
+                                TRACE_TICK(runChunks);
                             }
 
                         }
@@ -203,14 +251,18 @@ class nn
 			 * Note: this version is not multi threaded so waitForActivation and blockTillValue do nothing
              */
                         {
+                            unsigned long long started = (latency[LATENCY_RUN] != NULL) ? latencyRecorder::now() : 0;
 
-                            theOutputLayer->waitForActivation();									// set up the semaphores
-                            theInputLayer->setInputVector(inputVector);								// set the input nodes with the input vector
-                            theInputLayer->run();													// run the network
-                            theOutputLayer->blockTillValue();										// wait till all the semaphores are cleared
+                            forward(inputVector);
+
+                            if (started != 0)
+                            	latency[LATENCY_RUN]->slot(0).record(latencyRecorder::now() - started);
 
                             if (runComplete != NULL)
+                            {
+                                STATS_PHASE(PHASE_CALLBACK);
                                 runComplete(index, (void*)this);
+                            }
                         }
 
             void		run(vector<float> * inputVector, vector<float> * outputVector)
@@ -233,7 +285,13 @@ class nn
 			 *
 			 */
                         {
-                            theOutputLayer->returnOutputVector(outputVector);		// retrieve the result vector
+                            unsigned int i;
+
+                            if (dispatchedResult != NULL)		// a row run by one of the setThreads() workers
+                            	for (i = 0; i < outputVector->size(); i++)
+                            		(*outputVector)[i] = dispatchedResult[i];
+                            else
+                            	theOutputLayer->returnOutputVector(outputVector);		// retrieve the result vector
                             return outputVector;
                         }
 
@@ -267,9 +325,8 @@ class nn
                             ifstream * pFile;
                             trainingFile * trFile;
 
-                            if (checkExists(cstrFilename))
+                            if ((pFile = openFile(cstrFilename)) != NULL)
 							{
-								pFile = new ifstream(cstrFilename);
 								trFile = new trainingFile(pFile);
 								trFile->readInFile();
 								train(trFile, trComplete);
@@ -292,16 +349,15 @@ class nn
              *
              */
                         {
-                            // call train with each vector
-                            unsigned int i;
-
-                            for (i=0; i < trFile->inputLines(); i++)
-                                train(trFile->inputSet(i), trFile->outputSet(i));	// don't pass the call back because we only want it called at the end not after each training set
+                            trainPass(trFile);		// don't pass the call back because we only want it called at the end not after each training set
 
                             incrementRevision();
 
                             if (trComplete != NULL)
+                            {
+                                STATS_PHASE(PHASE_CALLBACK);
                                 trComplete((void*)this);
+                            }
                         }
 
             void		train(vector<float> * inputVector, vector<float> * desiredVector, funcTrainCallback trComplete = NULL)
@@ -315,10 +371,12 @@ class nn
              *
              */
                         {
+                            unsigned long long started = (latency[LATENCY_TRAIN] != NULL) ? latencyRecorder::now() : 0;
+
                             try
                             {
                                 // run
-                                run(inputVector);
+                                forward(inputVector);
 
                                 theOutputLayer->setDesiredValues(desiredVector);
 
@@ -338,9 +396,63 @@ class nn
                                 cout << iErr.mesg;// << " last error:" << iErr.lastError;
                             }
 
+                            if (started != 0)
+                            	latency[LATENCY_TRAIN]->slot(0).record(latencyRecorder::now() - started);
+
                             hasChanged = true;
                         }
 
+            template <class trainingRows>
+            double		trainPass(trainingRows * trFile, const unsigned int * order = NULL, unsigned int first = 0, unsigned int rows = UINT_MAX)
+            /*
+             * Train the network once with every row of trFile (a trainingFile or a trainingView), in the order given by order (row indexes, inputLines() of them)
+             * or in file order if order is NULL. Returns the mean squared error of the pass, taken from each row's output
+             * before its weights are adjusted and averaged over the rows and output nodes.
+             *
+             * first and rows train just part of the pass: positions first to first + rows - 1 of the order, so that a
+             * caller can do something between batches of an epoch.
+             *
+             * Unlike train(trainingFile *) this does not change the revision, so that a run of several passes can call
+             * trainingRunComplete() once at the end.
+             *
+             */
+                        {
+                            unsigned int i, row, last;
+                            size_t j;
+                            double sumSquared = 0.0;
+                            float diff;
+
+                            first = min(first, trFile->inputLines());
+                            last = (rows > trFile->inputLines() - first) ? trFile->inputLines() : first + rows;
+
+                            STATS_PHASE(PHASE_TRAIN);
+                            TRACE_SCOPE("train epoch");
+                            TRACE_CHUNKS(trainBatches, "train batch", parallelChunkRows);
+                            STATS_COUNT(COUNT_ROWS_TRAINED, last - first);
+                            STATS_COUNT(COUNT_LINKS_VISITED, (unsigned long long)(last - first) * linksPerRow() * 2);	// forward and back
+
+                            if (testOutput.size() != net.outputNodes())
+                            	testOutput.resize(net.outputNodes());
+
+                            for (i = first; i < last; i++)
+                            {
+                                row = (order != NULL) ? order[i] : i;
+                                train(trFile->inputSet(row), trFile->outputSet(row));
+
+                                theOutputLayer->returnOutputVector(&testOutput);	// the output of the forward pass, training does not change it
+                                for (j = 0; j < testOutput.size(); j++)
+                                {
+                                	diff = (*trFile->outputSet(row))[j] - testOutput[j];
+                                	sumSquared += diff * diff;
+                                }
+                                TRACE_TICK(trainBatches);
+                            }
+
+                            return (last == first) ? 0.0 : sumSquared / ((double)(last - first) * net.outputNodes());
+                        }
+
+            void		trainingRunComplete() { incrementRevision(); }	// call once after a run of trainPass() calls
+
             status_t	trainingError(vector<float> * errorVector)
             /*
              * Return the most recent error vector generated by the most recent training set.
@@ -356,7 +468,7 @@ class nn
 							return SUCCESS;
 						}
 
-            void		test(const char * cstrTestFilename, funcTestCallback testComplete = NULL)
+            void		test(const char * cstrTestFilename, funcTestCallback testComplete = NULL, testMetrics * metrics = NULL)
             /*
              * Run the data component of the training file called the contents of the C string cstrTestFilename and
              * compare the output generated by the network to the desired output. Calculate the difference.
@@ -371,17 +483,19 @@ class nn
              * errorVector: a pointer to a vector containing the desired minus the actual output
              * thisObject: an anonymous pointer to this object
              *
+             * If metrics is not NULL every row is also added to it (see testMetrics.hpp) so the callback can be NULL
+             * when only the summary is wanted.
+             *
              */
 						{
 							ifstream * pFile;
 							trainingFile * tstFile;
 
-							if (checkExists(cstrTestFilename))
+							if ((pFile = openFile(cstrTestFilename)) != NULL)
 							{
-								pFile = new ifstream(cstrTestFilename);
 								tstFile = new trainingFile(pFile);
 								tstFile->readInFile();
-								test(tstFile, testComplete);
+								test(tstFile, testComplete, metrics);
 								delete pFile;
 								delete tstFile;
 							}
@@ -389,7 +503,7 @@ class nn
 								throw format_Error(ENN_ERR_NON_FILE);
 						}
 
-            void		test(string * strTestFilename, funcTestCallback testComplete = NULL)
+            void		test(string * strTestFilename, funcTestCallback testComplete = NULL, testMetrics * metrics = NULL)
             /*
              * Run the data component of the training file called the contents of the string object strTestFilename and
              * compare the output generated by the network to the desired output. Calculate the difference.
@@ -408,10 +522,10 @@ class nn
              *
              */
 						{
-							test(strTestFilename->c_str(), testComplete);
+							test(strTestFilename->c_str(), testComplete, metrics);
 						}
 
-            void		test(trainingFile * testFile, funcTestCallback testComplete = NULL)
+            void		test(trainingFile * testFile, funcTestCallback testComplete = NULL, testMetrics * metrics = NULL)
             /*
              * Run the data component of the training file inside the wrapper testFile and
              * compare the output generated by the network to the desired output. Calculate the difference.
@@ -426,16 +540,61 @@ class nn
              * errorVector: a pointer to a vector containing the desired minus the actual output
              * thisObject: an anonymous pointer to this object
              *
+             * If metrics is not NULL every row is also added to it (see testMetrics.hpp) so the callback can be NULL
+             * when only the summary is wanted.
+             *
+             * If setThreads() has been given more than one thread the rows are shared out between the threads,
+             * but testComplete is still called on this thread once for each row, in row order.
+             *
              */
 						{
 							unsigned int i;
 
+							STATS_PHASE(PHASE_TEST);
+							TRACE_SCOPE("test");
+							STATS_COUNT(COUNT_ROWS_TESTED, testFile->inputLines());
+							STATS_COUNT(COUNT_LINKS_VISITED, testFile->inputLines() * linksPerRow());
+
+							if (workerCount > 1)
+							{
+								runParallel(testFile, LATENCY_TEST, [&](unsigned int row, const float * result)
+								{
+									size_t j;
+									vector<float> * desiredOutput = testFile->outputSet(row);
+
+									if (testOutput.size() != net.outputNodes())
+										testOutput.resize(net.outputNodes());
+									if (errorVector->size() != net.outputNodes())
+										errorVector->resize(net.outputNodes());
+
+									for (j = 0; j != testOutput.size(); j++)
+									{
+										testOutput[j] = result[j];
+										(*errorVector)[j] = result[j] - (*desiredOutput)[j];
+									}
+
+									if (metrics != NULL)
+										metrics->add(desiredOutput->data(), testOutput.data());
+
+									if (testComplete != NULL)
+									{
+										STATS_PHASE(PHASE_CALLBACK);
+										testComplete(row, testFile->inputSet(row), desiredOutput, &testOutput, errorVector, (void*)this);
+									}
+								});
+								return;
+							}
+
+							TRACE_CHUNKS(testChunks, "test chunk", parallelChunkRows);
 							for (i=0; i < testFile->inputLines(); i++)
-								test(i, testFile->inputSet(i), testFile->outputSet(i), testComplete);
+							{
+								test(i, testFile->inputSet(i), testFile->outputSet(i), testComplete, metrics);
+								TRACE_TICK(testChunks);
+							}
 
 						}
 
-            void		test(const int index, vector<float> * inputVector, vector<float> * desiredOutput, funcTestCallback testComplete = NULL)
+            void		test(const int index, vector<float> * inputVector, vector<float> * desiredOutput, funcTestCallback testComplete = NULL, testMetrics * metrics = NULL)
             /*
              * Test a single input vector and compare the result with the givine output vector. Then
              * compare the output generated by the network to the desired output. Calculate the difference.
@@ -450,24 +609,41 @@ class nn
              * errorVector: a pointer to a vector containing the desired minus the actual output
              * thisObject: an anonymous pointer to this object
              *
+             * If metrics is not NULL every row is also added to it (see testMetrics.hpp) so the callback can be NULL
+             * when only the summary is wanted.
+             *
              */
 						{
             				size_t i;
-            				vector<float> outputVec(net.outputNodes());
+            				unsigned long long started = (latency[LATENCY_TEST] != NULL) ? latencyRecorder::now() : 0;
+
+            				if (testOutput.size() != net.outputNodes())		// only after the topology has changed
+            					testOutput.resize(net.outputNodes());
+            				if (errorVector->size() != net.outputNodes())
+            					errorVector->resize(net.outputNodes());
 
             				// run
-							run(inputVector);
+							forward(inputVector);
 
 							// block til value
 
 							// compare
-							theOutputLayer->returnOutputVector(&outputVec);
+							theOutputLayer->returnOutputVector(&testOutput);
 
 							for (i = 0; i != errorVector->size(); i++)
-								(*errorVector)[i] = outputVec[i] - (*desiredOutput)[i];
+								(*errorVector)[i] = testOutput[i] - (*desiredOutput)[i];
+
+							if (metrics != NULL)
+								metrics->add(desiredOutput->data(), testOutput.data());
+
+							if (started != 0)
+								latency[LATENCY_TEST]->slot(0).record(latencyRecorder::now() - started);
 
 							if (testComplete != NULL)
-								testComplete(index, inputVector, desiredOutput, &outputVec, errorVector, (void*)this);
+							{
+								STATS_PHASE(PHASE_CALLBACK);
+								testComplete(index, inputVector, desiredOutput, &testOutput, errorVector, (void*)this);
+							}
 						}
 
             void		randomise()
@@ -475,6 +651,7 @@ class nn
              * Randomise the weights and biases in the network thereby restarting the training cycle from a different place.
              */
 						{
+							STATS_PHASE(PHASE_RANDOMISE);
 							random_device rd;
 							theHiddenLayer->randomise(rd);
 							theOutputLayer->randomise(rd);
@@ -507,12 +684,12 @@ class nn
 			{
 				fstream * pFile;
 				status_t rVal;
-				char cstrPathFile[255];	// dumb
-				char cstrFileName[25]; // dumb
+				char cstrPathFile[512];
+				char cstrFileName[255];		// big enough for a tagged name such as a cross validation fold
 
 				if (checkExists(cstrPath, false))
 				{
-					sprintf(cstrPathFile, "%s//%s", cstrPath, defaultName(cstrFileName));
+					snprintf(cstrPathFile, sizeof(cstrPathFile), "%s//%s", cstrPath, defaultName(cstrFileName));
 
 					pFile = new fstream();
 					pFile->open(cstrPathFile, ios::out);
@@ -534,6 +711,9 @@ class nn
 				string strContent;
 				status_t rVal;
 				rVal = saveOn(&strContent);
+
+				STATS_PHASE(PHASE_WRITE);
+				TRACE_SCOPE("write");
 				(*pFile) << strContent;
 
 				return rVal;
@@ -545,6 +725,8 @@ class nn
 			 *  save the net in the given existing string
 			 */
 			{
+				STATS_PHASE(PHASE_SAVE);
+				TRACE_SCOPE("save");
 				stringstream ss;
 
 				ss.precision(8);
@@ -555,6 +737,9 @@ class nn
 
 				ss << "learning(" << net.trainingLearningRate() << "," << net.trainingMomentum() << ")\n";
 
+				if (prunedLinks() > 0)
+					ss << "sparse(" << links() - prunedLinks() << ")\n";
+
 				// call the detail storage process here
 				theInputLayer->storeOn(&ss);
 				theHiddenLayer->storeOn(&ss);
@@ -563,6 +748,7 @@ class nn
 				hasChanged = false;
 
 				(*strOut) = ss.str();
+				STATS_COUNT(COUNT_BYTES_SAVED, strOut->size());
 
 				return SUCCESS;
 			}
@@ -589,12 +775,16 @@ class nn
                 net.setOutputNodes(newOut);
                 net.setStandardInputNodes(newIn);
 
-                theInputLayer = new inputLayer(net, layerNo++);		// deleted in ~nn
-                theHiddenLayer = new hiddenLayer(net, layerNo++);	// deleted in ~nn
-                theOutputLayer = new outputLayer(net, layerNo++);	// deleted in ~nn
+                {
+                	STATS_PHASE(PHASE_BUILD);
 
-                theInputLayer->connectNodes(theHiddenLayer->nodeList());
-                theHiddenLayer->connectNodes(theOutputLayer->nodeList());
+					theInputLayer = new inputLayer(net, layerNo++);		// deleted in ~nn
+					theHiddenLayer = new hiddenLayer(net, layerNo++);	// deleted in ~nn
+					theOutputLayer = new outputLayer(net, layerNo++);	// deleted in ~nn
+
+					theInputLayer->connectNodes(theHiddenLayer->nodeList());
+					theHiddenLayer->connectNodes(theOutputLayer->nodeList());
+                }
 
                 randomise();
                 incrementMajorVersion();
@@ -655,6 +845,78 @@ class nn
                 return SUCCESS;
 			}
 
+			status_t	removeHiddenNodes(const vector<bool> & remove, const vector<double> & meanValues)
+			/*
+			 * Remove the hidden nodes flagged in remove, for nodes whose value hardly changes (see nodeActivity.hpp). Each
+			 * removed node's mean value (meanValues, one per hidden node) times its weight to an output node is added to
+			 * that output node's bias, so the outputs stay as close as the node was to constant. The rest of the weights
+			 * and any pruned links are kept.
+			 *
+			 * This increments the major version. Returns FAILURE, leaving the network alone, if no node or every node
+			 * would be removed.
+			 */
+			{
+				nnWeights * oldWeights;
+				network_description newNet;
+				unsigned int keep, h, k, i, o;
+				double outputBias;
+				bool wasPruned;
+
+				if ((remove.size() != net.hiddenNodes()) || (meanValues.size() != net.hiddenNodes()))
+					return FAILURE;
+				keep = count(remove.begin(), remove.end(), false);
+				if ((keep == 0) || (keep == net.hiddenNodes()))
+					return FAILURE;
+
+				oldWeights = snapshot();
+				wasPruned = (prunedLinks() > 0);
+				newNet = net;
+				newNet.setHiddenNodes(keep);
+				nnWeights newWeights(newNet);
+
+				for (h = k = 0; h < net.hiddenNodes(); h++)
+					if (!remove[h])
+					{
+						for (i = 0; i < net.inputNodes(); i++)
+							newWeights.hiddenWeights()[k * net.inputNodes() + i] = oldWeights->hiddenWeights()[h * net.inputNodes() + i];
+						newWeights.hiddenBiases()[k] = oldWeights->hiddenBiases()[h];
+						for (o = 0; o < net.outputNodes(); o++)
+							newWeights.outputWeights()[o * keep + k] = oldWeights->outputWeights()[o * net.hiddenNodes() + h];
+						k++;
+					}
+				for (o = 0; o < net.outputNodes(); o++)
+				{
+					outputBias = oldWeights->outputBiases()[o];
+					for (h = 0; h < net.hiddenNodes(); h++)
+						if (remove[h])
+							outputBias += (double)oldWeights->outputWeights()[o * net.hiddenNodes() + h] * meanValues[h];
+					newWeights.outputBiases()[o] = (float)outputBias;
+				}
+				delete oldWeights;
+
+				alter(net.standardInputNodes(), keep, net.outputNodes());
+				setWeights(&newWeights);
+				if (wasPruned)		// pruned links are the only ones with a weight of exactly 0
+				{
+					twoDFloatArray inputKeep(net.inputNodes(), net.hiddenNodes());
+					twoDFloatArray hiddenKeep(net.hiddenNodes(), net.outputNodes());
+
+					for (h = 0; h < keep; h++)
+					{
+						for (i = 0; i < net.inputNodes(); i++)
+							inputKeep.set(i, h, (newWeights.hiddenWeights()[h * net.inputNodes() + i] != 0.0) ? 1.0 : 0.0);
+						if (net.hasInputLayerBiasNode())
+							inputKeep.set(net.standardInputNodes(), h, 1.0);
+						for (o = 0; o < net.outputNodes(); o++)
+							hiddenKeep.set(h, o, (newWeights.outputWeights()[o * keep + h] != 0.0) ? 1.0 : 0.0);
+					}
+					theInputLayer->pruneLinks(&inputKeep);
+					theHiddenLayer->pruneLinks(&hiddenKeep);
+				}
+
+				return SUCCESS;
+			}
+
             char *	defaultName(char * buffer)
             /*
              * Return the default name for the network, which is: <network Name>_<majorVersion>_<minorVersion>_<revision>.enn
@@ -670,6 +932,241 @@ class nn
 
 			bool		needsSaving() { return hasChanged; }	// Return true if the network has changed since it was last saved.
 
+			status_t	setWeights(nnWeights * newWeights)
+			/*
+			 * Copy the weights and biases in newWeights into the network. The topology must match, use alter() first if
+			 * it does not. The name and version are left alone.
+			 */
+			{
+				twoDFloatArray inputLinks(net.inputNodes(), net.hiddenNodes());
+				twoDFloatArray hiddenLinks(net.hiddenNodes(), net.outputNodes());
+				vector<float> hiddenBiases(net.hiddenNodes());
+				vector<float> outputBiases(net.outputNodes());
+
+				if ((newWeights->inputNodes() != net.inputNodes()) || (newWeights->hiddenNodes() != net.hiddenNodes())
+						|| (newWeights->outputNodes() != net.outputNodes()))
+					return FAILURE;
+
+				newWeights->linkWeights(0, &inputLinks);
+				newWeights->linkWeights(1, &hiddenLinks);
+				newWeights->nodeBiases(1, &hiddenBiases);
+				newWeights->nodeBiases(2, &outputBiases);
+
+				theInputLayer->setLinkWeights(&inputLinks);
+				theHiddenLayer->setLinkWeights(&hiddenLinks);
+				theHiddenLayer->setNodeBiases(&hiddenBiases);
+				theOutputLayer->setNodeBiases(&outputBiases);
+
+				hasChanged = true;
+				return SUCCESS;
+			}
+
+			unsigned int pruneBelow(float threshold)
+			/*
+			 * Prune every link whose weight is less than threshold in magnitude. A pruned link has a weight of 0 that
+			 * training leaves alone, so training after pruning fine tunes the links that are left, and the network is
+			 * saved sparse (see networkFile). The links from the input bias node are biases and are never pruned.
+			 *
+			 * Returns the number of links now pruned. The minor version is incremented.
+			 */
+			{
+				twoDFloatArray inputLinks(net.inputNodes(), net.hiddenNodes());
+				twoDFloatArray hiddenLinks(net.hiddenNodes(), net.outputNodes());
+				unsigned int i, h, o;
+
+				theInputLayer->linkWeights(&inputLinks);
+				theHiddenLayer->linkWeights(&hiddenLinks);
+
+				for (h = 0; h < net.hiddenNodes(); h++)
+				{
+					for (i = 0; i < net.standardInputNodes(); i++)
+						inputLinks.set(i, h, (fabsf(inputLinks.value(i, h)) < threshold) ? 0.0 : 1.0);
+					if (net.hasInputLayerBiasNode())
+						inputLinks.set(i, h, 1.0);
+				}
+				for (o = 0; o < net.outputNodes(); o++)
+					for (h = 0; h < net.hiddenNodes(); h++)
+						hiddenLinks.set(h, o, (fabsf(hiddenLinks.value(h, o)) < threshold) ? 0.0 : 1.0);
+
+				return pruneLinks(&inputLinks, &hiddenLinks);
+			}
+
+			unsigned int pruneToTop(unsigned int keep)
+			/*
+			 * As pruneBelow() but keep the keep largest links (in magnitude) into each hidden and output node and prune
+			 * the rest. Links of equal weight are kept in index order.
+			 */
+			{
+				twoDFloatArray inputLinks(net.inputNodes(), net.hiddenNodes());
+				twoDFloatArray hiddenLinks(net.hiddenNodes(), net.outputNodes());
+				vector<unsigned int> order;
+				unsigned int i, h, o;
+
+				theInputLayer->linkWeights(&inputLinks);
+				theHiddenLayer->linkWeights(&hiddenLinks);
+
+				for (h = 0; h < net.hiddenNodes(); h++)
+				{
+					order.resize(net.standardInputNodes());
+					for (i = 0; i < order.size(); i++)
+						order[i] = i;
+					stable_sort(order.begin(), order.end(),
+							[&inputLinks, h](unsigned int a, unsigned int b) { return fabsf(inputLinks.value(a, h)) > fabsf(inputLinks.value(b, h)); });
+					for (i = 0; i < order.size(); i++)
+						inputLinks.set(order[i], h, (i < keep) ? 1.0 : 0.0);
+					if (net.hasInputLayerBiasNode())
+						inputLinks.set(net.standardInputNodes(), h, 1.0);
+				}
+				for (o = 0; o < net.outputNodes(); o++)
+				{
+					order.resize(net.hiddenNodes());
+					for (h = 0; h < order.size(); h++)
+						order[h] = h;
+					stable_sort(order.begin(), order.end(),
+							[&hiddenLinks, o](unsigned int a, unsigned int b) { return fabsf(hiddenLinks.value(a, o)) > fabsf(hiddenLinks.value(b, o)); });
+					for (h = 0; h < order.size(); h++)
+						hiddenLinks.set(order[h], o, (h < keep) ? 1.0 : 0.0);
+				}
+
+				return pruneLinks(&inputLinks, &hiddenLinks);
+			}
+
+			unsigned int prunedLinks() { return theInputLayer->prunedLinks() + theHiddenLayer->prunedLinks(); }
+
+			unsigned int links() { return (net.inputNodes() * net.hiddenNodes()) + (net.hiddenNodes() * net.outputNodes()); }
+
+			void		setThreads(unsigned int threads)
+			/*
+			 * Share the rows of run(inputFile *) and test(trainingFile *) between threads worker threads.
+			 * 0 means one per hardware thread and 1 (the default) runs every row on the calling thread.
+			 *
+			 * Each worker runs its rows through a snapshot of the weights taken at the start of the call with
+			 * its own scratch space, so the results are exactly the same as running the rows one at a time.
+			 */
+			{
+				if (threads == 0)
+					threads = threadPool::hardwareThreads();
+
+				if ((pool != NULL) && (pool->workers() != threads))
+				{
+					delete pool;
+					pool = NULL;
+				}
+				workerCount = threads;
+			}
+
+			unsigned int threadCount() { return workerCount; }
+
+			void		setLearningRate(float newRate)
+			/*
+			 * Set the learning rate of the network and make it the one used for training. The learning rate and
+			 * momentum are shared by every network trained on the calling thread (see nnNode::setLearningParameters)
+			 */
+			{
+				net.setTrainingLearningRate(newRate);
+				nnNode::setLearningParameters(net.trainingLearningRate(), net.trainingMomentum());
+				hasChanged = true;
+			}
+
+			float		learningRate() { return net.trainingLearningRate(); }
+
+			void		setMomentum(float newMomentum)	// as setLearningRate() but for the momentum
+			{
+				net.setTrainingMomentum(newMomentum);
+				nnNode::setLearningParameters(net.trainingLearningRate(), net.trainingMomentum());
+				hasChanged = true;
+			}
+
+			float		momentum() { return net.trainingMomentum(); }
+
+			rpropState * rpropTrainingState() { return &rprop; }	// for rpropTrainer, to carry on between runs
+
+			nnWeights *	snapshot()
+			/*
+			 * Return a new nnWeights object holding a copy of the current weights, biases, name and version.
+			 *
+			 * The snapshot shares nothing with the network so it can be run on other threads while this network
+			 * carries on training. The caller must delete it.
+			 *
+			 */
+			{
+				nnWeights * theWeights;
+				twoDFloatArray inputLinks(net.inputNodes(), net.hiddenNodes());
+				twoDFloatArray hiddenLinks(net.hiddenNodes(), net.outputNodes());
+				vector<float> hiddenBiases(net.hiddenNodes());
+				vector<float> outputBiases(net.outputNodes());
+
+				theInputLayer->linkWeights(&inputLinks);
+				theHiddenLayer->linkWeights(&hiddenLinks);
+				theHiddenLayer->nodeBiases(&hiddenBiases);
+				theOutputLayer->nodeBiases(&outputBiases);
+
+				theWeights = new nnWeights(net);
+				theWeights->setLinkWeights(0, &inputLinks);
+				theWeights->setLinkWeights(1, &hiddenLinks);
+				theWeights->setNodeBiases(1, &hiddenBiases);
+				theWeights->setNodeBiases(2, &outputBiases);
+				theWeights->setIdentity(networkName, majorVersion, minorVersion, revision);
+
+				return theWeights;
+			}
+
+			void		setLatency(bool isOn)
+			/*
+			 * Switch the latency histograms (see latencyHistogram.hpp) on or off. While they are on the time of every row is
+			 * recorded for
+			 *	LATENCY_RUN		run(vector<float> *...), one row of run(inputFile *...), not including the callback
+			 *	LATENCY_TEST	one row of test(), including the metrics but not the callback
+			 *	LATENCY_TRAIN	one training step, train(vector<float> *, vector<float> *...)
+			 *
+			 * With setThreads() > 1 each worker records the rows it runs in a histogram of its own.
+			 */
+			{
+				unsigned int site;
+
+				for (site = 0; site < LATENCY_SITES; site++)
+					if (isOn && (latency[site] == NULL))
+						latency[site] = new latencyRecorder(1);		// deleted in ~nn or setLatency(false)
+					else if (!isOn && (latency[site] != NULL))
+					{
+						delete latency[site];
+						latency[site] = NULL;
+					}
+			}
+
+			latencyHistogram latencyOf(latency_site site)		// all the threads' histograms for site added together
+			{
+				return (latency[site] != NULL) ? latency[site]->merged() : latencyHistogram();
+			}
+
+			void		resetLatency()
+			{
+				unsigned int site;
+
+				for (site = 0; site < LATENCY_SITES; site++)
+					if (latency[site] != NULL)
+						latency[site]->reset();
+			}
+
+			void		latencyReport(ostream & outStr)
+			/*
+			 * Write the percentile table for every site that has recorded anything, labelled with the network name and version
+			 * so that reports from different revisions can be told apart
+			 */
+			{
+				static const char * siteNames[LATENCY_SITES] = { "run", "test", "train" };
+				char cstrLabel[80];
+				unsigned int site;
+
+				latencyHistogram::writeTitle(outStr);
+				for (site = 0; site < LATENCY_SITES; site++)
+					if (latencyOf((latency_site)site).count() > 0)
+					{
+						snprintf(cstrLabel, sizeof(cstrLabel), "%s %s %u.%u.%u", siteNames[site], networkName.c_str(), majorVersion, minorVersion, revision);
+						latencyOf((latency_site)site).writeOn(outStr, cstrLabel);
+					}
+			}
+
 
 
     // Setup
@@ -678,20 +1175,33 @@ class nn
             void		incrementMinorVersion() { minorVersion++; revision = 0; }
             void		incrementMajorVersion() { majorVersion++; minorVersion = revision = 0; }
 
+            unsigned int pruneLinks(twoDFloatArray * inputKeep, twoDFloatArray * hiddenKeep)
+            {
+                theInputLayer->pruneLinks(inputKeep);
+                theHiddenLayer->pruneLinks(hiddenKeep);
+                incrementMinorVersion();
+                hasChanged = true;
+                return prunedLinks();
+            }
+
             void		setup(network_description newNet)
             {
                 unsigned int layerNo = 0;
                 net = newNet;
                 networkName = net.networkName();
 
-                theInputLayer = new inputLayer(net, layerNo++);		// deleted in ~nn
-                theHiddenLayer = new hiddenLayer(net, layerNo++);	// deleted in ~nn
-                theOutputLayer = new outputLayer(net, layerNo++);	// deleted in ~nn
+                {
+                	STATS_PHASE(PHASE_BUILD);
+
+					theInputLayer = new inputLayer(net, layerNo++);		// deleted in ~nn
+					theHiddenLayer = new hiddenLayer(net, layerNo++);	// deleted in ~nn
+					theOutputLayer = new outputLayer(net, layerNo++);	// deleted in ~nn
 
-                theInputLayer->connectNodes(theHiddenLayer->nodeList());
-                theHiddenLayer->connectNodes(theOutputLayer->nodeList());
+					theInputLayer->connectNodes(theHiddenLayer->nodeList());
+					theHiddenLayer->connectNodes(theOutputLayer->nodeList());
 
-                errorVector = new vector<float>(newNet.outputNodes());	// deleted in the destructor
+					errorVector = new vector<float>(newNet.outputNodes());	// deleted in the destructor
+                }
 
                 randomise();
             }
@@ -706,6 +1216,11 @@ class nn
                 theHiddenLayer->setLinkWeights(nFile->linkWeights(1));
                 theHiddenLayer->setNodeBiases(nFile->nodeBiases(1));
                 theOutputLayer->setNodeBiases(nFile->nodeBiases(2));
+                if (nFile->isSparse())
+                {
+                    theInputLayer->pruneLinks(nFile->linkMask(0));
+                    theHiddenLayer->pruneLinks(nFile->linkMask(1));
+                }
 
 
                 majorVersion = nFile->majorVersion();
@@ -713,11 +1228,111 @@ class nn
                 revision = nFile->revision();
 
                 nFile->networkName(&networkName);
+                net.setNetworkName(networkName);		// the file keeps the name apart from the description
 
                 nnNode::setLearningParameters(net.trainingLearningRate(), net.trainingMomentum());
 
             }
+            void		forward(vector<float> * inputVector)	// run one input vector through the node and link objects
+            {
+                theOutputLayer->waitForActivation();									// set up the semaphores
+                theInputLayer->setInputVector(inputVector);								// set the input nodes with the input vector
+                theInputLayer->run();													// run the network
+                theOutputLayer->blockTillValue();										// wait till all the semaphores are cleared
+            }
+
+            void		runParallel(dataFile * dFile, latency_site site, function<void(unsigned int, const float *)> dispatch)
+            /*
+             * Run every row of dFile on the worker pool a wave at a time. While the workers run one wave the
+             * calling thread hands the results of the previous wave, in row order, to dispatch(row, outputValues).
+             * If setLatency() is on each worker records the time of each row in its own slot of latency[site].
+             */
+            {
+            	nnWeights * theWeights;
+            	unsigned int rows = dFile->inputLines();
+            	unsigned int outputs = net.outputNodes();
+            	unsigned int w;
+            	size_t waveRows;
+            	size_t first, count, r;
+            	int buffer = 0;
+            	vector<float> results[2];
+            	vector<vector<float> > hiddenScratch;
+
+            	if (pool == NULL)
+            		pool = new threadPool(workerCount);		// deleted in ~nn or setThreads()
+            	if (latency[site] != NULL)
+            		latency[site]->slots(pool->workers() + 1);	// slot 0 is the calling thread
+
+            	theWeights = snapshot();
+            	waveRows = parallelChunkRows * pool->workers() * 4;
+            	results[0].resize(waveRows * outputs);
+            	results[1].resize(waveRows * outputs);
+            	hiddenScratch.resize(pool->workers());
+            	for (w = 0; w < pool->workers(); w++)
+            		hiddenScratch[w].resize(net.hiddenNodes());
+
+            	auto startWave = [&](int waveBuffer, size_t waveFirst)
+            	{
+            		size_t waveCount = min(waveRows, (size_t)rows - waveFirst);
+
+            		pool->start((waveCount + parallelChunkRows - 1) / parallelChunkRows, [&, waveBuffer, waveFirst, waveCount](unsigned int worker, size_t task)
+            		{
+            			size_t row;
+            			size_t lastRow = min(waveCount, (task + 1) * parallelChunkRows);
+            			float * out = results[waveBuffer].data();
+
+            			TRACE_SCOPE("run chunk");
+
+            			latencyHistogram * rowLatency = (latency[site] != NULL) ? &latency[site]->slot(worker + 1) : NULL;
+            			unsigned long long started;
+
+            			for (row = task * parallelChunkRows; row < lastRow; row++)
+            			{
+            				started = (rowLatency != NULL) ? latencyRecorder::now() : 0;
+            				theWeights->run(dFile->inputSet(waveFirst + row)->data(), hiddenScratch[worker].data(), out + row * outputs);
+            				if (rowLatency != NULL)
+            					rowLatency->record(latencyRecorder::now() - started);
+            			}
+            		});
+            	};
+
+            	if (rows > 0)
+            		startWave(buffer, 0);
+
+            	for (first = 0; first < rows; first += count)
+            	{
+            		pool->wait();
+            		count = min(waveRows, (size_t)rows - first);
+
+            		if (first + count < rows)
+            			startWave(1 - buffer, first + count);
+
+            		{
+            			TRACE_SCOPE("dispatch wave");
+
+            			for (r = 0; r < count; r++)
+            				dispatch(first + r, results[buffer].data() + r * outputs);
+            		}
+
+            		buffer = 1 - buffer;
+            	}
+
+            	pool->wait();
+            	delete theWeights;
+            }
+
     // Other
+            ifstream *	openFile(const char * fileName)		// return a new ifstream for fileName, or NULL if there is no such file
+            {
+            	STATS_PHASE(PHASE_OPEN);
+
+            	if (!checkExists(fileName))
+            		return NULL;
+            	return new ifstream(fileName);
+            }
+
+            unsigned long long linksPerRow() { return (unsigned long long)net.inputNodes() * net.hiddenNodes() + net.hiddenNodes() * net.outputNodes(); }
+
             bool checkExists(const char * fileName, bool boolShouldBeFile = true)
             {
             	struct stat fileAtt;
@@ -744,6 +1359,18 @@ class nn
 
 	// testing
 	vector<float>	*	errorVector;				// pass a pointer to this vector in the test callback
+	vector<float>		testOutput;					// and this one, reused so that testing a row allocates nothing
+
+	// threading
+	unsigned int		workerCount = 1;			// see setThreads()
+	threadPool		*	pool = NULL;				// created the first time it is needed
+	const float		*	dispatchedResult = NULL;	// the row runResult() returns while a threaded run is calling back
+
+	// latency
+	latencyRecorder	*	latency[LATENCY_SITES] = { NULL, NULL, NULL };	// see setLatency()
+
+	// training
+	rpropState			rprop;						// see rpropTrainingState()
 
 	// identificaton
 	unsigned int		majorVersion;
@@ -9,6 +9,8 @@
 #include <vector>
 #include "twoDFloatArray.hpp"
 #include "errStruct.hpp"
+#include "runStats.hpp"
+#include "traceLog.hpp"
 
 /*
  * The eNN file wrapper hierarchy:
@@ -76,10 +78,17 @@ class NNFile
                                         string		 fragment;
                                         status_t	 decodeResult = SUCCESS;
 
+                                        STATS_PHASE(PHASE_PARSE);
+                                        TRACE_SCOPE("parse");
+                                        TRACE_CHUNKS(parseChunks, "parse chunk", 4096);
+
                                         while (!(pFile->eof()))
                                         {
                                         	getline((*pFile), fragment);
                                         	strLength = fragment.length();
+                                        	STATS_COUNT(COUNT_LINES_PARSED, 1);
+                                        	STATS_COUNT(COUNT_BYTES_PARSED, strLength + 1);
+                                        	TRACE_TICK(parseChunks);
 
 #ifdef _DEBUG_
                                         	cout << "\n" << fragment << "\n";
@@ -137,10 +146,10 @@ class NNFile
 
                                         // pull off the word preceeding the (
                                         bracketPos = line->find('(', 0);
-                                        if (bracketPos >= 0)
+                                        if (bracketPos != std::string::npos)
                                         {
-                                        	verb = line->substr(0, bracketPos);
-											arg = line->substr(bracketPos);
+                                        	verb.assign(*line, 0, bracketPos);		// assign rather than substr so that verb and arg keep their buffers
+											arg.assign(*line, bracketPos, std::string::npos);
                                             return 1;
                                         }
                                         return 0;
@@ -193,6 +202,8 @@ class NNFile
 			network_description		net;
             ifstream	*			pFile;		// temporary storage deleted by the doc
             string					errMessage;
+            string					lineVerb;			// filled by verbArguement() in decodeLine(), kept between lines
+            string					lineArguements;		// so that decoding a line does not allocate
 };
 
 #endif
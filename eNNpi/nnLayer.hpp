@@ -117,8 +117,28 @@ class inputLayer : public inLayer
 			
 	// save & retrieve
 	public:
-            void							linkWeights(twoDFloatArray * weightArray) {}
-            void							nodeBiases(vector<float> * nodeArray) {}
+            void							linkWeights(twoDFloatArray * weightArray)	// weightArray must be dimensioned [input nodes][hidden nodes]
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    (*nodeI)->linkWeights(weightArray->values((*nodeI)->nodeIndex()));
+                                            }
+
+            void							pruneLinks(twoDFloatArray * keepArray)	// dimensioned as for linkWeights(), 0 prunes a link
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    (*nodeI)->pruneLinks(keepArray->values((*nodeI)->nodeIndex()));
+                                            }
+
+            unsigned int					prunedLinks()
+                                            {
+                                                unsigned int count = 0;
+
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    count += (*nodeI)->prunedLinks();
+                                                return count;
+                                            }
+
+            void							nodeBiases(vector<float> * nodeArray) { /* input layers have no biases */ }
 	
 	// run (and train)
 	public:
@@ -278,8 +298,32 @@ class hiddenLayer : public inLayer
                                                 }
                                             }
 
-			void							linkWeights(twoDFloatArray * weightArray);
-			void							nodeBiases(vector<float> * nodeArray);	
+            void							linkWeights(twoDFloatArray * weightArray)	// weightArray must be dimensioned [hidden nodes][output nodes]
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    (*nodeI)->linkWeights(weightArray->values((*nodeI)->nodeIndex()));
+                                            }
+
+            void							pruneLinks(twoDFloatArray * keepArray)	// dimensioned as for linkWeights(), 0 prunes a link
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    (*nodeI)->pruneLinks(keepArray->values((*nodeI)->nodeIndex()));
+                                            }
+
+            unsigned int					prunedLinks()
+                                            {
+                                                unsigned int count = 0;
+
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    count += (*nodeI)->prunedLinks();
+                                                return count;
+                                            }
+
+            void							nodeBiases(vector<float> * nodeArray)
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    nodeArray->operator[]((*nodeI)->nodeIndex()) = (*nodeI)->getBias();
+                                            }
 	
 	// training
 	public:
@@ -386,8 +430,12 @@ class outputLayer : public nnLayer
 
                                             }
 
-			void							linkWeights(twoDFloatArray * weightArray);
-			void							nodeBiases(vector<float> * nodeArray);	
+            void							nodeBiases(vector<float> * nodeArray)
+                                            {
+                                                for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
+                                                    nodeArray->operator[]((*nodeI)->nodeIndex()) = (*nodeI)->getBias();
+                                            }
+
             void							trainingError(vector<float> * errorVector)
                                             {
                                                 for (nodeI = nodes->begin(); nodeI != nodes->end(); nodeI++)
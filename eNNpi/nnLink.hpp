@@ -15,6 +15,7 @@ class nnLink
                             theOutputNode = outNode;
                             index = newIndex;
                             lastWeightChange = 0.0;
+                            pruned = false;
                         }
 
                         nnLink() { }
@@ -85,6 +86,7 @@ class nnLink
                             newRand = randSeed();
                             weight = (weightMax - ((float)newRand / ((float)randSeed.max() / (2 * weightMax))));
                             outputErrorCalculated = false;
+                            pruned = false;
 
                             return newRand;
                         }
@@ -96,6 +98,8 @@ class nnLink
                             float currentWeightChange;
 
                             outputError = theOutputNode->adjustBiasReturningOutputError();
+                            if (pruned)			// masked out, the weight stays at 0 but the error still flows back
+                                return outputError;
 
                             currentWeightChange = nodeValueTimesLearningRate * outputError;
                             weight += currentWeightChange + (lastWeightChange * momentum);
@@ -121,6 +125,8 @@ class nnLink
 	
     void				storeOn(stringstream * strOut, unsigned int layerNo, unsigned int nodeNo)
                         {
+                            if (pruned)		// a sparse network file leaves pruned links out
+                                return;
 
  //                           (*strOut) << weight;
  //                           (*strOut) << layerNo;
@@ -137,12 +143,22 @@ class nnLink
                             (*strOut) << ")\n";
                         }
 
-    void				setWeight(float newWeight)
+    void				setWeight(float newWeight)	// a pruned link stays at 0
                         {
-                            weight = newWeight;
+                            if (!pruned)
+                                weight = newWeight;
                         }
 
 	float				linkWeight() { return weight; }; 
+
+    void				prune()		// set the weight to 0 and keep it there through training, until the link is randomised
+                        {
+                            weight = 0.0;
+                            lastWeightChange = 0.0;
+                            pruned = true;
+                        }
+
+	bool				isPruned() { return pruned; }
 	
 	private:
 	float				weight;
@@ -151,6 +167,7 @@ class nnLink
 	unsigned int		index;
 
 	float				lastWeightChange;	// multiply it by the momentum as add it to the current weight change
+	bool				pruned;				// see prune()
 	
 	float				scaledOutputError;
 	bool				outputErrorCalculated;
@@ -40,9 +40,9 @@ class nnNode
 
 			unsigned int	nodeIndex() { return index; }
 
-	// static training parameters
+	// static training parameters, one set per thread so that networks trained on different threads can each have their own
 	public:
-    static	void			setLearningParameters(float newLRP, float newMomentum)
+    static	void			setLearningParameters(float newLRP, float newMomentum)	// for the networks trained on the calling thread
                             {
                                 learningRate = newLRP;
                                 momentum = newMomentum;
@@ -50,8 +50,8 @@ class nnNode
 
 
 	protected:
-	static	float			learningRate;	
-	static  float			momentum;
+	static	thread_local float	learningRate;
+	static  thread_local float	momentum;
 
 	// basic node member vars
 	protected:
@@ -66,7 +66,7 @@ private:
 	
 };
 
-float nnNode::learningRate = (float)0.01;
-float nnNode::momentum = (float)0.0;
+thread_local float nnNode::learningRate = (float)0.01;
+thread_local float nnNode::momentum = (float)0.0;
 
 #endif
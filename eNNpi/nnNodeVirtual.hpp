@@ -22,6 +22,7 @@ class outNode : public virtual nnNode
                                             // node variables
                                             index = newIndex;
                                             linkCount = 0;
+                                            inLinks = NULL;						// until the concrete node sets them, so that a throw before then deletes nothing
                                             bias = 0.0;
                                             lastBiasChange = 0.0;
 
@@ -84,6 +85,7 @@ class outNode : public virtual nnNode
 
 
 			void						setBias(float newBias) { bias = newBias; }	// restore the bias from storage
+			float						getBias() { return bias; }					// read the bias back for storage or a weight snapshot
 			
 			const size_t				inLinkCount() { return inLinks->size(); }	// return the number of links coming into the node
     virtual	float						adjustBiasReturningOutputError(float learningRate) { return 0.0; };
@@ -155,6 +157,7 @@ class inNode : public virtual nnNode
                                         {
                                             index = newIndex;
                                             outLinkCount = 0;
+                                            outLinks = NULL;					// as for inLinks in outNode
                                         }
 
     virtual								~inNode()	// destroy all the links
@@ -225,6 +228,35 @@ class inNode : public virtual nnNode
                                             }
                                         }
 
+            void						linkWeights(vector<float> * weightArray)		// the reverse of setLinkWeights
+                                        {
+                                            for (outLinkI = outLinks->begin(); outLinkI != outLinks->end(); outLinkI++)
+                                            {
+                                                weightArray->operator[]((*outLinkI)->linkIndex()) = (*outLinkI)->getWeight();
+                                            }
+                                        }
+
+            void						pruneLinks(vector<float> * keepArray)	// prune the links whose entry in keepArray is 0
+                                        {
+                                            for (outLinkI = outLinks->begin(); outLinkI != outLinks->end(); outLinkI++)
+                                            {
+                                                if (keepArray->operator[]((*outLinkI)->linkIndex()) == 0.0)
+                                                    (*outLinkI)->prune();
+                                            }
+                                        }
+
+            unsigned int				prunedLinks()
+                                        {
+                                            unsigned int count = 0;
+
+                                            for (outLinkI = outLinks->begin(); outLinkI != outLinks->end(); outLinkI++)
+                                            {
+                                                if ((*outLinkI)->isPruned())
+                                                    count++;
+                                            }
+                                            return count;
+                                        }
+
             bool						activationFromLink(float activationLevel)	// input links have their value set explicitly before the net is run (should be an error)
                                         {
                                             //throw an error
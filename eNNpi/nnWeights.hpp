@@ -0,0 +1,302 @@
+#ifndef _nnWeights_h
+#define _nnWeights_h
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include "networkDescription.hpp"
+#include "networkFile.hpp"
+#include "twoDFloatArray.hpp"
+#include "errStruct.hpp"
+
+/*
+ * nnWeights is a flat, self contained copy of every weight and bias in a network.
+ *
+ * The node and link objects inside nn hold the activation state of the current run so only one
+ * input vector can be in flight at a time. An nnWeights object holds no run state at all: run()
+ * takes the caller's scratch space, so any number of threads can run the same nnWeights object at
+ * once as long as nobody changes it. Treat a published nnWeights object as read only.
+ *
+ * The weights are stored row major so that each node's dot product walks contiguous memory:
+ *
+ *	hiddenWeights()	[hidden node][input node]		(the input bias node, if any, is the last input)
+ *	outputWeights()	[output node][hidden node]
+ *
+ * run() adds the link values up in the same order as the node and link objects do, so the results
+ * are bit for bit the same as nn::run().
+ *
+ * Create one from a networkFile that has been read in, or call nn::snapshot().
+ */
+
+class nnWeights
+{
+	public:
+						nnWeights(network_description & newNet)
+						/*
+						 * Create a zeroed set of weights for the topology in newNet
+						 */
+						{
+							dimension(newNet);
+							majorVersion = minorVersion = revision = 0;
+						}
+
+						nnWeights(networkFile * nFile)
+						/*
+						 * Copy the weights out of a network file that has been read in completely
+						 */
+						{
+							network_description newNet;
+
+							if (!nFile->isComplete())
+								throw format_Error(ENN_ERR_INCOMPLETE_NETWORK_FILE);
+
+							nFile->networkDescription(&newNet);
+							dimension(newNet);
+
+							setLinkWeights(0, nFile->linkWeights(0));
+							setLinkWeights(1, nFile->linkWeights(1));
+							setNodeBiases(1, nFile->nodeBiases(1));
+							setNodeBiases(2, nFile->nodeBiases(2));
+
+							nFile->networkName(&name);
+							majorVersion = nFile->majorVersion();
+							minorVersion = nFile->minorVersion();
+							revision = nFile->revision();
+						}
+
+						~nnWeights() { }
+
+	// setup
+			void		setLinkWeights(unsigned int layer, twoDFloatArray * weightArray)
+			/*
+			 * Copy in the link weights in the layout used by networkFile::linkWeights(), i.e. [from node][to node]
+			 */
+						{
+							unsigned int i, j;
+
+							switch (layer)
+							{
+								case 0:
+									for (i = 0; i < inNodes; i++)
+										for (j = 0; j < hidNodes; j++)
+											hidWeights[j * inNodes + i] = weightArray->value(i, j);
+									break;
+								case 1:
+									for (i = 0; i < hidNodes; i++)
+										for (j = 0; j < outNodes; j++)
+											outWeights[j * hidNodes + i] = weightArray->value(i, j);
+									break;
+								case 2:
+									throw format_Error(ENN_ERR_LINK_ON_OUTPUT);
+								default:
+									throw format_Error(ENN_ERR_TOO_MANY_LAYERS);
+							}
+						}
+
+			void		setNodeBiases(unsigned int layer, vector<float> * biasArray)
+						{
+							switch (layer)
+							{
+								case 0:
+									throw format_Error(ENN_ERR_INPUT_NODE_BIAS_REQUESTED);
+								case 1:
+									hidBiases.assign(biasArray->begin(), biasArray->end());
+									break;
+								case 2:
+									outBiases.assign(biasArray->begin(), biasArray->end());
+									break;
+								default:
+									throw format_Error(ENN_ERR_TOO_MANY_LAYERS);
+							}
+						}
+
+			void		linkWeights(unsigned int layer, twoDFloatArray * weightArray)
+			/*
+			 * The reverse of setLinkWeights(), weightArray must already be dimensioned [from node][to node]
+			 */
+						{
+							unsigned int i, j;
+
+							switch (layer)
+							{
+								case 0:
+									for (i = 0; i < inNodes; i++)
+										for (j = 0; j < hidNodes; j++)
+											weightArray->set(i, j, hidWeights[j * inNodes + i]);
+									break;
+								case 1:
+									for (i = 0; i < hidNodes; i++)
+										for (j = 0; j < outNodes; j++)
+											weightArray->set(i, j, outWeights[j * hidNodes + i]);
+									break;
+								case 2:
+									throw format_Error(ENN_ERR_LINK_ON_OUTPUT);
+								default:
+									throw format_Error(ENN_ERR_TOO_MANY_LAYERS);
+							}
+						}
+
+			void		nodeBiases(unsigned int layer, vector<float> * biasArray)
+						{
+							switch (layer)
+							{
+								case 0:
+									throw format_Error(ENN_ERR_INPUT_NODE_BIAS_REQUESTED);
+								case 1:
+									biasArray->assign(hidBiases.begin(), hidBiases.end());
+									break;
+								case 2:
+									biasArray->assign(outBiases.begin(), outBiases.end());
+									break;
+								default:
+									throw format_Error(ENN_ERR_TOO_MANY_LAYERS);
+							}
+						}
+
+			void		setIdentity(const string & newName, unsigned int major, unsigned int minor, unsigned int revis)
+						{
+							name = newName;
+							majorVersion = major;
+							minorVersion = minor;
+							revision = revis;
+						}
+
+	// run
+			void		run(const float * inputVector, float * hiddenScratch, float * outputVector) const
+			/*
+			 * Run one row. inputVector holds standardInputNodes() values, hiddenScratch has room for
+			 * hiddenNodes() values and outputVector has room for outputNodes() values.
+			 */
+						{
+							runHidden(inputVector, hiddenScratch);
+							runOutput(hiddenScratch, outputVector);
+						}
+
+			void		runHidden(const float * inputVector, float * hiddenVector) const
+			/*
+			 * Run just the input to hidden layer, leaving the hidden node values in hiddenVector
+			 */
+						{
+							unsigned int h, i;
+							const float * w;
+							float activationQuantity;
+
+							for (h = 0; h < hidNodes; h++)
+							{
+								w = &hidWeights[h * inNodes];
+								activationQuantity = 0.0;
+								for (i = 0; i < stdInNodes; i++)
+									activationQuantity += w[i] * inputVector[i];
+								if (hasBias)
+									activationQuantity += w[stdInNodes] * (float)1.0;
+
+								hiddenVector[h] = f(hidBiases[h] + activationQuantity);
+							}
+						}
+
+			void		runOutput(const float * hiddenVector, float * outputVector) const
+			/*
+			 * Run just the hidden to output layer from a set of hidden node values
+			 */
+						{
+							unsigned int o, h;
+							const float * w;
+							float activationQuantity;
+
+							for (o = 0; o < outNodes; o++)
+							{
+								w = &outWeights[o * hidNodes];
+								activationQuantity = 0.0;
+								for (h = 0; h < hidNodes; h++)
+									activationQuantity += w[h] * hiddenVector[h];
+
+								outputVector[o] = f(outBiases[o] + activationQuantity);
+							}
+						}
+
+	static	float		f(float biasPlusActivationQuant)	// the same activation function as outNode::f()
+						{
+							if (biasPlusActivationQuant < -50.0)	//>
+								return 0.0;
+							else
+								if (biasPlusActivationQuant > 50.0)
+									return 1.0;
+								else
+									return (float)(1 / (1 + exp((double)(-1 * biasPlusActivationQuant))));
+						}
+
+	// access
+			network_description * networkDescription() { return &net; }
+			unsigned int	standardInputNodes() const { return stdInNodes; }
+			unsigned int	inputNodes() const { return inNodes; }		// including any input bias node
+			unsigned int	hiddenNodes() const { return hidNodes; }
+			unsigned int	outputNodes() const { return outNodes; }
+			bool			hasInputBiasNode() const { return hasBias; }
+
+			float		*	hiddenWeights() { return hidWeights.data(); }
+			float		*	hiddenBiases() { return hidBiases.data(); }
+			float		*	outputWeights() { return outWeights.data(); }
+			float		*	outputBiases() { return outBiases.data(); }
+			const float	*	hiddenWeights() const { return hidWeights.data(); }
+			const float	*	hiddenBiases() const { return hidBiases.data(); }
+			const float	*	outputWeights() const { return outWeights.data(); }
+			const float	*	outputBiases() const { return outBiases.data(); }
+
+			const string &	networkName() const { return name; }
+			unsigned int	major() const { return majorVersion; }
+			unsigned int	minor() const { return minorVersion; }
+			unsigned int	revis() const { return revision; }
+
+			bool		isNewerThan(const nnWeights & other) const	// compare major, minor then revision
+						{
+							if (majorVersion != other.majorVersion)
+								return majorVersion > other.majorVersion;
+							if (minorVersion != other.minorVersion)
+								return minorVersion > other.minorVersion;
+							return revision > other.revision;
+						}
+
+			bool		sameTopology(const nnWeights & other) const
+						{
+							return (inNodes == other.inNodes) && (stdInNodes == other.stdInNodes)
+									&& (hidNodes == other.hidNodes) && (outNodes == other.outNodes);
+						}
+
+	private:
+			void		dimension(network_description & newNet)
+						{
+							net = newNet;
+							stdInNodes = net.standardInputNodes();
+							inNodes = net.inputNodes();
+							hidNodes = net.hiddenNodes();
+							outNodes = net.outputNodes();
+							hasBias = net.hasInputLayerBiasNode();
+
+							hidWeights.assign(hidNodes * inNodes, 0.0);
+							hidBiases.assign(hidNodes, 0.0);
+							outWeights.assign(outNodes * hidNodes, 0.0);
+							outBiases.assign(outNodes, 0.0);
+							name = net.networkName();
+						}
+
+	private:
+	network_description	net;
+	unsigned int		stdInNodes;
+	unsigned int		inNodes;
+	unsigned int		hidNodes;
+	unsigned int		outNodes;
+	bool				hasBias;
+
+	vector<float>		hidWeights;		// [hidden node][input node]
+	vector<float>		hidBiases;
+	vector<float>		outWeights;		// [output node][hidden node]
+	vector<float>		outBiases;
+
+	// identification
+	string				name;
+	unsigned int		majorVersion;
+	unsigned int		minorVersion;
+	unsigned int		revision;
+};
+
+#endif	// _nnWeights_h
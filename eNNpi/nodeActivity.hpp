@@ -0,0 +1,141 @@
+#ifndef _nodeActivity_h
+#define _nodeActivity_h
+
+#include <math.h>
+#include <ostream>
+#include <vector>
+#include "nnWeights.hpp"
+
+/*
+ * nodeActivity measures how much each hidden node of a network does over a set of rows, to find the dead ones for
+ * nn::removeHiddenNodes().
+ *
+ * Every row is run through an nnWeights copy of the network and the mean and variance of each hidden node's value are
+ * kept (Welford's method, in double). A node whose value hardly changes, because it is stuck near 0 or 1 (f() is
+ * exactly 0 or 1 past +-50) or because its inputs cancel out, passes on no information. Replacing its value with its mean
+ * changes the activation sum of output node o by at most
+ *
+ *	|outputWeight[o][h]| * (value - mean)
+ *
+ * so a node's contribution is its largest output weight magnitude times the standard deviation of its value, and a node
+ * whose contribution is under a tolerance is dead. A node with output weights of (nearly) 0 is dead however much it
+ * varies.
+ *
+ * To use one
+ *	nodeActivity activity(*theNet->snapshot());
+ *	activity.analyse(trainingFile);		// or observe() each row
+ *	activity.deadNodes(tolerance, &dead);
+ *	theNet->removeHiddenNodes(dead, activity.means());
+ */
+
+const char ENN_ERR_ACTIVITY_TOPOLOGY[] = "The training file does not fit the network";
+
+class nodeActivity
+{
+	public:
+						nodeActivity(const nnWeights & source) : weights(source)
+						{
+							unsigned int h, o;
+							float magnitude;
+
+							meanValues.assign(weights.hiddenNodes(), 0.0);
+							sumSquares.assign(weights.hiddenNodes(), 0.0);
+							outputMagnitudes.assign(weights.hiddenNodes(), 0.0);
+							hiddenVector.resize(weights.hiddenNodes());
+							rowCount = 0;
+
+							for (h = 0; h < weights.hiddenNodes(); h++)
+								for (o = 0; o < weights.outputNodes(); o++)
+								{
+									magnitude = fabsf(weights.outputWeights()[o * weights.hiddenNodes() + h]);
+									if (magnitude > outputMagnitudes[h])
+										outputMagnitudes[h] = magnitude;
+								}
+						}
+
+	// analyse
+			void		observe(const float * inputVector)
+						{
+							unsigned int h;
+							double delta;
+
+							weights.runHidden(inputVector, hiddenVector.data());
+							rowCount++;
+							for (h = 0; h < weights.hiddenNodes(); h++)
+							{
+								delta = hiddenVector[h] - meanValues[h];
+								meanValues[h] += delta / rowCount;
+								sumSquares[h] += delta * (hiddenVector[h] - meanValues[h]);
+							}
+						}
+
+			template <class trainingRows> void analyse(trainingRows * rows)	// observe every row
+						{
+							unsigned int row;
+
+							if ((rows->inputLines() > 0) && (rows->inputSet(0)->size() != weights.standardInputNodes()))
+								throw format_Error(ENN_ERR_ACTIVITY_TOPOLOGY);
+							for (row = 0; row < rows->inputLines(); row++)
+								observe(rows->inputSet(row)->data());
+						}
+
+			unsigned int deadNodes(double tolerance, vector<bool> * dead) const
+			/*
+			 * Flag the nodes whose contribution is under tolerance and return how many there are. The node that
+			 * contributes most is always kept, so at least one is left.
+			 */
+						{
+							unsigned int h, best = 0, count = 0;
+
+							dead->assign(weights.hiddenNodes(), false);
+							for (h = 0; h < weights.hiddenNodes(); h++)
+							{
+								if (contribution(h) > contribution(best))
+									best = h;
+								if (contribution(h) < tolerance)
+								{
+									(*dead)[h] = true;
+									count++;
+								}
+							}
+							if ((count > 0) && (count == weights.hiddenNodes()))
+							{
+								(*dead)[best] = false;
+								count--;
+							}
+							return count;
+						}
+
+	// access
+			unsigned long rows() const { return rowCount; }
+			unsigned int hiddenNodes() const { return weights.hiddenNodes(); }
+			double		mean(unsigned int h) const { return meanValues[h]; }
+			double		variance(unsigned int h) const { return (rowCount > 0) ? sumSquares[h] / rowCount : 0.0; }
+			double		outputMagnitude(unsigned int h) const { return outputMagnitudes[h]; }	// the largest |weight| to an output node
+			double		contribution(unsigned int h) const { return outputMagnitudes[h] * sqrt(variance(h)); }
+			const vector<double> & means() const { return meanValues; }
+
+			void		writeOn(ostream & outStr, double tolerance) const	// a table of every hidden node
+						{
+							unsigned int h;
+
+							outStr << "Node\tMean\tStd dev\tMax |w out|\tContribution\n";
+							for (h = 0; h < weights.hiddenNodes(); h++)
+							{
+								outStr << h << "\t" << mean(h) << "\t" << sqrt(variance(h)) << "\t" << outputMagnitude(h) << "\t" << contribution(h);
+								if (contribution(h) < tolerance)
+									outStr << "\tdead" << (((mean(h) < 0.01) || (mean(h) > 0.99)) ? " (saturated)" : "");
+								outStr << "\n";
+							}
+						}
+
+	private:
+	nnWeights			weights;
+	unsigned long		rowCount;
+	vector<double>		meanValues;
+	vector<double>		sumSquares;			// of the differences from the mean, for the variance
+	vector<float>		outputMagnitudes;
+	vector<float>		hiddenVector;
+};
+
+#endif	// _nodeActivity_h
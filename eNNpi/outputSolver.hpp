@@ -0,0 +1,216 @@
+#ifndef _outputSolver_h
+#define _outputSolver_h
+
+#include <math.h>
+#include <vector>
+#include "nnWeights.hpp"
+#include "threadPool.hpp"
+
+/*
+ * outputSolver fits the output layer of a network in closed form, with the hidden layer left as it is.
+ *
+ * The output nodes are sigmoids, so an output node o gives a target t exactly when its activation sum is logit(t). With
+ * H the hidden node values of every training row (and a column of 1s for the bias) the output weights that best
+ * give those sums, in the least squares sense with a ridge penalty lambda, solve the normal equations
+ *
+ *	(HᵀH + lambda I) W = Hᵀ logit(T)
+ *
+ * one column of W per output node, its last row being the bias. The bias is not penalised. Targets are clamped to
+ * [targetClamp, 1 - targetClamp] first, as 0 and 1 have no logit.
+ *
+ * accumulate() makes one pass over the rows. They are split into one contiguous stripe per thread and each stripe is
+ * run through the hidden layer solverBlockRows rows at a time. Each block adds its HᵀH (the upper triangle) and
+ * Hᵀ logit(T) to the stripe's own sums in double, one row of the sums at a time so that the row stays in cache while
+ * the block is read. The stripes are added up in order at the end, so the result depends on the number of threads but
+ * not on how they are scheduled. solve() factors HᵀH + lambda I by Cholesky and solves for every output node, and
+ * writeInto() puts the weights and biases into an nnWeights, for nn::setWeights().
+ *
+ * The squares are taken in the logit space rather than of the output errors that training reduces, which counts an
+ * error near 0 or 1 for more than one near 0.5; a few epochs of training afterwards can polish the fit.
+ */
+
+const unsigned int solverBlockRows = 256;
+
+const char ENN_ERR_SOLVE_TOPOLOGY[] = "The training file does not fit the network";
+const char ENN_ERR_SOLVE_SINGULAR[] = "The output layer equations are singular, use a larger lambda";
+
+class outputSolver
+{
+	public:
+						outputSolver(const nnWeights & source, double newLambda) : weights(source)
+						{
+							lambda = newLambda;
+							targetClamp = 1e-3;
+							size = weights.hiddenNodes() + 1;
+							gram.assign((size_t)size * size, 0.0);
+							rhs.assign((size_t)size * weights.outputNodes(), 0.0);
+							rowCount = 0;
+						}
+
+			void		setTargetClamp(double clamp) { targetClamp = clamp; }
+
+			template <class trainingRows> void accumulate(trainingRows * rows, unsigned int threads = 1)
+			/*
+			 * Add every row of rows to the normal equations, on threads threads (0 for one per core)
+			 */
+						{
+							unsigned int stripes, stripe;
+							vector<vector<double> > stripeGram, stripeRhs;
+							size_t i;
+
+							if ((rows->inputLines() > 0) && ((rows->inputSet(0)->size() != weights.standardInputNodes())
+									|| (rows->outputSet(0)->size() != weights.outputNodes())))
+								throw format_Error(ENN_ERR_SOLVE_TOPOLOGY);
+
+							stripes = (threads == 0) ? threadPool::hardwareThreads() : threads;
+							if (stripes > rows->inputLines() / solverBlockRows + 1)
+								stripes = rows->inputLines() / solverBlockRows + 1;
+							stripeGram.resize(stripes);
+							stripeRhs.resize(stripes);
+
+							auto work = [&](unsigned int worker, size_t task)
+							{
+								unsigned int first = (unsigned int)((size_t)rows->inputLines() * task / stripes);
+								unsigned int last = (unsigned int)((size_t)rows->inputLines() * (task + 1) / stripes);
+
+								stripeGram[task].assign(gram.size(), 0.0);
+								stripeRhs[task].assign(rhs.size(), 0.0);
+								addRows(rows, first, last, stripeGram[task], stripeRhs[task]);
+							};
+
+							if (stripes == 1)
+								work(0, 0);
+							else
+							{
+								threadPool pool(stripes);
+								pool.run(stripes, work);
+							}
+
+							for (stripe = 0; stripe < stripes; stripe++)
+							{
+								for (i = 0; i < gram.size(); i++)
+									gram[i] += stripeGram[stripe][i];
+								for (i = 0; i < rhs.size(); i++)
+									rhs[i] += stripeRhs[stripe][i];
+							}
+							rowCount += rows->inputLines();
+						}
+
+			void		solve()
+			/*
+			 * Factor HᵀH + lambda I = LLᵀ and solve for each output node's column of weights
+			 */
+						{
+							vector<double> factor(gram);
+							unsigned int i, j, k, o, outNodes = weights.outputNodes();
+							double sum;
+
+							for (i = 0; i + 1 < size; i++)		// not the bias
+								factor[(size_t)i * size + i] += lambda;
+
+							for (j = 0; j < size; j++)			// Cholesky, L in the lower triangle, from the upper triangle sums
+							{
+								sum = factor[(size_t)j * size + j];
+								for (k = 0; k < j; k++)
+									sum -= factor[(size_t)j * size + k] * factor[(size_t)j * size + k];
+								if (!(sum > 0.0))
+									throw format_Error(ENN_ERR_SOLVE_SINGULAR);
+								factor[(size_t)j * size + j] = sqrt(sum);
+
+								for (i = j + 1; i < size; i++)
+								{
+									sum = factor[(size_t)j * size + i];		// the upper triangle holds A[j][i] = A[i][j]
+									for (k = 0; k < j; k++)
+										sum -= factor[(size_t)i * size + k] * factor[(size_t)j * size + k];
+									factor[(size_t)i * size + j] = sum / factor[(size_t)j * size + j];
+								}
+							}
+
+							solution.assign(rhs.size(), 0.0);
+							for (o = 0; o < outNodes; o++)
+							{
+								for (i = 0; i < size; i++)			// L y = b
+								{
+									sum = rhs[(size_t)i * outNodes + o];
+									for (k = 0; k < i; k++)
+										sum -= factor[(size_t)i * size + k] * solution[(size_t)k * outNodes + o];
+									solution[(size_t)i * outNodes + o] = sum / factor[(size_t)i * size + i];
+								}
+								for (i = size; i-- > 0; )			// Lᵀ x = y
+								{
+									sum = solution[(size_t)i * outNodes + o];
+									for (k = i + 1; k < size; k++)
+										sum -= factor[(size_t)k * size + i] * solution[(size_t)k * outNodes + o];
+									solution[(size_t)i * outNodes + o] = sum / factor[(size_t)i * size + i];
+								}
+							}
+						}
+
+			void		writeInto(nnWeights * target) const		// the solved output weights and biases, after solve()
+						{
+							unsigned int h, o, hidNodes = weights.hiddenNodes(), outNodes = weights.outputNodes();
+
+							for (o = 0; o < outNodes; o++)
+							{
+								for (h = 0; h < hidNodes; h++)
+									target->outputWeights()[o * hidNodes + h] = (float)solution[(size_t)h * outNodes + o];
+								target->outputBiases()[o] = (float)solution[(size_t)hidNodes * outNodes + o];
+							}
+						}
+
+	// access
+			unsigned long rows() const { return rowCount; }
+			double		ridge() const { return lambda; }
+
+	private:
+			template <class trainingRows> void addRows(trainingRows * rows, unsigned int first, unsigned int last, vector<double> & blockGram, vector<double> & blockRhs) const
+						{
+							unsigned int hidNodes = weights.hiddenNodes(), outNodes = weights.outputNodes();
+							vector<float> hidden((size_t)solverBlockRows * size);
+							vector<double> logits((size_t)solverBlockRows * outNodes);
+							unsigned int start, count, r, i, j, o;
+							double target, hi;
+							const float * hr;
+
+							for (start = first; start < last; start += count)
+							{
+								count = (last - start < solverBlockRows) ? last - start : solverBlockRows;
+								for (r = 0; r < count; r++)
+								{
+									weights.runHidden(rows->inputSet(start + r)->data(), &hidden[(size_t)r * size]);
+									hidden[(size_t)r * size + hidNodes] = 1.0;
+									for (o = 0; o < outNodes; o++)
+									{
+										target = (*rows->outputSet(start + r))[o];
+										target = (target < targetClamp) ? targetClamp : ((target > 1 - targetClamp) ? 1 - targetClamp : target);
+										logits[(size_t)r * outNodes + o] = log(target / (1 - target));
+									}
+								}
+
+								for (i = 0; i < size; i++)		// the block's HᵀH (upper triangle) and Hᵀ logit(T), a row of the sums at a time
+									for (r = 0; r < count; r++)
+									{
+										hr = &hidden[(size_t)r * size];
+										hi = hr[i];
+										if (hi == 0.0)
+											continue;
+										for (j = i; j < size; j++)
+											blockGram[(size_t)i * size + j] += hi * hr[j];
+										for (o = 0; o < outNodes; o++)
+											blockRhs[(size_t)i * outNodes + o] += hi * logits[(size_t)r * outNodes + o];
+									}
+							}
+						}
+
+	private:
+	nnWeights			weights;
+	double				lambda;
+	double				targetClamp;
+	unsigned int		size;				// hidden nodes + 1 for the bias
+	unsigned long		rowCount;
+	vector<double>		gram;				// HᵀH, [size][size], upper triangle
+	vector<double>		rhs;				// Hᵀ logit(T), [size][output]
+	vector<double>		solution;			// W, [size][output], the bias last
+};
+
+#endif	// _outputSolver_h
@@ -0,0 +1,308 @@
+#ifndef _quantizedWeights_h
+#define _quantizedWeights_h
+
+#include <stdint.h>
+#include <math.h>
+#include <ostream>
+#include <vector>
+#include "nnWeights.hpp"
+#include "networkFile.hpp"
+
+/*
+ * quantizedWeights is an int8 copy of a network for inference, made after training from an nnWeights snapshot.
+ *
+ * Each row of weights (the links into one hidden or output node) is quantized symmetrically with a scale of its own,
+ * max |w| / 127. The inputs and the hidden node values are quantized with one scale per layer, found by calibration:
+ * every row of a calibration file is run through the float weights and the largest input and hidden node values
+ * seen are mapped to 127. A hidden or output node then works out
+ *
+ *	f(bias + rowScale * activationScale * sum(qWeight * qValue))
+ *
+ * with the sum of the int8 products made in an int32. The node biases and the input bias node weights stay float and
+ * are added together up front. Values outside the calibrated range are clamped to +-127.
+ *
+ * The weights take a quarter of the memory of the float weights plus one float scale and one float bias per node.
+ *
+ * To make one
+ *	quantizedWeights q(*theNet->snapshot());
+ *	q.calibrate(trainingFile);		// or observe() each row and then quantize()
+ *
+ * saveOn() writes the quantized section of a .enn file (see networkFile) and quantizedWeights(networkFile *) reads
+ * it back along with the float biases of the same file.
+ */
+
+const char ENN_ERR_NO_QUANTIZED[] = "The network file has no quantized section, save it with -quantize";
+const char ENN_ERR_NOT_QUANTIZED[] = "The network has not been calibrated and quantized";
+const char ENN_ERR_CALIBRATION_TOPOLOGY[] = "The calibration file does not fit the network";
+
+class quantizedWeights
+{
+	public:
+	typedef int8_t		scratchType;
+
+						quantizedWeights(const nnWeights & source)
+						/*
+						 * Ready to calibrate from source's float weights, call observe() or calibrate() then quantize()
+						 */
+						{
+							setFloatWeights(source);
+							inputRange = hiddenRange = 0.0;
+							isQuantized = false;
+						}
+
+						quantizedWeights(networkFile * nFile)
+						/*
+						 * Read a network file that has a quantized section
+						 */
+						{
+							unsigned int h, o, i;
+							vector<float> * row;
+
+							if (!nFile->hasQuantized())
+								throw format_Error(ENN_ERR_NO_QUANTIZED);
+
+							nnWeights floatWeights(nFile);
+							setFloatWeights(floatWeights);
+							floatHidden.clear();		// only needed to calibrate
+							floatOutput.clear();
+
+							inScale = nFile->quantizedScale(0);
+							hidScale = nFile->quantizedScale(1);
+							inputRange = inScale * 127;
+							hiddenRange = hidScale * 127;
+							for (h = 0; h < hidNodes; h++)
+							{
+								row = nFile->quantizedRow(1, h);
+								for (i = 0; i < stdInNodes; i++)
+									hidWeights[h * stdInNodes + i] = (int8_t)(*row)[i];
+								hidRowScales[h] = (*row)[stdInNodes];
+								hidCombined[h] = hidRowScales[h] * inScale;
+							}
+							for (o = 0; o < outNodes; o++)
+							{
+								row = nFile->quantizedRow(2, o);
+								for (i = 0; i < hidNodes; i++)
+									outWeights[o * hidNodes + i] = (int8_t)(*row)[i];
+								outRowScales[o] = (*row)[hidNodes];
+								outCombined[o] = outRowScales[o] * hidScale;
+							}
+							isQuantized = true;
+						}
+
+	// calibrate
+			void		observe(const float * inputVector)
+			/*
+			 * Run one calibration row through the float weights, widening the input and hidden ranges to fit it
+			 */
+						{
+							unsigned int h, i;
+							float activationQuantity;
+
+							for (i = 0; i < stdInNodes; i++)
+								if (fabsf(inputVector[i]) > inputRange)
+									inputRange = fabsf(inputVector[i]);
+
+							for (h = 0; h < hidNodes; h++)
+							{
+								activationQuantity = 0.0;
+								for (i = 0; i < stdInNodes; i++)
+									activationQuantity += floatHidden[h * stdInNodes + i] * inputVector[i];
+
+								activationQuantity = fabsf(nnWeights::f(hidBiasTotals[h] + activationQuantity));
+								if (activationQuantity > hiddenRange)
+									hiddenRange = activationQuantity;
+							}
+						}
+
+			template <class trainingRows> void calibrate(trainingRows * calibration)	// observe every row then quantize()
+						{
+							unsigned int row;
+
+							if ((calibration->inputLines() > 0) && (calibration->inputSet(0)->size() != stdInNodes))
+								throw format_Error(ENN_ERR_CALIBRATION_TOPOLOGY);
+							for (row = 0; row < calibration->inputLines(); row++)
+								observe(calibration->inputSet(row)->data());
+							quantize();
+						}
+
+			void		quantize()
+						{
+							unsigned int h, o;
+
+							inScale = (inputRange > 0.0) ? inputRange / 127 : 1.0;
+							hidScale = (hiddenRange > 0.0) ? hiddenRange / 127 : 1.0;
+
+							for (h = 0; h < hidNodes; h++)
+							{
+								hidRowScales[h] = quantizeRow(&floatHidden[h * stdInNodes], stdInNodes, &hidWeights[h * stdInNodes]);
+								hidCombined[h] = hidRowScales[h] * inScale;
+							}
+							for (o = 0; o < outNodes; o++)
+							{
+								outRowScales[o] = quantizeRow(&floatOutput[o * hidNodes], hidNodes, &outWeights[o * hidNodes]);
+								outCombined[o] = outRowScales[o] * hidScale;
+							}
+							isQuantized = true;
+						}
+
+	// run
+			void		run(const float * inputVector, int8_t * scratch, float * outputVector) const
+			/*
+			 * scratch has room for scratchSize() values and outputVector for outputNodes() values
+			 */
+						{
+							int8_t * qInput = scratch;
+							int8_t * qHidden = scratch + stdInNodes;
+							float invInScale = 1 / inScale;
+							float invHidScale = 1 / hidScale;
+							unsigned int h, i, o;
+
+							if (!isQuantized)
+								throw format_Error(ENN_ERR_NOT_QUANTIZED);
+
+							for (i = 0; i < stdInNodes; i++)
+								qInput[i] = quantizeValue(inputVector[i] * invInScale);
+
+							for (h = 0; h < hidNodes; h++)
+								qHidden[h] = quantizeValue(nnWeights::f(hidBiasTotals[h] + hidCombined[h] * (float)dot(&hidWeights[h * stdInNodes], qInput, stdInNodes))
+												* invHidScale);
+
+							for (o = 0; o < outNodes; o++)
+								outputVector[o] = nnWeights::f(outBiases[o] + outCombined[o] * (float)dot(&outWeights[o * hidNodes], qHidden, hidNodes));
+						}
+
+			void		saveOn(ostream & outStr) const		// the quantized section of a .enn file
+						{
+							unsigned int h, o, i;
+							streamsize oldPrecision = outStr.precision(8);
+
+							outStr << "quantScale(0," << inScale << ")\nquantScale(1," << hidScale << ")\n";
+							for (h = 0; h < hidNodes; h++)
+							{
+								outStr << "quantRow(1," << h << "," << hidRowScales[h];
+								for (i = 0; i < stdInNodes; i++)
+									outStr << "," << (int)hidWeights[h * stdInNodes + i];
+								outStr << ")\n";
+							}
+							for (o = 0; o < outNodes; o++)
+							{
+								outStr << "quantRow(2," << o << "," << outRowScales[o];
+								for (i = 0; i < hidNodes; i++)
+									outStr << "," << (int)outWeights[o * hidNodes + i];
+								outStr << ")\n";
+							}
+							outStr.precision(oldPrecision);
+						}
+
+	// access
+			unsigned int standardInputNodes() const { return stdInNodes; }
+			unsigned int hiddenNodes() const { return hidNodes; }
+			unsigned int outputNodes() const { return outNodes; }
+			unsigned int scratchSize() const { return stdInNodes + hidNodes; }
+			bool		quantized() const { return isQuantized; }
+			float		inputScale() const { return inScale; }
+			float		hiddenScale() const { return hidScale; }
+
+			size_t		weightBytes() const		// the int8 weights and the per node floats used to run them
+						{
+							return hidWeights.size() + outWeights.size() + (hidNodes + outNodes) * 2 * sizeof(float);
+						}
+
+			size_t		floatWeightBytes() const	// the same weights as floats, as in nnWeights
+						{
+							return ((size_t)hidNodes * (stdInNodes + (hasBias ? 1 : 0)) + hidNodes + (size_t)outNodes * hidNodes + outNodes) * sizeof(float);
+						}
+
+	private:
+			void		setFloatWeights(const nnWeights & source)
+						{
+							unsigned int h, i;
+							const float * w;
+
+							stdInNodes = source.standardInputNodes();
+							hidNodes = source.hiddenNodes();
+							outNodes = source.outputNodes();
+							hasBias = source.hasInputBiasNode();
+
+							floatHidden.resize((size_t)hidNodes * stdInNodes);		// without the bias node column
+							hidBiasTotals.resize(hidNodes);
+							for (h = 0; h < hidNodes; h++)
+							{
+								w = source.hiddenWeights() + (size_t)h * source.inputNodes();
+								for (i = 0; i < stdInNodes; i++)
+									floatHidden[h * stdInNodes + i] = w[i];
+								hidBiasTotals[h] = source.hiddenBiases()[h] + (hasBias ? w[stdInNodes] : (float)0.0);
+							}
+							floatOutput.assign(source.outputWeights(), source.outputWeights() + (size_t)outNodes * hidNodes);
+							outBiases.assign(source.outputBiases(), source.outputBiases() + outNodes);
+
+							hidWeights.resize((size_t)hidNodes * stdInNodes);
+							outWeights.resize((size_t)outNodes * hidNodes);
+							hidRowScales.resize(hidNodes);
+							outRowScales.resize(outNodes);
+							hidCombined.resize(hidNodes);
+							outCombined.resize(outNodes);
+						}
+
+	static	float		quantizeRow(const float * weights, unsigned int count, int8_t * qWeights)	// returns the row's scale
+						{
+							float maxWeight = 0.0, scale, invScale;
+							unsigned int i;
+
+							for (i = 0; i < count; i++)
+								if (fabsf(weights[i]) > maxWeight)
+									maxWeight = fabsf(weights[i]);
+							scale = (maxWeight > 0.0) ? maxWeight / 127 : 1.0;
+							invScale = 1 / scale;
+							for (i = 0; i < count; i++)
+								qWeights[i] = quantizeValue(weights[i] * invScale);
+							return scale;
+						}
+
+	static	int8_t		quantizeValue(float scaled)
+						{
+							long q = lrintf(scaled);
+
+							return (int8_t)((q > 127) ? 127 : ((q < -127) ? -127 : q));
+						}
+
+	__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+	static	int32_t		dot(const int8_t * a, const int8_t * b, unsigned int count)
+			/*
+			 * The -O2 cost model will not vectorise the widening multiply, so this one function asks gcc for the full one
+			 * (SSE2 or NEON multiply, widen and add). Integer sums come out the same in any order.
+			 */
+						{
+							int32_t sum = 0;
+							unsigned int i;
+
+							for (i = 0; i < count; i++)
+								sum += (int16_t)a[i] * (int16_t)b[i];
+							return sum;
+						}
+
+	private:
+	unsigned int		stdInNodes;
+	unsigned int		hidNodes;
+	unsigned int		outNodes;
+	bool				hasBias;
+	bool				isQuantized;
+
+	vector<int8_t>		hidWeights;			// [hidden][standard input]
+	vector<int8_t>		outWeights;			// [output][hidden]
+	vector<float>		hidRowScales;
+	vector<float>		outRowScales;
+	vector<float>		hidCombined;		// row scale * input scale
+	vector<float>		outCombined;		// row scale * hidden scale
+	vector<float>		hidBiasTotals;		// hidden bias + input bias node weight
+	vector<float>		outBiases;
+
+	float				inScale;
+	float				hidScale;
+	float				inputRange;			// calibration
+	float				hiddenRange;
+	vector<float>		floatHidden;		// calibration, [hidden][standard input]
+	vector<float>		floatOutput;		//	"
+};
+
+#endif	// _quantizedWeights_h
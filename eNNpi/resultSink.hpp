@@ -0,0 +1,329 @@
+#ifndef _resultSink_h
+#define _resultSink_h
+
+#include <fcntl.h>		// POSIX only
+#include <unistd.h>
+#include <string.h>
+
+#include <charconv>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "errStruct.hpp"
+
+/*
+ * The result sink hierarchy:
+ *
+ *	resultSink
+ *		textSink		tab (TSV) or comma (CSV) separated text with a title row
+ *		binarySink		raw native endian float32, no title row and no index
+ *
+ * A result sink writes the output of nn::run and nn::test to a file without going through iostreams. Numbers
+ * are formatted with std::to_chars straight into a large buffer which is written out with write(2) when it
+ * fills up, so nothing is allocated per row.
+ *
+ * With backgroundFlush set, two buffers are used: rows are formatted into one while a writer thread writes
+ * out the other. The rows only wait if the disk cannot keep up with both buffers.
+ *
+ * Row layouts:
+ *	runRow:		index, output values
+ *	testRow:	index, input values, desired values, actual values, error values
+ *
+ * The binary layout is the same without the index, so a run file is rows * outputNodes floats.
+ *
+ * Call close() (or delete the sink) to make sure everything has reached the file.
+ */
+
+const size_t resultSinkBufferSize = 1 << 20;
+
+class resultSink
+{
+	public:
+						resultSink(const char * cstrFilename, bool backgroundFlush = false)
+						{
+							fd = open(cstrFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+							if (fd < 0)
+								throw format_Error(ENN_ERR_RESULT_FILE);
+
+							active = new char[resultSinkBufferSize];		// deleted in close()
+							used = 0;
+							pending = NULL;
+							pendingUsed = 0;
+							stopWriter = false;
+							writeFailed = false;
+							titleWritten = false;
+							background = backgroundFlush;
+
+							if (background)
+							{
+								spare = new char[resultSinkBufferSize];	// deleted in close()
+								writer = thread(&resultSink::writeLoop, this);
+							}
+							else
+								spare = NULL;
+						}
+
+	virtual				~resultSink()
+						{
+							close();
+						}
+
+	virtual	void		runRow(const int index, const float * outputVector, unsigned int outputs) = 0;
+	virtual	void		testRow(const int index, const float * inputVector, unsigned int inputs,
+								const float * desiredVector, const float * actualVector, const float * errorVector, unsigned int outputs) = 0;
+
+			void		flush()		// hand the current buffer to the disk (or the writer thread)
+						{
+							if (used == 0)
+								return;
+
+							if (!background)
+							{
+								writeAll(active, used);
+								used = 0;
+							}
+							else
+							{
+								unique_lock<mutex> guard(writerLock);
+
+								writerReady.wait(guard, [this] { return spare != NULL; });	// the writer has given the other buffer back
+								pending = active;
+								pendingUsed = used;
+								active = spare;
+								spare = NULL;
+								used = 0;
+								writerReady.notify_all();
+							}
+						}
+
+			void		close()
+						{
+							if (fd < 0)
+								return;
+
+							flush();
+							if (writer.joinable())
+							{
+								{
+									lock_guard<mutex> guard(writerLock);
+									stopWriter = true;
+								}
+								writerReady.notify_all();
+								writer.join();
+							}
+
+							::close(fd);
+							fd = -1;
+
+							delete [] active;
+							if (spare != NULL)
+								delete [] spare;
+						}
+
+			bool		failed() { return writeFailed; }	// true if any write to the file failed
+
+	protected:
+			void		reserve(size_t bytes)	// make sure that there is room for another bytes in the active buffer
+						{
+							if (used + bytes > resultSinkBufferSize)
+								flush();
+						}
+
+			void		put(const char c)
+						{
+							active[used++] = c;
+						}
+
+			void		put(const char * cstr)
+						{
+							size_t length = strlen(cstr);
+
+							memcpy(active + used, cstr, length);
+							used += length;
+						}
+
+			void		put(const int i)
+						{
+							used = to_chars(active + used, active + resultSinkBufferSize, i).ptr - active;
+						}
+
+			void		put(const float f)
+						{
+							used = to_chars(active + used, active + resultSinkBufferSize, f).ptr - active;
+						}
+
+			void		put(const void * data, size_t bytes)
+						{
+							memcpy(active + used, data, bytes);
+							used += bytes;
+						}
+
+			bool		needsTitle()	// true the first time it is called
+						{
+							if (titleWritten)
+								return false;
+							titleWritten = true;
+							return true;
+						}
+
+	private:
+			void		writeAll(const char * buffer, size_t bytes)
+						{
+							ssize_t written;
+
+							while (bytes > 0)
+							{
+								written = write(fd, buffer, bytes);
+								if (written <= 0)
+								{
+									writeFailed = true;
+									return;
+								}
+								buffer += written;
+								bytes -= written;
+							}
+						}
+
+			void		writeLoop()		// the background writer thread
+						{
+							unique_lock<mutex> guard(writerLock);
+
+							for (;;)
+							{
+								writerReady.wait(guard, [this] { return (pending != NULL) || stopWriter; });
+								if (pending == NULL)
+									return;
+
+								guard.unlock();
+								writeAll(pending, pendingUsed);
+								guard.lock();
+
+								spare = pending;
+								pending = NULL;
+								writerReady.notify_all();
+							}
+						}
+
+	private:
+	int					fd;
+	char			*	active;			// rows are formatted into this buffer
+	size_t				used;
+	bool				background;		// a writer thread writes the buffers, only it writes to fd
+	char			*	spare;			// the free buffer, NULL while the writer thread has a buffer (read under writerLock)
+	char			*	pending;		// buffer waiting for (or being written by) the writer thread
+	size_t				pendingUsed;
+	thread				writer;
+	mutex				writerLock;
+	condition_variable	writerReady;
+	bool				stopWriter;
+	atomic<bool>		writeFailed;
+	bool				titleWritten;
+};
+
+class textSink : public resultSink
+{
+	public:
+						textSink(const char * cstrFilename, const char separator = '\t', bool backgroundFlush = false) : resultSink(cstrFilename, backgroundFlush)
+						{
+							sep = separator;
+						}
+
+	virtual				~textSink() { }
+
+			void		runRow(const int index, const float * outputVector, unsigned int outputs)
+						{
+							if (needsTitle())
+								title(0, outputs, false);
+
+							reserve(rowBytes(outputs));
+							put(index);
+							values(outputVector, outputs);
+							put('\n');
+						}
+
+			void		testRow(const int index, const float * inputVector, unsigned int inputs,
+								const float * desiredVector, const float * actualVector, const float * errorVector, unsigned int outputs)
+						{
+							if (needsTitle())
+								title(inputs, outputs, true);
+
+							reserve(rowBytes(inputs + 3 * outputs));
+							put(index);
+							values(inputVector, inputs);
+							values(desiredVector, outputs);
+							values(actualVector, outputs);
+							values(errorVector, outputs);
+							put('\n');
+						}
+
+	private:
+			size_t		rowBytes(unsigned int fields) { return 16 + fields * 24; }	// enough for the index and any float
+
+			void		values(const float * vec, unsigned int count)
+						{
+							unsigned int i;
+
+							for (i = 0; i < count; i++)
+							{
+								put(sep);
+								put(vec[i]);
+							}
+						}
+
+			void		titles(const char * cstrTitle, unsigned int count)
+						{
+							unsigned int i;
+
+							for (i = 0; i < count; i++)
+							{
+								reserve(32);
+								put(sep);
+								put(cstrTitle);
+								put((int)i);
+							}
+						}
+
+			void		title(unsigned int inputs, unsigned int outputs, bool isTest)
+						{
+							reserve(8);
+							put("Index");
+							if (isTest)
+							{
+								titles("Input:", inputs);
+								titles("Desired:", outputs);
+								titles("Actual:", outputs);
+								titles("Error:", outputs);
+							}
+							else
+								titles("Output:", outputs);
+							put('\n');
+						}
+
+	char				sep;
+};
+
+class binarySink : public resultSink
+{
+	public:
+						binarySink(const char * cstrFilename, bool backgroundFlush = false) : resultSink(cstrFilename, backgroundFlush) { }
+	virtual				~binarySink() { }
+
+			void		runRow(const int index, const float * outputVector, unsigned int outputs)
+						{
+							reserve(outputs * sizeof(float));
+							put(outputVector, outputs * sizeof(float));
+						}
+
+			void		testRow(const int index, const float * inputVector, unsigned int inputs,
+								const float * desiredVector, const float * actualVector, const float * errorVector, unsigned int outputs)
+						{
+							reserve((inputs + 3 * outputs) * sizeof(float));
+							put(inputVector, inputs * sizeof(float));
+							put(desiredVector, outputs * sizeof(float));
+							put(actualVector, outputs * sizeof(float));
+							put(errorVector, outputs * sizeof(float));
+						}
+};
+
+#endif	// _resultSink_h
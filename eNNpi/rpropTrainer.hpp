@@ -0,0 +1,413 @@
+#ifndef _rpropTrainer_h
+#define _rpropTrainer_h
+
+#include <math.h>
+#include <vector>
+#include "nnWeights.hpp"
+#include "epochTrainer.hpp"
+#include "threadPool.hpp"
+
+/*
+ * rpropTrainer trains a network by iRPROP+ (resilient backpropagation with weight backtracking, Igel and Hüsken), a
+ * full batch algorithm that needs no learning rate or momentum.
+ *
+ * Each epoch finds the gradient of the summed squared error over every training row, then moves each weight and bias
+ * by its own step size in the direction against the sign of its gradient. Only the sign of the gradient is used. A
+ * weight's step grows by rpropIncrease while its gradient keeps its sign and shrinks by rpropDecrease when it flips,
+ * within [rpropStepMin, rpropStepMax]. On a flip the weight's last move is undone if the error went up, and the
+ * weight sits the next epoch out. The step sizes, last gradients and last moves are kept in arrays laid out as the
+ * weights are, [hidden weights][hidden biases][output weights][output biases], with the weights in nnWeights order.
+ *
+ * The gradient is found a layer at a time. The rows are split into one contiguous stripe per thread and each stripe
+ * is run through the network rpropBlockRows rows at a time: the forward pass of the block, the output node errors,
+ * the hidden node errors, then the block's gradient of each layer added to the stripe's own sums in double. The
+ * stripes are added up in order, so the result depends on the number of threads but not on how they are scheduled.
+ *
+ * The trainer works on an nnWeights copy of the network:
+ *
+ *	nnWeights * snapshot = theNet->snapshot();
+ *	rpropTrainer trainer(snapshot, theNet->rpropTrainingState());
+ *	trainer.run(trainingFile);
+ *	theNet->setWeights(snapshot);
+ *
+ * Given the network's rpropState the trainer starts from the step sizes, last gradients and last moves the previous
+ * run left there, as long as the weights are still the ones that run ended with, and run() leaves its own there at
+ * the end. Otherwise it starts every step at initialStep.
+ *
+ * The epochs stop by the rules of epochTrainer (see stoppingRules), on the validation loss if setValidation() has
+ * given a validation file and on the training loss if not. There is no learning rate, so a decay multiplies every
+ * step size instead. For a pruned network keepPruned() leaves the weights that are 0 at 0. The learningRate of each
+ * epochReport is the mean step size.
+ */
+
+const unsigned int rpropBlockRows = 256;
+const float rpropIncrease = 1.2;
+const float rpropDecrease = 0.5;
+const float rpropStepMax = 50.0;
+const float rpropStepMin = 1e-6;
+
+const char ENN_ERR_RPROP_TOPOLOGY[] = "The training file does not fit the network";
+
+class rpropTrainer
+{
+	public:
+						rpropTrainer(nnWeights * newWeights, rpropState * newState = NULL, float initialStep = 0.1)
+						{
+							theWeights = newWeights;
+							hidWeightCount = (size_t)theWeights->hiddenNodes() * theWeights->inputNodes();
+							outWeightCount = (size_t)theWeights->outputNodes() * theWeights->hiddenNodes();
+							parameterCount = hidWeightCount + theWeights->hiddenNodes() + outWeightCount + theWeights->outputNodes();
+							state = newState;
+
+							if ((state != NULL) && (state->stepSize.size() == parameterCount) && (state->trainedWeights == parameters()))
+							{
+								stepSize = state->stepSize;
+								lastGradient = state->lastGradient;
+								lastChange = state->lastChange;
+								lastLoss = state->lastLoss;
+							}
+							else
+							{
+								stepSize.assign(parameterCount, initialStep);
+								lastGradient.assign(parameterCount, 0.0);
+								lastChange.assign(parameterCount, 0.0);
+								lastLoss = -1.0;
+							}
+							gradient.assign(parameterCount, 0.0);
+
+							threads = 1;
+							pool = NULL;
+							validationFile = NULL;
+							rules.setMaxEpochs(16);
+							epochComplete = NULL;
+							callbackData = NULL;
+						}
+
+						~rpropTrainer() { delete pool; }
+
+	// setup, as for epochTrainer
+			void		setValidation(trainingFile * newValidationFile) { validationFile = newValidationFile; }
+			void		setMaxEpochs(unsigned int epochs) { rules.setMaxEpochs(epochs); }
+			void		setPatience(unsigned int epochs) { rules.setPatience(epochs); }
+			void		setTarget(double targetLoss) { rules.setTarget(targetLoss); }
+			void		setTimeBudget(double seconds) { rules.setTimeBudget(seconds); }
+			void		setDecay(float factor, unsigned int epochs = 0) { rules.setDecay(factor, epochs); }	// of the step sizes
+			void		setCallback(funcEpochCallback newCallback, void * data = NULL) { epochComplete = newCallback; callbackData = data; }
+
+			void		setThreads(unsigned int newThreads)	// for the gradient, 0 for one per core
+						{
+							threads = (newThreads == 0) ? threadPool::hardwareThreads() : newThreads;
+							delete pool;
+							pool = NULL;
+						}
+
+			void		keepPruned()	// leave the link weights that are 0 now at 0, for a pruned network
+						{
+							size_t i;
+
+							pruned.assign(parameterCount, false);
+							for (i = 0; i < hidWeightCount; i++)
+								pruned[i] = (theWeights->hiddenWeights()[i] == 0.0);
+							for (i = 0; i < outWeightCount; i++)
+								pruned[outWeightStart() + i] = (theWeights->outputWeights()[i] == 0.0);
+						}
+
+	// train
+			template <class trainingRows> double trainEpoch(trainingRows * rows)
+			/*
+			 * One full batch step over every row. Returns the mean squared error of the weights the step started
+			 * from, as nn::trainPass() does.
+			 */
+						{
+							double loss = batchGradient(rows);
+
+							step(loss);
+							lastLoss = loss;
+							return loss;
+						}
+
+			template <class trainingRows> stop_reason run(trainingRows * rows)	// epochs until a stopping rule is met, see epochTrainer
+						{
+							epochReport report;
+							stop_reason reason = STOP_NONE;
+							bool decayDue;
+							size_t i;
+
+							rules.start();
+							for (report.epoch = 1; reason == STOP_NONE; report.epoch++)
+							{
+								report.trainingLoss = trainEpoch(rows);
+								report.learningRate = meanStepSize();
+								report.validationLoss = (validationFile != NULL) ? validate() : -1.0;
+								report.isBest = rules.improved((validationFile != NULL) ? report.validationLoss : report.trainingLoss);
+								report.elapsedMs = rules.elapsedMs();
+
+								if (epochComplete != NULL)
+									epochComplete(report, callbackData);
+
+								reason = rules.endOfEpoch(report.epoch, &decayDue);
+								if (decayDue)
+									for (i = 0; i < parameterCount; i++)
+										stepSize[i] = (stepSize[i] * rules.decay() > rpropStepMin) ? stepSize[i] * rules.decay() : rpropStepMin;
+							}
+
+							if (state != NULL)
+							{
+								state->stepSize = stepSize;
+								state->lastGradient = lastGradient;
+								state->lastChange = lastChange;
+								state->lastLoss = lastLoss;
+								state->trainedWeights = parameters();
+							}
+							return reason;
+						}
+
+	// access
+			double		bestLossSeen() const { return rules.bestLoss(); }
+			double		meanStepSize() const
+						{
+							double sum = 0.0;
+							size_t i;
+
+							for (i = 0; i < parameterCount; i++)
+								sum += stepSize[i];
+							return (parameterCount > 0) ? sum / parameterCount : 0.0;
+						}
+
+	private:
+			vector<float> parameters()	// a copy of every weight and bias, as the parameters are laid out
+						{
+							vector<float> values(parameterCount);
+							size_t i;
+
+							for (i = 0; i < parameterCount; i++)
+								values[i] = *parameter(i);
+							return values;
+						}
+
+			double		validate()		// the mean squared error over the validation file
+						{
+							vector<float> hidden(theWeights->hiddenNodes()), output(theWeights->outputNodes());
+							unsigned int row, o;
+							double diff, sumSquared = 0.0;
+
+							if ((validationFile->inputLines() > 0) && ((validationFile->inputSet(0)->size() != theWeights->standardInputNodes())
+									|| (validationFile->outputSet(0)->size() != theWeights->outputNodes())))
+								throw format_Error(ENN_ERR_RPROP_TOPOLOGY);
+
+							for (row = 0; row < validationFile->inputLines(); row++)
+							{
+								theWeights->run(validationFile->inputSet(row)->data(), hidden.data(), output.data());
+								for (o = 0; o < theWeights->outputNodes(); o++)
+								{
+									diff = (*validationFile->outputSet(row))[o] - output[o];
+									sumSquared += diff * diff;
+								}
+							}
+							return (validationFile->inputLines() == 0) ? 0.0 : sumSquared / ((double)validationFile->inputLines() * theWeights->outputNodes());
+						}
+
+			size_t		hidBiasStart() const { return hidWeightCount; }
+			size_t		outWeightStart() const { return hidWeightCount + theWeights->hiddenNodes(); }
+			size_t		outBiasStart() const { return outWeightStart() + outWeightCount; }
+
+			float	*	parameter(size_t i)		// the weight or bias that gradient[i] is for
+						{
+							if (i < hidBiasStart())
+								return theWeights->hiddenWeights() + i;
+							else if (i < outWeightStart())
+								return theWeights->hiddenBiases() + (i - hidBiasStart());
+							else if (i < outBiasStart())
+								return theWeights->outputWeights() + (i - outWeightStart());
+							else
+								return theWeights->outputBiases() + (i - outBiasStart());
+						}
+
+			template <class trainingRows> double batchGradient(trainingRows * rows)
+			/*
+			 * Leave the gradient of the summed squared error (halved) in gradient and return the mean squared error
+			 */
+						{
+							unsigned int stripes, stripe;
+							vector<vector<double> > stripeGradient;
+							vector<double> stripeSquares;
+							double sumSquared = 0.0;
+							size_t i;
+
+							if ((rows->inputLines() > 0) && ((rows->inputSet(0)->size() != theWeights->standardInputNodes())
+									|| (rows->outputSet(0)->size() != theWeights->outputNodes())))
+								throw format_Error(ENN_ERR_RPROP_TOPOLOGY);
+
+							stripes = threads;
+							if (stripes > rows->inputLines() / rpropBlockRows + 1)
+								stripes = rows->inputLines() / rpropBlockRows + 1;
+							stripeGradient.resize(stripes);
+							stripeSquares.assign(stripes, 0.0);
+
+							auto work = [&](unsigned int worker, size_t task)
+							{
+								unsigned int first = (unsigned int)((size_t)rows->inputLines() * task / stripes);
+								unsigned int last = (unsigned int)((size_t)rows->inputLines() * (task + 1) / stripes);
+
+								stripeGradient[task].assign(parameterCount, 0.0);
+								stripeSquares[task] = addRows(rows, first, last, stripeGradient[task]);
+							};
+
+							if (stripes == 1)
+								work(0, 0);
+							else
+							{
+								if (pool == NULL)
+									pool = new threadPool(threads);
+								pool->run(stripes, work);
+							}
+
+							gradient.assign(parameterCount, 0.0);
+							for (stripe = 0; stripe < stripes; stripe++)
+							{
+								for (i = 0; i < parameterCount; i++)
+									gradient[i] += stripeGradient[stripe][i];
+								sumSquared += stripeSquares[stripe];
+							}
+
+							return (rows->inputLines() == 0) ? 0.0 : sumSquared / ((double)rows->inputLines() * theWeights->outputNodes());
+						}
+
+			template <class trainingRows> double addRows(trainingRows * rows, unsigned int first, unsigned int last, vector<double> & blockGradient) const
+			/*
+			 * Add the gradient of rows first to last - 1 to blockGradient, a layer at a time per block, and return their
+			 * summed squared error
+			 */
+						{
+							unsigned int stdInNodes = theWeights->standardInputNodes(), inNodes = theWeights->inputNodes();
+							unsigned int hidNodes = theWeights->hiddenNodes(), outNodes = theWeights->outputNodes();
+							vector<float> hidden((size_t)rpropBlockRows * hidNodes);
+							vector<float> output((size_t)rpropBlockRows * outNodes);
+							vector<double> outputDelta((size_t)rpropBlockRows * outNodes);
+							vector<double> hiddenDelta((size_t)rpropBlockRows * hidNodes);
+							vector<const float *> inputs(rpropBlockRows);
+							const float * outW = theWeights->outputWeights();
+							unsigned int start, count, r, i, h, o;
+							double sumSquared = 0.0, diff, value, sum, d;
+							double * g;
+
+							for (start = first; start < last; start += count)
+							{
+								count = (last - start < rpropBlockRows) ? last - start : rpropBlockRows;
+
+								for (r = 0; r < count; r++)		// forward, and the error of each output node's activation sum
+								{
+									inputs[r] = rows->inputSet(start + r)->data();
+									theWeights->runHidden(inputs[r], &hidden[(size_t)r * hidNodes]);
+									theWeights->runOutput(&hidden[(size_t)r * hidNodes], &output[(size_t)r * outNodes]);
+									for (o = 0; o < outNodes; o++)
+									{
+										value = output[(size_t)r * outNodes + o];
+										diff = (*rows->outputSet(start + r))[o] - value;
+										sumSquared += diff * diff;
+										outputDelta[(size_t)r * outNodes + o] = -diff * value * (1 - value);
+									}
+								}
+
+								for (r = 0; r < count; r++)		// back through the output weights to each hidden node's activation sum
+									for (h = 0; h < hidNodes; h++)
+									{
+										sum = 0.0;
+										for (o = 0; o < outNodes; o++)
+											sum += outputDelta[(size_t)r * outNodes + o] * outW[(size_t)o * hidNodes + h];
+										value = hidden[(size_t)r * hidNodes + h];
+										hiddenDelta[(size_t)r * hidNodes + h] = sum * value * (1 - value);
+									}
+
+								for (o = 0; o < outNodes; o++)	// the output layer's gradient
+								{
+									g = &blockGradient[outWeightStart() + (size_t)o * hidNodes];
+									for (r = 0; r < count; r++)
+									{
+										d = outputDelta[(size_t)r * outNodes + o];
+										if (d == 0.0)
+											continue;
+										for (h = 0; h < hidNodes; h++)
+											g[h] += d * hidden[(size_t)r * hidNodes + h];
+										blockGradient[outBiasStart() + o] += d;
+									}
+								}
+
+								for (h = 0; h < hidNodes; h++)	// the hidden layer's gradient, the input bias node's link last
+								{
+									g = &blockGradient[(size_t)h * inNodes];
+									for (r = 0; r < count; r++)
+									{
+										d = hiddenDelta[(size_t)r * hidNodes + h];
+										if (d == 0.0)
+											continue;
+										for (i = 0; i < stdInNodes; i++)
+											g[i] += d * inputs[r][i];
+										if (inNodes > stdInNodes)
+											g[stdInNodes] += d;
+										blockGradient[hidBiasStart() + h] += d;
+									}
+								}
+							}
+
+							return sumSquared;
+						}
+
+			void		step(double loss)	// iRPROP+, loss being the error of the weights the gradient is for
+						{
+							float * w;
+							double product;
+							size_t i;
+
+							for (i = 0; i < parameterCount; i++)
+							{
+								if (!pruned.empty() && pruned[i])
+									continue;
+								w = parameter(i);
+								product = lastGradient[i] * gradient[i];
+								if (product > 0.0)
+								{
+									stepSize[i] = (stepSize[i] * rpropIncrease < rpropStepMax) ? stepSize[i] * rpropIncrease : rpropStepMax;
+									lastChange[i] = (gradient[i] > 0.0) ? -stepSize[i] : stepSize[i];
+									*w += lastChange[i];
+									lastGradient[i] = gradient[i];
+								}
+								else if (product < 0.0)
+								{
+									stepSize[i] = (stepSize[i] * rpropDecrease > rpropStepMin) ? stepSize[i] * rpropDecrease : rpropStepMin;
+									if ((lastLoss >= 0) && (loss > lastLoss))
+										*w -= lastChange[i];
+									lastGradient[i] = 0.0;
+								}
+								else
+								{
+									lastChange[i] = (gradient[i] > 0.0) ? -stepSize[i] : ((gradient[i] < 0.0) ? stepSize[i] : 0.0);
+									*w += lastChange[i];
+									lastGradient[i] = gradient[i];
+								}
+							}
+						}
+
+	private:
+	nnWeights		*	theWeights;			// trained in place
+	size_t				hidWeightCount;
+	size_t				outWeightCount;
+	size_t				parameterCount;
+
+	vector<float>		stepSize;			// per weight and bias, as the parameters are laid out
+	vector<double>		lastGradient;
+	vector<float>		lastChange;
+	vector<double>		gradient;
+	vector<bool>		pruned;				// empty unless keepPruned()
+	double				lastLoss;			// -1 before the first epoch
+	rpropState		*	state;				// the network's, or NULL
+
+	unsigned int		threads;
+	threadPool		*	pool;				// made on the first multi-threaded epoch
+	trainingFile	*	validationFile;		// NULL stops on the training loss
+	stoppingRules		rules;
+	funcEpochCallback	epochComplete;
+	void			*	callbackData;
+};
+
+#endif	// _rpropTrainer_h
@@ -0,0 +1,188 @@
+#ifndef _runStats_h
+#define _runStats_h
+
+/*
+ * Per phase timings and counters for the -stats flag.
+ *
+ * Compile with the _STATS_ directive set to build them in. Without it STATS_PHASE and STATS_COUNT expand to
+ * nothing, so they cost nothing at all. The Release and Debug builds leave it out; make eNNpi_instrumented builds
+ * a copy with it. With it they cost one test of a flag until runStats::global().enable()
+ * is called.
+ *
+ *	STATS_PHASE(phase)			time from here to the end of the enclosing block and add it to phase
+ *	STATS_COUNT(counter, n)		add n to counter
+ *
+ * Phases can nest (the callbacks are called from inside run and test, open and parse from inside train) so
+ * the time of an outer phase includes the time of any phase inside it.
+ *
+ * The report adds the process figures from getrusage(): user and system CPU time, the maximum resident set
+ * size, page faults and context switches.
+ */
+
+#ifdef _STATS_
+
+#include <sys/resource.h>	// POSIX only
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+using namespace std ;
+
+enum stats_phase { PHASE_OPEN, PHASE_PARSE, PHASE_BUILD, PHASE_RANDOMISE, PHASE_TRAIN, PHASE_RUN, PHASE_TEST, PHASE_CALLBACK,
+					PHASE_SAVE, PHASE_WRITE, PHASE_COUNT };
+
+enum stats_counter { COUNT_ROWS_TRAINED, COUNT_ROWS_RUN, COUNT_ROWS_TESTED, COUNT_LINKS_VISITED, COUNT_LINES_PARSED, COUNT_BYTES_PARSED,
+					COUNT_BYTES_SAVED, COUNT_COUNT };
+
+class runStats
+{
+	public:
+	static	runStats &	global()
+						{
+							static runStats theStats;
+							return theStats;
+						}
+
+			void		enable()
+						{
+							if (!enabled)
+								started = chrono::steady_clock::now();
+							enabled = true;
+						}
+
+			bool		isEnabled() { return enabled; }
+
+			void		addPhase(stats_phase phase, long long ns)
+						{
+							phaseNs[phase].fetch_add(ns, memory_order_relaxed);
+							phaseCalls[phase].fetch_add(1, memory_order_relaxed);
+						}
+
+			void		count(stats_counter counter, unsigned long long n)
+						{
+							if (enabled)
+								counters[counter].fetch_add(n, memory_order_relaxed);
+						}
+
+			void		writeOn(ostream & outStr)
+						{
+							struct rusage usage;
+							unsigned int i;
+
+							getrusage(RUSAGE_SELF, &usage);
+
+							outStr << "Phase\tCalls\tms\n";
+							for (i = 0; i < PHASE_COUNT; i++)
+								if (phaseCalls[i] > 0)
+									outStr << phaseName((stats_phase)i) << "\t" << phaseCalls[i] << "\t" << phaseNs[i] / 1e6 << "\n";
+
+							outStr << "Counter\tValue\n";
+							for (i = 0; i < COUNT_COUNT; i++)
+								outStr << counterName((stats_counter)i) << "\t" << counters[i] << "\n";
+
+							outStr << "Wall ms: " << wallMs() << " User ms: " << ms(usage.ru_utime) << " System ms: " << ms(usage.ru_stime)
+									<< " Max RSS KB: " << usage.ru_maxrss << " Minor faults: " << usage.ru_minflt << " Major faults: " << usage.ru_majflt
+									<< " Voluntary switches: " << usage.ru_nvcsw << " Involuntary switches: " << usage.ru_nivcsw << "\n";
+						}
+
+			bool		writeJson(const char * cstrFilename)
+						{
+							struct rusage usage;
+							FILE * pFile;
+							unsigned int i;
+
+							if ((pFile = fopen(cstrFilename, "w")) == NULL)
+								return false;
+
+							getrusage(RUSAGE_SELF, &usage);
+
+							fprintf(pFile, "{\n\t\"phases\": {");
+							for (i = 0; i < PHASE_COUNT; i++)
+								fprintf(pFile, "%s\n\t\t\"%s\": {\"calls\": %llu, \"ms\": %.3f}", (i > 0) ? "," : "", phaseName((stats_phase)i),
+										(unsigned long long)phaseCalls[i], phaseNs[i] / 1e6);
+							fprintf(pFile, "\n\t},\n\t\"counters\": {");
+							for (i = 0; i < COUNT_COUNT; i++)
+								fprintf(pFile, "%s\n\t\t\"%s\": %llu", (i > 0) ? "," : "", counterName((stats_counter)i), (unsigned long long)counters[i]);
+							fprintf(pFile, "\n\t},\n\t\"process\": {\"wallMs\": %.3f, \"userMs\": %.3f, \"systemMs\": %.3f, \"maxRssKb\": %ld, "
+									"\"minorFaults\": %ld, \"majorFaults\": %ld, \"voluntarySwitches\": %ld, \"involuntarySwitches\": %ld}\n}\n",
+									wallMs(), ms(usage.ru_utime), ms(usage.ru_stime), usage.ru_maxrss, usage.ru_minflt, usage.ru_majflt,
+									usage.ru_nvcsw, usage.ru_nivcsw);
+							fclose(pFile);
+
+							return true;
+						}
+
+	static	const char *	phaseName(stats_phase phase)
+						{
+							static const char * names[PHASE_COUNT] = { "open", "parse", "build", "randomise", "train", "run", "test",
+																		"callback", "save", "write" };
+							return names[phase];
+						}
+
+	static	const char *	counterName(stats_counter counter)
+						{
+							static const char * names[COUNT_COUNT] = { "rowsTrained", "rowsRun", "rowsTested", "linksVisited",
+																		"linesParsed", "bytesParsed", "bytesSaved" };
+							return names[counter];
+						}
+
+	private:
+						runStats()
+						{
+							unsigned int i;
+
+							enabled = false;
+							for (i = 0; i < PHASE_COUNT; i++)
+								phaseNs[i] = phaseCalls[i] = 0;
+							for (i = 0; i < COUNT_COUNT; i++)
+								counters[i] = 0;
+						}
+
+			double		wallMs() { return enabled ? chrono::duration<double, milli>(chrono::steady_clock::now() - started).count() : 0.0; }
+	static	double		ms(struct timeval & tv) { return tv.tv_sec * 1e3 + tv.tv_usec / 1e3; }
+
+	private:
+	bool				enabled;
+	chrono::steady_clock::time_point started;
+	atomic<unsigned long long>	phaseNs[PHASE_COUNT];
+	atomic<unsigned long long>	phaseCalls[PHASE_COUNT];
+	atomic<unsigned long long>	counters[COUNT_COUNT];
+};
+
+class statsTimer	// adds the time between construction and destruction to a phase
+{
+	public:
+						statsTimer(stats_phase timedPhase)
+						{
+							phase = timedPhase;
+							timing = runStats::global().isEnabled();
+							if (timing)
+								start = chrono::steady_clock::now();
+						}
+
+						~statsTimer()
+						{
+							if (timing)
+								runStats::global().addPhase(phase, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+						}
+
+	private:
+	stats_phase			phase;
+	bool				timing;
+	chrono::steady_clock::time_point start;
+};
+
+#define STATS_JOIN(a, b)			a##b
+#define STATS_NAME(a, b)			STATS_JOIN(a, b)
+#define STATS_PHASE(phase)			statsTimer STATS_NAME(phaseTimer_, __LINE__)(phase)
+#define STATS_COUNT(counter, n)		runStats::global().count(counter, n)
+
+#else
+
+#define STATS_PHASE(phase)
+#define STATS_COUNT(counter, n)
+
+#endif	// _STATS_
+
+#endif	// _runStats_h
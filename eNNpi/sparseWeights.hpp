@@ -0,0 +1,206 @@
+#ifndef _sparseWeights_h
+#define _sparseWeights_h
+
+#include <stdint.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPARSE_X86_KERNEL
+#endif
+#include "nnWeights.hpp"
+#include "networkFile.hpp"
+
+/*
+ * sparseWeights is a compressed sparse row (CSR) copy of a pruned network for inference (see nn::pruneBelow() and
+ * nn::pruneToTop()). Each layer keeps only the links that are not 0:
+ *
+ *	rowStart[node], rowStart[node + 1]	the range of the links into node
+ *	column[link]						the node the link comes from, in 16 bits
+ *	value[link]							its weight
+ *
+ * so a link costs 6 bytes rather than 4 and the copy is smaller than nnWeights below two thirds density, and the
+ * time to run a row falls with the number of links left. The input bias node weights are kept apart, one per hidden
+ * node, and are never pruned.
+ *
+ * The portable kernel walks each row in column order and makes the sums in the same order as nnWeights::run(),
+ * leaving out only terms that are 0, so the results are the same as the float network's. On x86 the copy also has an
+ * AVX2 kernel, built for AVX2 whatever the build flags and used when the processor has it (checked once per copy):
+ * rows of 8 or more links are gathered 8 at a time (vpgatherdps) into 8 partial sums, which is quicker for wide
+ * layers but adds the terms up in a different order, so the results may differ in the last bits.
+ *
+ * Make one from nnWeights or from a network file, usually one saved sparse by a pruned network.
+ */
+
+const char ENN_ERR_SPARSE_TOO_WIDE[] = "A layer has too many nodes for a sparse copy (65536 at most)";
+
+class sparseWeights
+{
+	public:
+	typedef float		scratchType;
+
+						sparseWeights(const nnWeights & source)
+						{
+							setWeights(source);
+						}
+
+						sparseWeights(networkFile * nFile)
+						{
+							nnWeights floatWeights(nFile);
+							setWeights(floatWeights);
+						}
+
+	// run
+			void		run(const float * inputVector, float * scratch, float * outputVector) const
+			/*
+			 * scratch has room for scratchSize() values and outputVector for outputNodes() values
+			 */
+						{
+							unsigned int h, o;
+							float activationQuantity;
+
+							for (h = 0; h < hidNodes; h++)
+							{
+								activationQuantity = rowSum(hidden, h, inputVector, vectorKernel);
+								if (hasBias)
+									activationQuantity += hidBiasLinks[h] * (float)1.0;
+								scratch[h] = nnWeights::f(hidBiases[h] + activationQuantity);
+							}
+
+							for (o = 0; o < outNodes; o++)
+								outputVector[o] = nnWeights::f(outBiases[o] + rowSum(output, o, scratch, vectorKernel));
+						}
+
+	// access
+			unsigned int standardInputNodes() const { return stdInNodes; }
+			unsigned int hiddenNodes() const { return hidNodes; }
+			unsigned int outputNodes() const { return outNodes; }
+			unsigned int scratchSize() const { return hidNodes; }
+
+			size_t		links() const { return hidden.value.size() + output.value.size(); }
+			size_t		denseLinks() const { return (size_t)hidNodes * stdInNodes + (size_t)outNodes * hidNodes; }	// not counting bias node links
+			double		density() const { return (denseLinks() > 0) ? (double)links() / denseLinks() : 1.0; }
+
+			size_t		weightBytes() const
+						{
+							return links() * (sizeof(float) + sizeof(uint16_t)) + (hidden.rowStart.size() + output.rowStart.size()) * sizeof(uint32_t)
+									+ (hidBiasLinks.size() + hidBiases.size() + outBiases.size()) * sizeof(float);
+						}
+
+			size_t		floatWeightBytes() const	// the same weights as in nnWeights
+						{
+							return ((size_t)hidNodes * (stdInNodes + (hasBias ? 1 : 0)) + hidNodes + (size_t)outNodes * hidNodes + outNodes) * sizeof(float);
+						}
+
+	private:
+	struct csrLayer
+	{
+		vector<uint32_t>	rowStart;		// one per node and one more for the end
+		vector<uint16_t>	column;
+		vector<float>		value;
+	};
+
+			void		setWeights(const nnWeights & source)
+						{
+							unsigned int h;
+
+							stdInNodes = source.standardInputNodes();
+							hidNodes = source.hiddenNodes();
+							outNodes = source.outputNodes();
+							hasBias = source.hasInputBiasNode();
+							vectorKernel = hasVectorKernel();
+							if ((stdInNodes > 65536) || (hidNodes > 65536))
+								throw format_Error(ENN_ERR_SPARSE_TOO_WIDE);
+
+							compress(source.hiddenWeights(), hidNodes, stdInNodes, source.inputNodes(), hidden);
+							compress(source.outputWeights(), outNodes, hidNodes, hidNodes, output);
+
+							hidBiasLinks.assign(hidNodes, 0.0);
+							if (hasBias)
+								for (h = 0; h < hidNodes; h++)
+									hidBiasLinks[h] = source.hiddenWeights()[(size_t)h * source.inputNodes() + stdInNodes];
+							hidBiases.assign(source.hiddenBiases(), source.hiddenBiases() + hidNodes);
+							outBiases.assign(source.outputBiases(), source.outputBiases() + outNodes);
+						}
+
+	static	void		compress(const float * weights, unsigned int rows, unsigned int columns, unsigned int stride, csrLayer & layer)
+						{
+							unsigned int r, c;
+
+							layer.rowStart.resize(rows + 1);
+							layer.column.clear();
+							layer.value.clear();
+							for (r = 0; r < rows; r++)
+							{
+								layer.rowStart[r] = layer.value.size();
+								for (c = 0; c < columns; c++)
+									if (weights[(size_t)r * stride + c] != 0.0)
+									{
+										layer.column.push_back((uint16_t)c);
+										layer.value.push_back(weights[(size_t)r * stride + c]);
+									}
+							}
+							layer.rowStart[rows] = layer.value.size();
+						}
+
+	static	float		rowSum(const csrLayer & layer, unsigned int row, const float * x, bool useVector)
+			/*
+			 * The sum of the row's weights times x, by the AVX2 kernel if useVector, else in column order
+			 */
+						{
+							uint32_t link = layer.rowStart[row];
+							uint32_t end = layer.rowStart[row + 1];
+							const uint16_t * column = layer.column.data();
+							const float * value = layer.value.data();
+							float sum = 0.0;
+
+#if defined(SPARSE_X86_KERNEL)
+							if (useVector && (end - link >= 8))
+								return rowSumGather(column, value, link, end, x);
+#endif
+							for (; link < end; link++)
+								sum += value[link] * x[column[link]];
+							return sum;
+						}
+
+#if defined(SPARSE_X86_KERNEL)
+	static	bool		hasVectorKernel() { return __builtin_cpu_supports("avx2"); }
+
+	static	float		rowSumGather(const uint16_t * column, const float * value, uint32_t link, uint32_t end, const float * x) __attribute__((target("avx2")))
+						{
+							__m256 sums = _mm256_setzero_ps();
+							__m128 half;
+							float sum;
+
+							for (; link + 8 <= end; link += 8)
+							{
+								__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(column + link)));
+								sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_loadu_ps(value + link), _mm256_i32gather_ps(x, index, sizeof(float))));
+							}
+							half = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+							half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+							half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+							sum = _mm_cvtss_f32(half);
+
+							for (; link < end; link++)
+								sum += value[link] * x[column[link]];
+							return sum;
+						}
+#else
+	static	bool		hasVectorKernel() { return false; }
+#endif
+
+	private:
+	unsigned int		stdInNodes;
+	unsigned int		hidNodes;
+	unsigned int		outNodes;
+	bool				hasBias;
+	bool				vectorKernel;		// rowSum() uses the AVX2 kernel
+
+	csrLayer			hidden;				// [hidden][standard input]
+	csrLayer			output;				// [output][hidden]
+	vector<float>		hidBiasLinks;		// the input bias node weight into each hidden node
+	vector<float>		hidBiases;
+	vector<float>		outBiases;
+};
+
+#endif	// _sparseWeights_h
@@ -0,0 +1,435 @@
+#ifndef _sweepEngine_h
+#define _sweepEngine_h
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <random>
+#include <string>
+#include <vector>
+#include "nn.hpp"
+#include "epochTrainer.hpp"
+#include "testMetrics.hpp"
+#include "threadPool.hpp"
+
+/*
+ * A hyperparameter sweep: train many candidate networks that differ in hidden width, learning rate, momentum and
+ * input bias node, and keep the best.
+ *
+ * sweepSpace describes the values to try, one key per hyperparameter separated by ;
+ *
+ *	hidden=2,4,8;lr=0.01:1;momentum=0,0.9;bias=0,1
+ *
+ * Each key takes either a list of values or a lo:hi range. A grid search tries every combination of the lists (so it
+ * needs lists only); a random search draws each key from its list, or from its range (log uniform for lr, uniform
+ * for the others). A key that is left out keeps the base network's value.
+ *
+ * sweepEngine runs the candidates with successive halving: every candidate that is still in the running trains
+ * for one rung of epochs, all of them in parallel on a threadPool, the loss of each is measured (the MSE over the
+ * validation file if there is one, else the training loss) and the worse half is dropped. The survivors train on
+ * from where they were for twice as many epochs in the next rung, until one candidate is left or the epoch budget
+ * is spent. The threadPool hands the candidates out one at a time as workers come free, so a slow (wide) candidate
+ * does not hold up the rest of a rung.
+ *
+ * Candidates are ranked by the last rung they reached and then by their loss in it. Each one is named
+ * <base name>_sweep<k> so that saveBest() can write the best of them side by side.
+ */
+
+const char ENN_ERR_SWEEP_SPACE[] = "Unknown sweep space, use key=v1,v2,... or key=lo:hi for hidden, lr, momentum and bias separated by ;";
+const char ENN_ERR_SWEEP_GRID_RANGE[] = "A grid sweep needs a list of values for every key, use a random search for ranges";
+const char ENN_ERR_SWEEP_TOPOLOGY[] = "The sweep training file does not fit the network";
+const char ENN_ERR_SWEEP_CANDIDATE[] = "Unknown exception training the candidate";
+
+enum sweep_key { SWEEP_HIDDEN, SWEEP_LR, SWEEP_MOMENTUM, SWEEP_BIAS, SWEEP_KEYS };
+
+struct sweepPoint
+{
+	unsigned int		hidden;
+	float				learningRate;
+	float				momentum;
+	bool				biasNode;
+};
+
+class sweepSpace
+{
+	public:
+						sweepSpace(const char * cstrSpec)
+						{
+							string spec = cstrSpec;
+							string part, key, values;
+							std::string::size_type start = 0, semi, equals, colon;
+							unsigned int k;
+
+							for (k = 0; k < SWEEP_KEYS; k++)
+								isRange[k] = false;
+
+							do
+							{
+								semi = spec.find(';', start);
+								part = spec.substr(start, (semi == std::string::npos) ? std::string::npos : semi - start);
+								start = semi + 1;
+								if (part.size() == 0)
+									continue;
+
+								equals = part.find('=');
+								if (equals == std::string::npos)
+									throw format_Error(ENN_ERR_SWEEP_SPACE);
+								key = part.substr(0, equals);
+								values = part.substr(equals + 1);
+
+								if (key == "hidden")
+									k = SWEEP_HIDDEN;
+								else if (key == "lr")
+									k = SWEEP_LR;
+								else if (key == "momentum")
+									k = SWEEP_MOMENTUM;
+								else if (key == "bias")
+									k = SWEEP_BIAS;
+								else
+									throw format_Error(ENN_ERR_SWEEP_SPACE);
+
+								colon = values.find(':');
+								if (colon != std::string::npos)
+								{
+									isRange[k] = true;
+									lists[k].push_back(atof(values.substr(0, colon).c_str()));
+									lists[k].push_back(atof(values.substr(colon + 1).c_str()));
+								}
+								else
+									splitList(values, &lists[k]);
+
+								if (lists[k].size() == 0)
+									throw format_Error(ENN_ERR_SWEEP_SPACE);
+							}
+							while (semi != std::string::npos);
+						}
+
+			vector<sweepPoint> grid(const sweepPoint & base)
+			/*
+			 * Every combination of the listed values, hidden varying slowest
+			 */
+						{
+							vector<sweepPoint> points;
+							vector<double> values[SWEEP_KEYS];
+							sweepPoint point;
+							size_t h, l, m, b;
+							unsigned int k;
+
+							for (k = 0; k < SWEEP_KEYS; k++)
+							{
+								if (isRange[k])
+									throw format_Error(ENN_ERR_SWEEP_GRID_RANGE);
+								values[k] = lists[k];
+								if (values[k].size() == 0)
+									values[k].push_back(baseValue(base, (sweep_key)k));
+							}
+
+							for (h = 0; h < values[SWEEP_HIDDEN].size(); h++)
+								for (l = 0; l < values[SWEEP_LR].size(); l++)
+									for (m = 0; m < values[SWEEP_MOMENTUM].size(); m++)
+										for (b = 0; b < values[SWEEP_BIAS].size(); b++)
+										{
+											point.hidden = (unsigned int)values[SWEEP_HIDDEN][h];
+											point.learningRate = (float)values[SWEEP_LR][l];
+											point.momentum = (float)values[SWEEP_MOMENTUM][m];
+											point.biasNode = (values[SWEEP_BIAS][b] != 0);
+											points.push_back(point);
+										}
+							return points;
+						}
+
+			vector<sweepPoint> sample(const sweepPoint & base, unsigned int count, unsigned long seed)
+			/*
+			 * count points drawn at random from the space, the same ones for the same seed
+			 */
+						{
+							vector<sweepPoint> points;
+							sweepPoint point;
+							mt19937 gen(seed);
+							unsigned int i;
+
+							for (i = 0; i < count; i++)
+							{
+								point.hidden = (unsigned int)lround(draw(gen, SWEEP_HIDDEN, base));
+								point.learningRate = (float)draw(gen, SWEEP_LR, base);
+								point.momentum = (float)draw(gen, SWEEP_MOMENTUM, base);
+								point.biasNode = (lround(draw(gen, SWEEP_BIAS, base)) != 0);
+								if (point.hidden == 0)
+									point.hidden = 1;
+								points.push_back(point);
+							}
+							return points;
+						}
+
+	private:
+	static	void		splitList(const string & values, vector<double> * list)
+						{
+							std::string::size_type start = 0, comma;
+
+							do
+							{
+								comma = values.find(',', start);
+								list->push_back(atof(values.substr(start, (comma == std::string::npos) ? std::string::npos : comma - start).c_str()));
+								start = comma + 1;
+							}
+							while (comma != std::string::npos);
+						}
+
+	static	double		baseValue(const sweepPoint & base, sweep_key k)
+						{
+							switch (k)
+							{
+								case SWEEP_HIDDEN:		return base.hidden;
+								case SWEEP_LR:			return base.learningRate;
+								case SWEEP_MOMENTUM:	return base.momentum;
+								default:				return base.biasNode ? 1 : 0;
+							}
+						}
+
+			double		draw(mt19937 & gen, sweep_key k, const sweepPoint & base)
+						{
+							double lo, hi;
+
+							if (lists[k].size() == 0)
+								return baseValue(base, k);
+							if (!isRange[k])
+								return lists[k][uniform_int_distribution<size_t>(0, lists[k].size() - 1)(gen)];
+
+							lo = lists[k][0];
+							hi = lists[k][1];
+							if ((k == SWEEP_LR) && (lo > 0) && (hi > 0))
+								return exp(uniform_real_distribution<double>(log(lo), log(hi))(gen));
+							return uniform_real_distribution<double>(lo, hi)(gen);
+						}
+
+	private:
+	vector<double>		lists[SWEEP_KEYS];		// the values, or lo and hi for a range
+	bool				isRange[SWEEP_KEYS];
+};
+
+struct sweepCandidate
+{
+	sweepPoint			point;
+	string				networkName;
+	nn				*	net;				// NULL if it failed
+	double				loss;				// in the last rung it trained in
+	unsigned int		epochs;				// trained in total
+	unsigned int		rung;				// the last rung it trained in, 1 for the first
+	double				elapsedMs;			// training and measuring, over every rung
+	string				error;				// empty unless it failed
+};
+
+class sweepEngine
+{
+	public:
+						sweepEngine(trainingFile * newTrainingFile, trainingFile * newValidationFile = NULL) : trRows(newTrainingFile)
+						{
+							validationFile = newValidationFile;
+							firstRungEpochs = 1;
+							maxEpochs = 16;
+							workerCount = 0;
+						}
+
+						~sweepEngine()
+						{
+							clearCandidates();
+						}
+
+	// setup
+			void		setSchedule(unsigned int firstEpochs, unsigned int epochBudget)	// epochs in the first rung, most epochs per candidate
+						{
+							firstRungEpochs = (firstEpochs > 0) ? firstEpochs : 1;
+							maxEpochs = (epochBudget > firstRungEpochs) ? epochBudget : firstRungEpochs;
+						}
+
+			void		setThreads(unsigned int threads) { workerCount = threads; }		// 0 (the default) is one per hardware thread
+
+	// run
+			void		run(nn * baseNet, vector<sweepPoint> & points)
+			/*
+			 * Build a candidate for every point, with the base network's widths and name, and race them. baseNet is not changed.
+			 */
+						{
+							network_description baseDescription = *baseNet->networkDescription();
+							vector<unsigned int> alive;
+							unsigned int rungEpochs = firstRungEpochs;
+							unsigned int trained = 0;
+							unsigned int rung = 0;
+							unsigned int c, threads;
+
+							if ((trRows.inputLines() == 0) || (trRows.inputSet(0)->size() != baseDescription.standardInputNodes())
+									|| (trRows.outputSet(0)->size() != baseDescription.outputNodes()))
+								throw format_Error(ENN_ERR_SWEEP_TOPOLOGY);
+
+							clearCandidates();
+							candidates.resize(points.size());
+							for (c = 0; c < points.size(); c++)
+							{
+								candidates[c].point = points[c];
+								candidates[c].networkName = baseDescription.networkName() + "_sweep" + to_string(c + 1);
+								candidates[c].net = NULL;
+								candidates[c].loss = -1.0;
+								candidates[c].epochs = candidates[c].rung = 0;
+								candidates[c].elapsedMs = 0.0;
+								candidates[c].error.clear();
+								alive.push_back(c);
+							}
+
+							threads = (workerCount == 0) ? threadPool::hardwareThreads() : workerCount;
+							threadPool pool(threads);
+
+							while (alive.size() > 0)
+							{
+								rung++;
+								pool.run(alive.size(), [&](unsigned int worker, size_t task)
+								{
+									trainCandidate(candidates[alive[task]], baseDescription, rung, rungEpochs);
+								});
+								trained += rungEpochs;
+
+								alive.erase(remove_if(alive.begin(), alive.end(), [this](unsigned int a) { return !candidates[a].error.empty(); }), alive.end());
+								if ((alive.size() <= 1) || (trained >= maxEpochs))
+									break;
+
+								sort(alive.begin(), alive.end(), [this](unsigned int a, unsigned int b) { return candidates[a].loss < candidates[b].loss; });
+								alive.resize((alive.size() + 1) / 2);
+
+								rungEpochs = min(rungEpochs * 2, maxEpochs - trained);
+							}
+
+							ranked.clear();
+							for (c = 0; c < candidates.size(); c++)
+								ranked.push_back(c);
+							sort(ranked.begin(), ranked.end(), [this](unsigned int a, unsigned int b)
+							{
+								if (candidates[a].error.empty() != candidates[b].error.empty())
+									return candidates[a].error.empty();
+								if (candidates[a].rung != candidates[b].rung)
+									return candidates[a].rung > candidates[b].rung;
+								return candidates[a].loss < candidates[b].loss;
+							});
+						}
+
+			unsigned int saveBest(unsigned int count, const char * cstrPath)
+			/*
+			 * Save the best count candidates on cstrPath, returns how many were saved
+			 */
+						{
+							unsigned int i, saved = 0;
+
+							for (i = 0; (i < ranked.size()) && (saved < count); i++)
+								if (candidates[ranked[i]].net != NULL)
+								{
+									candidates[ranked[i]].net->saveTo(cstrPath);
+									saved++;
+								}
+							return saved;
+						}
+
+	// access
+			unsigned int candidateCount() { return (unsigned int)candidates.size(); }
+			sweepCandidate & candidate(unsigned int rank) { return candidates[ranked[rank]]; }		// 0 is the best
+
+			void		writeOn(ostream & outStr)
+			/*
+			 * The summary table, best first
+			 */
+						{
+							unsigned int i;
+
+							outStr << "Rank\tNetwork\tHidden\tLR\tMomentum\tBias\tRung\tEpochs\t" << (validationFile != NULL ? "Validation MSE" : "Training loss") << "\tms\n";
+							for (i = 0; i < ranked.size(); i++)
+							{
+								sweepCandidate & c = candidates[ranked[i]];
+
+								outStr << i + 1 << "\t" << c.networkName << "\t" << c.point.hidden << "\t" << c.point.learningRate << "\t" << c.point.momentum
+										<< "\t" << (c.point.biasNode ? "yes" : "no") << "\t" << c.rung << "\t" << c.epochs << "\t";
+								if (!c.error.empty())
+									outStr << "Error: " << c.error;
+								else
+									outStr << c.loss;
+								outStr << "\t" << c.elapsedMs << "\n";
+							}
+						}
+
+	private:
+			void		trainCandidate(sweepCandidate & c, network_description baseDescription, unsigned int rung, unsigned int epochs)
+			/*
+			 * Runs on a worker thread: build the candidate in its first rung, then train it on for epochs and measure it.
+			 * Exceptions must not escape, a failure is recorded in the candidate instead.
+			 */
+						{
+							chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+							try
+							{
+								if (c.net == NULL)
+								{
+									baseDescription.setNetworkName(c.networkName);
+									baseDescription.setHiddenNodes(c.point.hidden);
+									baseDescription.setInputLayerBiasNode(c.point.biasNode);
+									c.net = new nn(baseDescription);		// deleted in clearCandidates()
+									c.net->setLearningRate(c.point.learningRate);
+									c.net->setMomentum(c.point.momentum);
+								}
+
+								epochTrainer trainer(c.net, trRows);
+								trainer.setMaxEpochs(epochs);
+								trainer.setSeed((unsigned long)(&c - candidates.data()) * 1000 + rung);
+								trainer.run();
+
+								if (validationFile != NULL)
+								{
+									testMetrics metrics(c.net->outputNodes());
+
+									c.net->test(validationFile, NULL, &metrics);
+									c.loss = metrics.mse();
+								}
+								else
+									c.loss = trainer.bestLossSeen();
+								c.epochs += epochs;
+								c.rung = rung;
+							}
+							catch (format_Error & e)
+							{
+								c.error = e.mesg;
+							}
+							catch (internal_Error & e)
+							{
+								c.error = e.mesg;
+							}
+							catch (std::exception & e)			// bad_alloc from a wide candidate among them
+							{
+								c.error = e.what();
+							}
+							catch (...)
+							{
+								c.error = ENN_ERR_SWEEP_CANDIDATE;
+							}
+
+							c.elapsedMs += chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+						}
+
+			void		clearCandidates()
+						{
+							for (sweepCandidate & c : candidates)
+								if (c.net != NULL)
+									delete c.net;
+							candidates.clear();
+							ranked.clear();
+						}
+
+	private:
+	trainingView		trRows;
+	trainingFile	*	validationFile;		// not owned
+	unsigned int		firstRungEpochs;
+	unsigned int		maxEpochs;
+	unsigned int		workerCount;
+
+	vector<sweepCandidate> candidates;		// each written only by the worker training it during a rung
+	vector<unsigned int> ranked;			// candidate indexes, best first
+};
+
+#endif	// _sweepEngine_h
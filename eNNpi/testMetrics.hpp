@@ -0,0 +1,225 @@
+#ifndef _testMetrics_h
+#define _testMetrics_h
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "errStruct.hpp"
+
+using namespace std ;
+
+enum metric_class { CLASS_ARGMAX, CLASS_THRESHOLD };
+
+/*
+ * testMetrics accumulates the error statistics of a test run one row at a time so that nothing
+ * but the summary has to be written out.
+ *
+ * For every output node it keeps the mean squared error, the mean absolute error and the largest
+ * absolute error. Each row is also classified, either by
+ *	CLASS_ARGMAX		the class is the output node with the highest value (one output node per class)
+ *	CLASS_THRESHOLD		every output node is a yes/no answer: yes if its value is >= the threshold
+ *
+ * and counted in a confusion matrix [desired class][actual class]. With CLASS_THRESHOLD there are two
+ * classes (0 = no, 1 = yes) summed over all of the output nodes and a row is only correct if all of its
+ * output nodes are. A single output node has nothing to take the argmax over, so CLASS_ARGMAX falls back to
+ * CLASS_THRESHOLD for it.
+ *
+ * The sigmoid output of the net lies in (0, 1). If the desired values use -1 and +1 instead (the Shuttle
+ * files do) set signTargets and they are mapped onto 0 and 1 before the errors are calculated.
+ *
+ * Nothing is allocated once the object has been constructed.
+ */
+
+class testMetrics
+{
+	public:
+						testMetrics(unsigned int outputNodes, metric_class mode = CLASS_ARGMAX, float classThreshold = 0.5, bool isSignTargets = false)
+						{
+							outputs = outputNodes;
+							classMode = ((mode == CLASS_ARGMAX) && (outputs == 1)) ? CLASS_THRESHOLD : mode;	// argmax of one node is always 0
+							threshold = classThreshold;
+							signTargets = isSignTargets;
+							classes = (classMode == CLASS_ARGMAX) ? outputs : 2;
+
+							sumSquared.resize(outputs);
+							sumAbsolute.resize(outputs);
+							maxAbsolute.resize(outputs);
+							confusion.resize(classes * classes);
+							reset();
+						}
+
+			void		reset()
+						{
+							rows = correctRows = 0;
+							sumSquared.assign(outputs, 0.0);
+							sumAbsolute.assign(outputs, 0.0);
+							maxAbsolute.assign(outputs, 0.0);
+							confusion.assign(classes * classes, 0);
+						}
+
+			void		add(const float * desiredVector, const float * actualVector)
+			/*
+			 * Add one row: the desired output from the training file and the actual output of the net
+			 */
+						{
+							unsigned int i;
+							float desired;
+							double diff;
+							bool allCorrect = true;
+							unsigned int desiredClass, actualClass;
+
+							for (i = 0; i < outputs; i++)
+							{
+								desired = target(desiredVector[i]);
+								diff = fabs((double)actualVector[i] - desired);
+								sumSquared[i] += diff * diff;
+								sumAbsolute[i] += diff;
+								if (diff > maxAbsolute[i])
+									maxAbsolute[i] = diff;
+
+								if (classMode == CLASS_THRESHOLD)
+								{
+									desiredClass = (desired >= threshold) ? 1 : 0;
+									actualClass = (actualVector[i] >= threshold) ? 1 : 0;
+									confusion[desiredClass * classes + actualClass]++;
+									if (desiredClass != actualClass)
+										allCorrect = false;
+								}
+							}
+
+							if (classMode == CLASS_ARGMAX)
+							{
+								desiredClass = argmax(desiredVector);
+								actualClass = argmax(actualVector);
+								confusion[desiredClass * classes + actualClass]++;
+								allCorrect = (desiredClass == actualClass);
+							}
+
+							if (allCorrect)
+								correctRows++;
+							rows++;
+						}
+
+			void		merge(testMetrics & other)	// add the counts from another object with the same settings
+						{
+							unsigned int i;
+
+							rows += other.rows;
+							correctRows += other.correctRows;
+							for (i = 0; i < outputs; i++)
+							{
+								sumSquared[i] += other.sumSquared[i];
+								sumAbsolute[i] += other.sumAbsolute[i];
+								if (other.maxAbsolute[i] > maxAbsolute[i])
+									maxAbsolute[i] = other.maxAbsolute[i];
+							}
+							for (i = 0; i < classes * classes; i++)
+								confusion[i] += other.confusion[i];
+						}
+
+	// access
+			unsigned long	rowCount() { return rows; }
+			double		accuracy() { return (rows == 0) ? 0.0 : (double)correctRows / rows; }
+			double		mse(unsigned int output) { return (rows == 0) ? 0.0 : sumSquared[output] / rows; }
+			double		mae(unsigned int output) { return (rows == 0) ? 0.0 : sumAbsolute[output] / rows; }
+			double		maxError(unsigned int output) { return maxAbsolute[output]; }
+			double		mse()	// averaged over all the output nodes
+						{
+							unsigned int i;
+							double total = 0.0;
+
+							for (i = 0; i < outputs; i++)
+								total += mse(i);
+							return (outputs == 0) ? 0.0 : total / outputs;
+						}
+			unsigned long	confusionCount(unsigned int desiredClass, unsigned int actualClass) { return confusion[desiredClass * classes + actualClass]; }
+			unsigned int	classCount() { return classes; }
+
+			void		writeOn(ostream & outStr)
+			/*
+			 * Write a compact summary: one line of totals, one line per output node and the confusion matrix
+			 */
+						{
+							unsigned int i, j;
+
+							outStr << "Rows: " << rows << " Correct: " << correctRows << " Accuracy: " << accuracy() << " MSE: " << mse() << "\n";
+							outStr << "Output\tMSE\tMAE\tMax\n";
+							for (i = 0; i < outputs; i++)
+								outStr << i << "\t" << mse(i) << "\t" << mae(i) << "\t" << maxError(i) << "\n";
+
+							outStr << "Confusion (row: desired, column: actual)\n";
+							for (i = 0; i < classes; i++)
+							{
+								outStr << i;
+								for (j = 0; j < classes; j++)
+									outStr << "\t" << confusionCount(i, j);
+								outStr << "\n";
+							}
+						}
+
+	static	testMetrics *	fromSpec(const char * cstrSpec, unsigned int outputNodes)
+			/*
+			 * Create a new object from a -metrics argument: argmax, threshold or threshold:0.7 optionally
+			 * followed by +sign for -1/+1 desired values, e.g. argmax+sign. argmax is threshold (0.5) for a single
+			 * output node. The caller must delete it.
+			 */
+						{
+							string spec = cstrSpec;
+							bool isSign = false;
+							float classThreshold = 0.5;
+							std::string::size_type plusPos;
+
+							plusPos = spec.find('+');
+							if (plusPos != std::string::npos)
+							{
+								if (spec.substr(plusPos + 1) != "sign")
+									throw format_Error(ENN_ERR_UNK_METRICS);
+								isSign = true;
+								spec = spec.substr(0, plusPos);
+							}
+
+							if (spec == "argmax")
+								return new testMetrics(outputNodes, CLASS_ARGMAX, classThreshold, isSign);
+
+							if (spec.compare(0, 9, "threshold") == 0)
+							{
+								if (spec.size() > 10)
+									classThreshold = (float)atof(spec.c_str() + 10);
+								return new testMetrics(outputNodes, CLASS_THRESHOLD, classThreshold, isSign);
+							}
+
+							throw format_Error(ENN_ERR_UNK_METRICS);
+						}
+
+	private:
+			float		target(float desired) { return signTargets ? (desired + (float)1.0) * (float)0.5 : desired; }
+
+			unsigned int argmax(const float * vec)
+						{
+							unsigned int i, best = 0;
+
+							for (i = 1; i < outputs; i++)
+								if (vec[i] > vec[best])
+									best = i;
+							return best;
+						}
+
+	private:
+	unsigned int		outputs;
+	unsigned int		classes;
+	metric_class		classMode;
+	float				threshold;
+	bool				signTargets;
+
+	unsigned long		rows;
+	unsigned long		correctRows;
+	vector<double>		sumSquared;			// per output node
+	vector<double>		sumAbsolute;		//	"
+	vector<double>		maxAbsolute;		//	"
+	vector<unsigned long> confusion;		// [desired class][actual class]
+};
+
+#endif	// _testMetrics_h
@@ -0,0 +1,147 @@
+#ifndef _threadPool_h
+#define _threadPool_h
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+using namespace std ;
+
+/*
+ * threadPool is a fixed set of worker threads that share out a batch of numbered tasks.
+ *
+ *	start(taskCount, work)	hands out the tasks 0..taskCount-1 and returns straight away
+ *	wait()					blocks until every task in the batch has finished
+ *	run(taskCount, work)	start() followed by wait()
+ *
+ * work is called as work(workerIndex, taskIndex). workerIndex is in the range 0..workers()-1 and a
+ * worker only ever runs one task at a time, so it can be used to pick per worker scratch space.
+ *
+ * Only one batch can be in flight at a time. The calling thread does not run tasks itself, which
+ * leaves it free to deal with the results of the previous batch while the next one runs.
+ */
+
+class threadPool
+{
+	public:
+						threadPool(unsigned int workerCount = 0)	// 0 means one worker per hardware thread
+						{
+							unsigned int i;
+
+							if (workerCount == 0)
+								workerCount = hardwareThreads();
+
+							stopping = false;
+							batch = 0;
+							taskCount = 0;
+							tasksDone = 0;
+							busyWorkers = 0;
+							nextTask = 0;
+
+							for (i = 0; i < workerCount; i++)
+								workerThreads.push_back(thread(&threadPool::workLoop, this, i));
+						}
+
+						~threadPool()
+						{
+							{
+								lock_guard<mutex> guard(poolLock);
+								stopping = true;
+							}
+							batchReady.notify_all();
+
+							for (thread & t : workerThreads)
+								t.join();
+						}
+
+			void		start(size_t tasks, function<void(unsigned int, size_t)> work)
+						{
+							unique_lock<mutex> guard(poolLock);		// one lock for the wait and the new batch, so no worker can join the old batch in between
+
+							batchDone.wait(guard, [this] { return (tasksDone == taskCount) && (busyWorkers == 0); });
+							currentWork = work;
+							taskCount = tasks;
+							tasksDone = 0;
+							nextTask = 0;
+							batch++;
+							batchReady.notify_all();
+						}
+
+			void		wait()
+						{
+							unique_lock<mutex> guard(poolLock);
+							batchDone.wait(guard, [this] { return (tasksDone == taskCount) && (busyWorkers == 0); });
+						}
+
+			void		run(size_t tasks, function<void(unsigned int, size_t)> work)
+						{
+							start(tasks, work);
+							wait();
+						}
+
+			unsigned int workers() { return (unsigned int)workerThreads.size(); }
+
+	static	unsigned int hardwareThreads()
+						{
+							unsigned int n = thread::hardware_concurrency();
+							return (n == 0) ? 1 : n;
+						}
+
+	private:
+			void		workLoop(unsigned int workerIndex)
+						{
+							unsigned long seenBatch = 0;
+							const function<void(unsigned int, size_t)> * work;
+							size_t tasks;
+							size_t task;
+							size_t done;
+
+							for (;;)
+							{
+								{
+									unique_lock<mutex> guard(poolLock);
+									batchReady.wait(guard, [&] { return stopping || (batch != seenBatch); });
+									if (stopping)
+										return;
+									seenBatch = batch;
+									busyWorkers++;		// so that the next batch cannot replace currentWork while this worker is using it
+									work = &currentWork;
+									tasks = taskCount;
+								}
+
+								done = 0;
+								while ((task = nextTask++) < tasks)
+								{
+									(*work)(workerIndex, task);
+									done++;
+								}
+
+								{
+									lock_guard<mutex> guard(poolLock);
+									tasksDone += done;
+									busyWorkers--;
+									if ((tasksDone == taskCount) && (busyWorkers == 0))
+										batchDone.notify_all();
+								}
+							}
+						}
+
+	private:
+	vector<thread>		workerThreads;
+	mutex				poolLock;
+	condition_variable	batchReady;
+	condition_variable	batchDone;
+	bool				stopping;
+	unsigned long		batch;			// incremented by start() to wake the workers
+
+	function<void(unsigned int, size_t)>	currentWork;
+	size_t				taskCount;
+	size_t				tasksDone;		// guarded by poolLock
+	unsigned int		busyWorkers;	//	"
+	atomic<size_t>		nextTask;
+};
+
+#endif	// _threadPool_h
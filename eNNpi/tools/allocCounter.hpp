@@ -0,0 +1,107 @@
+#ifndef _allocCounter_h
+#define _allocCounter_h
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+using namespace std ;
+
+/*
+ * allocCounter replaces the global operator new and delete so that a tool can count every heap allocation
+ * made by eNNpi, including the ones inside the standard library.
+ *
+ * Include this file in exactly one translation unit of a tool, never in the eNNpi application itself.
+ *
+ *	allocCounter::mark()		take a snapshot of the counts
+ *	allocCounter::since(mark)	the allocations, bytes and frees made since the snapshot
+ *
+ * The counts are totals over all of the threads.
+ */
+
+struct allocCounts
+{
+	unsigned long long	allocs;
+	unsigned long long	bytes;
+	unsigned long long	frees;
+};
+
+class allocCounter
+{
+	public:
+	static	allocCounts	mark()
+						{
+							allocCounts counts;
+
+							counts.allocs = allocs.load(memory_order_relaxed);
+							counts.bytes = bytes.load(memory_order_relaxed);
+							counts.frees = frees.load(memory_order_relaxed);
+							return counts;
+						}
+
+	static	allocCounts	since(const allocCounts & start)
+						{
+							allocCounts counts = mark();
+
+							counts.allocs -= start.allocs;
+							counts.bytes -= start.bytes;
+							counts.frees -= start.frees;
+							return counts;
+						}
+
+	// never inlined into the replacement operators, or GCC pairs the malloc and free it can see with new and delete
+	// and warns -Wmismatched-new-delete
+	__attribute__((noinline)) static void * allocate(size_t size)
+						{
+							void * p;
+
+							allocs.fetch_add(1, memory_order_relaxed);
+							bytes.fetch_add(size, memory_order_relaxed);
+							p = malloc((size == 0) ? 1 : size);
+							return p;
+						}
+
+	__attribute__((noinline)) static void release(void * p)
+						{
+							if (p != NULL)
+							{
+								frees.fetch_add(1, memory_order_relaxed);
+								free(p);
+							}
+						}
+
+	private:
+	inline static atomic<unsigned long long> allocs { 0 };
+	inline static atomic<unsigned long long> bytes { 0 };
+	inline static atomic<unsigned long long> frees { 0 };
+};
+
+void * operator new(size_t size)
+{
+	void * p = allocCounter::allocate(size);
+
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+void * operator new[](size_t size)
+{
+	void * p = allocCounter::allocate(size);
+
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+void * operator new(size_t size, const nothrow_t &) noexcept { return allocCounter::allocate(size); }
+void * operator new[](size_t size, const nothrow_t &) noexcept { return allocCounter::allocate(size); }
+
+void operator delete(void * p) noexcept { allocCounter::release(p); }
+void operator delete[](void * p) noexcept { allocCounter::release(p); }
+void operator delete(void * p, size_t) noexcept { allocCounter::release(p); }
+void operator delete[](void * p, size_t) noexcept { allocCounter::release(p); }
+void operator delete(void * p, const nothrow_t &) noexcept { allocCounter::release(p); }
+void operator delete[](void * p, const nothrow_t &) noexcept { allocCounter::release(p); }
+
+#endif	// _allocCounter_h
@@ -0,0 +1,614 @@
+/*
+ * bench - reproducible timings for each stage of eNNpi
+ *
+ *	run/<topology>/nn		forward pass per row through the node and link objects (nn::run)
+ *	run/<topology>/flat		forward pass per row through an nnWeights snapshot
+ *	run/<topology>/int8		forward pass per row through a quantizedWeights copy calibrated on the run rows
+ *	run/<topology>/fp16		forward pass per row through a halfWeights copy, and /bf16 likewise
+ *	run/<topology>/csr<d>	forward pass per row through a sparseWeights copy with the smallest weights pruned to d%
+ *							density (50, 25, 10 and 5), to set against /flat
+ *	train/<topology>		one training step per row (nn::train)
+ *	parse/<file>			readInFile of every .tr and .dat file under the test data directory
+ *	save/<topology>			nn::saveOn
+ *	load/<topology>			networkFile::readInFile and nn construction from a saved file
+ *	converge/<file>/<algo>	epochs and wall time for a seeded network to train to convergeTarget on a test data file,
+ *							by the network's own SGD (epochTrainer) and by iRPROP+ (rpropTrainer), over convergeSeeds
+ *							seeds. Written as a table of its own: how many runs reached the target and the median
+ *							epochs and ms of those that did
+ *
+ * The topologies are the ones in testData (xor 2-2-1, binary 2-3-3, Shuttle 7-7-5) plus two synthetic
+ * wide ones. Weights and rows come from a fixed seed so every run does exactly the same work.
+ *
+ * With -alloc the timings are replaced by an allocation check. Each stage is run once to warm up and then
+ * on files of allocRows and 2 * allocRows rows, counting every operator new. The difference between the two
+ * is what the stage allocates per row. The run, train and test loops (on one thread and on a pool) must not
+ * allocate anything per row; bench -alloc exits with 1 if any of them do. Parse, save and load are reported
+ * but not checked. The alloccheck target in makefile.targets (part of make tools) runs it.
+ *
+ * bench [-data %dir] [-json %file] [-filter %text] [-warmup %n] [-samples %n] [-alloc]
+ */
+
+#include <dirent.h>
+#include <unistd.h>
+#include "../nn.hpp"
+#include "../quantizedWeights.hpp"
+#include "../halfWeights.hpp"
+#include "../sparseWeights.hpp"
+#include "../epochTrainer.hpp"
+#include "../rpropTrainer.hpp"
+#include "benchmark.hpp"
+#include "dataGenerator.hpp"
+#include "allocCounter.hpp"
+
+struct benchTopology
+{
+	const char	*	name;
+	int				inputs;
+	int				hidden;
+	int				outputs;
+};
+
+const benchTopology benchTopologies[] =
+{
+	{ "xor-2-2-1", 2, 2, 1 },
+	{ "binary-2-3-3", 2, 3, 3 },
+	{ "shuttle-7-7-5", 7, 7, 5 },
+	{ "wide-32-64-8", 32, 64, 8 },
+	{ "wide-64-256-16", 64, 256, 16 }
+};
+
+const unsigned int benchRows = 1024;		// rows per timed call for the run and train benchmarks
+const unsigned int benchSeed = 20131208;
+
+nn * seededNet(const benchTopology & topo, mt19937 & gen)
+/*
+ * Create a network and give it weights from gen rather than the random_device so every run is the same
+ */
+{
+	string name = topo.name;
+	nn * theNet;
+	nnWeights * theWeights;
+	uniform_real_distribution<float> weight(-1.0, 1.0);
+	unsigned int i;
+
+	theNet = new nn(topo.inputs, topo.hidden, topo.outputs, (float)0.1, name);
+	theWeights = theNet->snapshot();
+	for (i = 0; i < theWeights->hiddenNodes() * theWeights->inputNodes(); i++)
+		theWeights->hiddenWeights()[i] = weight(gen);
+	for (i = 0; i < theWeights->hiddenNodes(); i++)
+		theWeights->hiddenBiases()[i] = weight(gen);
+	for (i = 0; i < theWeights->outputNodes() * theWeights->hiddenNodes(); i++)
+		theWeights->outputWeights()[i] = weight(gen);
+	for (i = 0; i < theWeights->outputNodes(); i++)
+		theWeights->outputBiases()[i] = weight(gen);
+	theNet->setWeights(theWeights);
+	delete theWeights;
+
+	return theNet;
+}
+
+void pruneSmallest(float * weights, size_t count, double density)
+/*
+ * Zero all but the largest density of count weights (in magnitude)
+ */
+{
+	vector<float> magnitudes(count);
+	size_t keep = (size_t)(count * density + 0.5);
+	size_t i;
+	float threshold;
+
+	if (keep >= count)
+		return;
+	for (i = 0; i < count; i++)
+		magnitudes[i] = fabsf(weights[i]);
+	nth_element(magnitudes.begin(), magnitudes.begin() + (count - keep), magnitudes.end());
+	threshold = magnitudes[count - keep];
+	for (i = 0; i < count; i++)
+		if (fabsf(weights[i]) < threshold)
+			weights[i] = 0.0;
+}
+
+void seededRows(vector<vector<float> > & rows, unsigned int count, unsigned int width, mt19937 & gen, bool binaryValues)
+{
+	uniform_real_distribution<float> value(-1.0, 1.0);
+	unsigned int i, j;
+
+	rows.resize(count);
+	for (i = 0; i < count; i++)
+	{
+		rows[i].resize(width);
+		for (j = 0; j < width; j++)
+			rows[i][j] = binaryValues ? (value(gen) > 0 ? (float)1.0 : (float)0.0) : value(gen);
+	}
+}
+
+void benchTopologyStages(benchSuite & suite, const benchTopology & topo)
+{
+	mt19937 gen(benchSeed);
+	nn * theNet = seededNet(topo, gen);
+	nnWeights * theWeights = theNet->snapshot();
+	vector<vector<float> > inputs, desired;
+	vector<float> output(topo.outputs);
+	vector<float> hidden(topo.hidden);
+	string strSaved;
+	string prefix;
+	char cstrPath[] = "/tmp/ennBenchXXXXXX";
+	int fd;
+
+	seededRows(inputs, benchRows, topo.inputs, gen, false);
+	seededRows(desired, benchRows, topo.outputs, gen, true);
+
+	prefix = topo.name;
+
+	suite.runRows("run/" + prefix + "/nn", benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			theNet->run(&inputs[i], &output);
+	});
+
+	suite.runRows("run/" + prefix + "/flat", benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			theWeights->run(inputs[i].data(), hidden.data(), output.data());
+	});
+
+	quantizedWeights quantized(*theWeights);
+	vector<int8_t> quantizedScratch(quantized.scratchSize());
+	for (const vector<float> & row : inputs)
+		quantized.observe(row.data());
+	quantized.quantize();
+
+	suite.runRows("run/" + prefix + "/int8", benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			quantized.run(inputs[i].data(), quantizedScratch.data(), output.data());
+	});
+
+	halfWeights fp16(*theWeights, HALF_FP16);
+	halfWeights bf16(*theWeights, HALF_BF16);
+	vector<float> halfScratch(fp16.scratchSize());
+
+	suite.runRows("run/" + prefix + "/fp16", benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			fp16.run(inputs[i].data(), halfScratch.data(), output.data());
+	});
+
+	suite.runRows("run/" + prefix + "/bf16", benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			bf16.run(inputs[i].data(), halfScratch.data(), output.data());
+	});
+
+	for (unsigned int density : { 50, 25, 10, 5 })
+	{
+		nnWeights pruned(*theWeights);
+
+		pruneSmallest(pruned.hiddenWeights(), (size_t)pruned.hiddenNodes() * pruned.inputNodes(), density / 100.0);
+		pruneSmallest(pruned.outputWeights(), (size_t)pruned.outputNodes() * pruned.hiddenNodes(), density / 100.0);
+		sparseWeights sparse(pruned);
+
+		suite.runRows("run/" + prefix + "/csr" + to_string(density), benchRows, [&](unsigned long first, unsigned long last)
+		{
+			unsigned long i;
+			for (i = first; i < last; i++)
+				sparse.run(inputs[i].data(), hidden.data(), output.data());
+		});
+	}
+
+	suite.runRows("train/" + prefix, benchRows, [&](unsigned long first, unsigned long last)
+	{
+		unsigned long i;
+		for (i = first; i < last; i++)
+			theNet->train(&inputs[i], &desired[i]);
+	});
+
+	suite.run("save/" + prefix, 1, [&]
+	{
+		theNet->saveOn(&strSaved);
+	});
+
+	fd = mkstemp(cstrPath);
+	if (fd >= 0)
+	{
+		fstream * pFile = new fstream(cstrPath, ios::out);
+		theNet->saveTo(pFile);
+		pFile->close();
+		delete pFile;
+		close(fd);
+
+		suite.run("load/" + prefix, 1, [&]
+		{
+			nn loaded(cstrPath);
+		});
+		unlink(cstrPath);
+	}
+
+	delete theWeights;
+	delete theNet;
+}
+
+template <class fileClass> unsigned int parseRows(const string & path)
+{
+	ifstream * pFile = new ifstream(path.c_str());
+	fileClass * dFile = new fileClass(pFile);
+	unsigned int rows;
+
+	dFile->readInFile();
+	rows = dFile->inputLines();
+	delete dFile;
+	delete pFile;
+
+	return rows;
+}
+
+void benchParse(benchSuite & suite, const string & dataDir)
+{
+	DIR * topDir;
+	DIR * subDir;
+	struct dirent * topEntry;
+	struct dirent * subEntry;
+	vector<string> files;
+	string path, fileName;
+	unsigned int i, rows;
+
+	if ((topDir = opendir(dataDir.c_str())) == NULL)
+	{
+		cerr << "No test data in " << dataDir << ", skipping the parse benchmarks\n";
+		return;
+	}
+
+	while ((topEntry = readdir(topDir)) != NULL)
+	{
+		if (topEntry->d_name[0] == '.')
+			continue;
+		path = dataDir + "/" + topEntry->d_name;
+		if ((subDir = opendir(path.c_str())) == NULL)
+			continue;
+		while ((subEntry = readdir(subDir)) != NULL)
+		{
+			fileName = subEntry->d_name;
+			if ((fileName.size() > 3) && ((fileName.compare(fileName.size() - 3, 3, ".tr") == 0)
+					|| (fileName.compare(fileName.size() - 4, 4, ".dat") == 0)))
+				files.push_back(string(topEntry->d_name) + "/" + fileName);
+		}
+		closedir(subDir);
+	}
+	closedir(topDir);
+	sort(files.begin(), files.end());
+
+	for (i = 0; i < files.size(); i++)
+	{
+		path = dataDir + "/" + files[i];
+
+		try
+		{
+			if (files[i].compare(files[i].size() - 3, 3, ".tr") == 0)
+			{
+				rows = parseRows<trainingFile>(path);
+				suite.run("parse/" + files[i], rows, [&] { parseRows<trainingFile>(path); });
+			}
+			else
+			{
+				rows = parseRows<inputFile>(path);
+				suite.run("parse/" + files[i], rows, [&] { parseRows<inputFile>(path); });
+			}
+		}
+		catch (format_Error & e)
+		{
+			cerr << files[i] << ": " << e.mesg << "\n";
+		}
+	}
+}
+
+struct convergeCase
+{
+	const char	*	file;				// under the test data directory
+	benchTopology	topo;
+};
+
+const convergeCase convergeCases[] =
+{
+	{ "xor/xor01.tr", { "xor-2-3-1", 2, 3, 1 } },
+	{ "binary/binary01.tr", { "binary-2-3-3", 2, 3, 3 } }
+};
+
+const unsigned int convergeSeeds = 10;
+const unsigned int convergeMaxEpochs = 2000;
+const double convergeTarget = 0.02;
+
+void callback_CountEpoch(const epochReport & report, void * caller)
+{
+	*(unsigned int *)caller = report.epoch;
+}
+
+double median(vector<double> values)
+{
+	if (values.size() == 0)
+		return 0.0;
+	sort(values.begin(), values.end());
+	return (values.size() % 2 == 1) ? values[values.size() / 2] : (values[values.size() / 2 - 1] + values[values.size() / 2]) / 2;
+}
+
+void benchConverge(benchSuite & suite, const string & dataDir)
+{
+	ifstream * pFile;
+	trainingFile * trFile;
+	vector<double> epochs, ms;
+	chrono::steady_clock::time_point start;
+	unsigned int c, seed, epochCount;
+	stop_reason reason;
+	string name;
+	nn * theNet;
+	bool headed = false;
+
+	for (c = 0; c < sizeof(convergeCases) / sizeof(convergeCases[0]); c++)
+	{
+		pFile = new ifstream((dataDir + "/" + convergeCases[c].file).c_str());
+		trFile = new trainingFile(pFile);
+		try
+		{
+			trFile->readInFile();
+		}
+		catch (format_Error & e)
+		{
+			cerr << convergeCases[c].file << ": " << e.mesg << "\n";
+			delete trFile;
+			delete pFile;
+			continue;
+		}
+
+		for (bool rprop : { false, true })
+		{
+			name = string("converge/") + convergeCases[c].file + (rprop ? "/rprop" : "/sgd");
+			if (!suite.wanted(name))
+				continue;
+			if (!headed)
+			{
+				printf("\n%-40s %10s %10s %12s %12s\n", "convergence", "target", "reached", "epochs", "ms");
+				headed = true;
+			}
+
+			epochs.clear();
+			ms.clear();
+			for (seed = 1; seed <= convergeSeeds; seed++)
+			{
+				mt19937 gen(benchSeed + seed);
+				theNet = seededNet(convergeCases[c].topo, gen);
+				epochCount = 0;
+
+				start = chrono::steady_clock::now();
+				if (rprop)
+				{
+					nnWeights * theWeights = theNet->snapshot();
+					rpropTrainer trainer(theWeights);
+					trainer.setMaxEpochs(convergeMaxEpochs);
+					trainer.setTarget(convergeTarget);
+					trainer.setCallback(&callback_CountEpoch, &epochCount);
+					reason = trainer.run(trFile);
+					theNet->setWeights(theWeights);
+					delete theWeights;
+				}
+				else
+				{
+					epochTrainer trainer(theNet, trFile);
+					trainer.setMaxEpochs(convergeMaxEpochs);
+					trainer.setTarget(convergeTarget);
+					trainer.setSeed(seed);
+					trainer.setCallback(&callback_CountEpoch, &epochCount);
+					reason = trainer.run();
+				}
+				if (reason == STOP_TARGET)
+				{
+					ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+					epochs.push_back(epochCount);
+				}
+				delete theNet;
+			}
+
+			printf("%-40s %10g %7u/%-2u %12.0f %12.2f\n", name.c_str(), convergeTarget, (unsigned int)epochs.size(), convergeSeeds,
+					median(epochs), median(ms));
+			fflush(stdout);
+		}
+
+		delete trFile;
+		delete pFile;
+	}
+}
+
+const unsigned int allocRows = 512;
+
+void callback_RunAlloc(const int index, void * caller)
+{
+	static vector<float> resVec;	// the same as callback_RunComplete in main.cpp without the output
+
+	resVec.resize(((nn*)caller)->outputNodes());
+	((nn*)caller)->runResult(&resVec);
+}
+
+string writeDataset(const benchTopology & topo, unsigned long rows, bool isTraining)
+/*
+ * Write rows rows of teacher data for topo to a temporary file and return its name
+ */
+{
+	dataGenerator generator(GEN_TEACHER, topo.inputs, topo.hidden, topo.outputs, benchSeed, isTraining);
+	vector<char> buffer(max(generator.chunkBytes(rows), generator.headerBytes()));
+	vector<float> inScratch, outScratch, hidScratch;
+	char cstrPath[] = "/tmp/ennAllocXXXXXX";
+	int fd;
+	size_t bytes;
+
+	if ((fd = mkstemp(cstrPath)) < 0)
+		return "";
+	bytes = generator.header(buffer.data());
+	if (write(fd, buffer.data(), bytes) != (ssize_t)bytes)
+		cerr << "Could not write " << cstrPath << "\n";
+	bytes = generator.formatChunk(0, rows, buffer.data(), inScratch, outScratch, hidScratch);
+	if (write(fd, buffer.data(), bytes) != (ssize_t)bytes)
+		cerr << "Could not write " << cstrPath << "\n";
+	close(fd);
+
+	return cstrPath;
+}
+
+bool allocStage(const string & name, bool mustBeZero, function<void(unsigned int)> stage)
+/*
+ * stage(0) runs on allocRows rows, stage(1) on 2 * allocRows. Report the allocations and return false if a
+ * stage that mustBeZero allocates per row.
+ */
+{
+	allocCounts small, large;
+	allocCounts start;
+	double perRow;
+	bool ok;
+
+	stage(0);							// warm up: first time buffers, the thread pool, the static vectors in the callbacks
+
+	start = allocCounter::mark();
+	stage(0);
+	small = allocCounter::since(start);
+
+	start = allocCounter::mark();
+	stage(1);
+	large = allocCounter::since(start);
+
+	perRow = ((double)large.allocs - (double)small.allocs) / allocRows;
+	ok = !mustBeZero || (large.allocs <= small.allocs);
+
+	printf("%-40s %10u %12llu %12llu %12.3f %s\n", name.c_str(), allocRows, small.allocs, small.bytes, perRow,
+			mustBeZero ? (ok ? "ok" : "FAIL") : "-");
+	fflush(stdout);
+
+	return ok;
+}
+
+bool allocChecks(const benchTopology & topo, const string & filter)
+{
+	mt19937 gen(benchSeed);
+	nn * theNet = seededNet(topo, gen);
+	string prefix = topo.name;
+	string trPaths[2], datPaths[2];
+	ifstream * pFiles[4];
+	trainingFile * trFiles[2];
+	inputFile * datFiles[2];
+	testMetrics metrics(topo.outputs);
+	string strSaved;
+	unsigned int i;
+	bool ok = true;
+
+	for (i = 0; i < 2; i++)
+	{
+		trPaths[i] = writeDataset(topo, allocRows * (i + 1), true);
+		datPaths[i] = writeDataset(topo, allocRows * (i + 1), false);
+
+		pFiles[i * 2] = new ifstream(trPaths[i].c_str());
+		trFiles[i] = new trainingFile(pFiles[i * 2]);
+		trFiles[i]->readInFile();
+		pFiles[i * 2 + 1] = new ifstream(datPaths[i].c_str());
+		datFiles[i] = new inputFile(pFiles[i * 2 + 1]);
+		datFiles[i]->readInFile();
+	}
+
+	auto check = [&](const string & name, bool mustBeZero, function<void(unsigned int)> stage)
+	{
+		if ((filter.size() == 0) || (name.find(filter) != std::string::npos))
+			if (!allocStage(name, mustBeZero, stage))
+				ok = false;
+	};
+
+	check("run/" + prefix, true, [&](unsigned int f) { theNet->run(datFiles[f], &callback_RunAlloc); });
+	check("train/" + prefix, true, [&](unsigned int f) { theNet->train(trFiles[f]); });
+	check("test/" + prefix, true, [&](unsigned int f) { theNet->test(trFiles[f], NULL, &metrics); });
+
+	theNet->setThreads(2);
+	check("run/" + prefix + "/threads", true, [&](unsigned int f) { theNet->run(datFiles[f], &callback_RunAlloc); });
+	check("test/" + prefix + "/threads", true, [&](unsigned int f) { theNet->test(trFiles[f], NULL, &metrics); });
+	theNet->setThreads(1);
+
+	check("parse/" + prefix, false, [&](unsigned int f) { parseRows<trainingFile>(trPaths[f]); });
+	check("save/" + prefix, false, [&](unsigned int f) { theNet->saveOn(&strSaved); });
+
+	for (i = 0; i < 2; i++)
+	{
+		delete trFiles[i];
+		delete datFiles[i];
+		unlink(trPaths[i].c_str());
+		unlink(datPaths[i].c_str());
+	}
+	for (i = 0; i < 4; i++)
+		delete pFiles[i];
+	delete theNet;
+
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	string dataDir = "../testData";
+	string jsonFile;
+	string filter;
+	unsigned int warmup = 5;
+	unsigned int samples = 30;
+	bool allocMode = false;
+	bool ok = true;
+	unsigned int i;
+	string argvI;
+
+	for (i = 1; i < (unsigned int)argc; i++)
+	{
+		argvI = argv[i];
+		if ((argvI == "-data") && (i + 1 < (unsigned int)argc))
+			dataDir = argv[++i];
+		else if ((argvI == "-json") && (i + 1 < (unsigned int)argc))
+			jsonFile = argv[++i];
+		else if ((argvI == "-filter") && (i + 1 < (unsigned int)argc))
+			filter = argv[++i];
+		else if ((argvI == "-warmup") && (i + 1 < (unsigned int)argc))
+			warmup = atoi(argv[++i]);
+		else if ((argvI == "-samples") && (i + 1 < (unsigned int)argc))
+			samples = atoi(argv[++i]);
+		else if (argvI == "-alloc")
+			allocMode = true;
+		else
+		{
+			cout << "bench [-data %dir] [-json %file] [-filter %text] [-warmup %n] [-samples %n] [-alloc]\n";
+			return 1;
+		}
+	}
+
+	if (allocMode)
+	{
+		printf("%-40s %10s %12s %12s %12s %s\n", "stage", "rows", "allocs", "bytes", "allocs/row", "zero");
+		for (i = 0; i < sizeof(benchTopologies) / sizeof(benchTopologies[0]); i++)
+			if (!allocChecks(benchTopologies[i], filter))
+				ok = false;
+
+		if (!ok)
+			cout << "Some of the run, train or test loops allocate memory for every row\n";
+		return ok ? 0 : 1;
+	}
+
+	benchSuite suite(warmup, samples);
+	suite.setFilter(filter);
+	suite.title();
+
+	for (i = 0; i < sizeof(benchTopologies) / sizeof(benchTopologies[0]); i++)
+		benchTopologyStages(suite, benchTopologies[i]);
+
+	benchParse(suite, dataDir);
+	benchConverge(suite, dataDir);
+
+	if (jsonFile.size() > 0)
+		if (!suite.writeJson(jsonFile.c_str()))
+		{
+			cerr << "Could not write " << jsonFile << "\n";
+			return 1;
+		}
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#ifndef _benchmark_h
+#define _benchmark_h
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../latencyHistogram.hpp"
+
+using namespace std ;
+
+/*
+ * A very small benchmark harness for the bench target.
+ *
+ * Every benchmark is a function that processes a fixed number of rows. It is called warmupRuns times
+ * to settle the caches and the branch predictors and then sampleRuns times with each call timed on its
+ * own. A benchmark given to runRows() processes a range of its rows per call, and each sample is then
+ * timed benchChunkRows rows at a time as well, into a latencyHistogram, so that the percentiles are of
+ * rows rather than of whole samples. For one given to run() the percentiles are of whole samples. The
+ * results are reported per row:
+ *
+ *	warmup		total milliseconds spent warming up
+ *	median		median nanoseconds per row over the samples
+ *	p50, p99	percentiles of the nanoseconds per row of each chunk (each sample for run()), to the 1/16
+ *				resolution of latencyHistogram
+ *	rows/s		rows divided by the total sample time
+ *
+ * writeJson() writes every result so that two runs (e.g. before and after a commit) can be compared by
+ * benchmark name.
+ */
+
+struct benchResult
+{
+	string			name;
+	unsigned long	rowsPerRun;
+	unsigned int	samples;
+	double			warmupMs;
+	double			medianNs;		// per row
+	double			p50Ns;			// per row, of the chunks
+	double			p99Ns;			//	"
+	double			rowsPerSecond;
+};
+
+const unsigned int benchChunkRows = 16;		// rows per timed chunk for runRows()
+
+class benchSuite
+{
+	public:
+						benchSuite(unsigned int warmup = 5, unsigned int samples = 30)
+						{
+							warmupRuns = warmup;
+							sampleRuns = samples;
+						}
+
+			void		setFilter(const string & newFilter) { filter = newFilter; }
+
+			bool		wanted(const string & name) { return (filter.size() == 0) || (name.find(filter) != std::string::npos); }
+
+			void		run(const string & name, unsigned long rows, function<void()> body)
+			/*
+			 * Time body, which must process rows rows each time it is called
+			 */
+						{
+							measure(name, rows, rows, [&](unsigned long, unsigned long) { body(); });
+						}
+
+			void		runRows(const string & name, unsigned long rows, function<void(unsigned long, unsigned long)> body)
+			/*
+			 * Time body(first, last), which must process rows first to last - 1 of rows rows
+			 */
+						{
+							measure(name, rows, benchChunkRows, body);
+						}
+
+			void		report(benchResult & result)
+						{
+							printf("%-40s %10lu %10.2f %12.1f %12.1f %12.1f %14.0f\n", result.name.c_str(), result.rowsPerRun, result.warmupMs,
+									result.medianNs, result.p50Ns, result.p99Ns, result.rowsPerSecond);
+							fflush(stdout);
+						}
+
+			void		title()
+						{
+							printf("%-40s %10s %10s %12s %12s %12s %14s\n", "benchmark", "rows/run", "warmup ms", "median ns", "p50 ns", "p99 ns", "rows/s");
+						}
+
+			bool		writeJson(const char * cstrFilename)
+						{
+							FILE * pFile;
+							unsigned int i;
+
+							if ((pFile = fopen(cstrFilename, "w")) == NULL)
+								return false;
+
+							fprintf(pFile, "{\n\t\"compiler\": \"%s\",\n\t\"hardwareThreads\": %u,\n\t\"warmupRuns\": %u,\n\t\"sampleRuns\": %u,\n\t\"benchmarks\": [\n",
+									__VERSION__, thread::hardware_concurrency(), warmupRuns, sampleRuns);
+							for (i = 0; i < results.size(); i++)
+								fprintf(pFile, "\t\t{\"name\": \"%s\", \"rowsPerRun\": %lu, \"samples\": %u, \"warmupMs\": %.3f, \"medianNsPerRow\": %.3f, \"p50NsPerRow\": %.3f, \"p99NsPerRow\": %.3f, \"rowsPerSecond\": %.1f}%s\n",
+										results[i].name.c_str(), results[i].rowsPerRun, results[i].samples, results[i].warmupMs,
+										results[i].medianNs, results[i].p50Ns, results[i].p99Ns, results[i].rowsPerSecond, (i + 1 < results.size()) ? "," : "");
+							fprintf(pFile, "\t]\n}\n");
+							fclose(pFile);
+
+							return true;
+						}
+
+	private:
+			void		measure(const string & name, unsigned long rows, unsigned long chunkRows, function<void(unsigned long, unsigned long)> body)
+			/*
+			 * Time the samples of body chunkRows rows at a time (the last chunk may be shorter)
+			 */
+						{
+							benchResult result;
+							vector<double> sampleNs;
+							latencyHistogram chunkNs;		// per row
+							chrono::steady_clock::time_point start, chunkStart, chunkEnd;
+							double totalNs = 0.0;
+							unsigned long first, last;
+							unsigned int i;
+
+							if (!wanted(name) || (rows == 0))
+								return;
+
+							start = chrono::steady_clock::now();
+							for (i = 0; i < warmupRuns; i++)
+								body(0, rows);
+							result.warmupMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+							sampleNs.resize(sampleRuns);
+							for (i = 0; i < sampleRuns; i++)
+							{
+								start = chunkEnd = chrono::steady_clock::now();
+								for (first = 0; first < rows; first = last)
+								{
+									last = (rows - first > chunkRows) ? first + chunkRows : rows;
+									chunkStart = chunkEnd;
+									body(first, last);
+									chunkEnd = chrono::steady_clock::now();
+									chunkNs.record((unsigned long long)(chrono::duration<double, nano>(chunkEnd - chunkStart).count() / (last - first) + 0.5));
+								}
+								sampleNs[i] = chrono::duration<double, nano>(chunkEnd - start).count();
+								totalNs += sampleNs[i];
+							}
+							sort(sampleNs.begin(), sampleNs.end());
+
+							result.name = name;
+							result.rowsPerRun = rows;
+							result.samples = sampleRuns;
+							result.medianNs = percentile(sampleNs, 0.5) / rows;
+							result.p50Ns = chunkNs.percentile(50);
+							result.p99Ns = chunkNs.percentile(99);
+							result.rowsPerSecond = (totalNs > 0.0) ? (double)rows * sampleRuns / (totalNs * 1e-9) : 0.0;
+							results.push_back(result);
+
+							report(result);
+						}
+
+	static	double		percentile(vector<double> & sorted, double p)
+						{
+							size_t i;
+
+							if (sorted.size() == 0)
+								return 0.0;
+							i = (size_t)(p * sorted.size());
+							if (i >= sorted.size())
+								i = sorted.size() - 1;
+							return sorted[i];
+						}
+
+	private:
+	unsigned int		warmupRuns;
+	unsigned int		sampleRuns;
+	string				filter;
+	vector<benchResult>	results;
+};
+
+#endif	// _benchmark_h
@@ -0,0 +1,269 @@
+#ifndef _dataGenerator_h
+#define _dataGenerator_h
+
+#include <math.h>
+#include <string.h>
+#include <charconv>
+#include <random>
+#include <string>
+#include <vector>
+#include "../nnWeights.hpp"
+
+using namespace std ;
+
+/*
+ * dataGenerator makes synthetic training (.tr) and input (.dat) rows for any topology.
+ *
+ * The families:
+ *
+ *	xor			the corners of the unit hypercube plus gaussian noise. Output j is the parity of input bits j and up
+ *				(the 2-2-1 case is the same problem as testData/xor)
+ *	binary		noisy copies of a small set of prototype points, each with its own random binary output code
+ *				(the same shape of problem as testData/binary)
+ *	gauss		one gaussian cluster per output node, the desired output is one-hot
+ *	teacher		uniform random inputs run through a random network with the requested topology; the desired
+ *				output is the teacher's output
+ *
+ * Everything random comes from the seed. The fixed parts of a family (prototypes, cluster centres, the teacher's
+ * weights) are made from the seed alone, and the rows are made in chunks whose generator is seeded from the seed
+ * and the chunk number. Chunks can therefore be made in any order on any number of threads and the file is
+ * always the same for the same seed.
+ *
+ * formatChunk() writes rows with std::to_chars into a caller supplied buffer that must have room for
+ * chunkBytes(rows) characters, so nothing is allocated per row.
+ */
+
+enum generator_family { GEN_XOR, GEN_BINARY, GEN_GAUSS, GEN_TEACHER };
+
+class dataGenerator
+{
+	public:
+						dataGenerator(generator_family newFamily, unsigned int inputNodes, unsigned int hiddenNodes, unsigned int outputNodes,
+										unsigned long newSeed, bool isTraining = true)
+						{
+							family = newFamily;
+							inputs = inputNodes;
+							hidden = hiddenNodes;
+							outputs = outputNodes;
+							seed = newSeed;
+							training = isTraining;
+							noise = (float)0.05;
+							signTargets = false;
+							prototypeCount = 8;
+							teacher = NULL;
+
+							setup();
+						}
+
+						~dataGenerator()
+						{
+							if (teacher != NULL)
+								delete teacher;
+						}
+
+	// setup
+			void		setNoise(float newNoise) { noise = newNoise; }
+			void		setSignTargets(bool isSign) { signTargets = isSign; }		// write -1/+1 desired values, like the Shuttle files
+			void		setPrototypes(unsigned int newCount) { prototypeCount = newCount; setup(); }
+
+	static	bool		familyFromName(const string & name, generator_family * familyOut)
+						{
+							if (name == "xor")
+								*familyOut = GEN_XOR;
+							else if (name == "binary")
+								*familyOut = GEN_BINARY;
+							else if (name == "gauss")
+								*familyOut = GEN_GAUSS;
+							else if (name == "teacher")
+								*familyOut = GEN_TEACHER;
+							else
+								return false;
+							return true;
+						}
+
+	// generate
+			size_t		headerBytes() { return 64; }
+
+			size_t		header(char * buffer)
+						{
+							char * p = buffer;
+
+							p = put(p, "networkTopology(");
+							p = to_chars(p, buffer + headerBytes(), inputs).ptr;
+							*p++ = ',';
+							p = to_chars(p, buffer + headerBytes(), hidden).ptr;
+							*p++ = ',';
+							p = to_chars(p, buffer + headerBytes(), outputs).ptr;
+							p = put(p, ")\n");
+
+							return p - buffer;
+						}
+
+			size_t		chunkBytes(unsigned long rows)		// the most a chunk of rows can take
+						{
+							return rows * (20 + (inputs + outputs) * (maxFloatChars + 1));
+						}
+
+			size_t		formatChunk(unsigned long chunk, unsigned long rows, char * buffer, vector<float> & inputScratch,
+										vector<float> & outputScratch, vector<float> & hiddenScratch)
+			/*
+			 * Make rows rows of chunk number chunk and format them into buffer. Returns the number of characters
+			 * written. The scratch vectors are resized on the first call and reused after that.
+			 */
+						{
+							seed_seq chunkSeed { (unsigned int)seed, (unsigned int)(seed >> 32), (unsigned int)chunk, (unsigned int)(chunk >> 32), 1u };
+							mt19937 gen(chunkSeed);
+							char * p = buffer;
+							unsigned long r;
+							unsigned int i;
+
+							inputScratch.resize(inputs);
+							outputScratch.resize(outputs);
+							hiddenScratch.resize(hidden);
+
+							for (r = 0; r < rows; r++)
+							{
+								makeRow(gen, inputScratch.data(), outputScratch.data(), hiddenScratch.data());
+
+								p = put(p, training ? "inputOutputVector(" : "inputVector(");
+								for (i = 0; i < inputs; i++)
+								{
+									if (i > 0)
+										*p++ = ',';
+									p = to_chars(p, p + maxFloatChars, inputScratch[i]).ptr;
+								}
+								if (training)
+								{
+									*p++ = ';';
+									for (i = 0; i < outputs; i++)
+									{
+										if (i > 0)
+											*p++ = ',';
+										p = to_chars(p, p + maxFloatChars, signTargets ? outputScratch[i] * 2 - 1 : outputScratch[i]).ptr;
+									}
+								}
+								p = put(p, ")\n");
+							}
+
+							return p - buffer;
+						}
+
+			nnWeights *	teacherWeights() { return teacher; }		// NULL unless the family is teacher
+
+	private:
+			void		setup()
+			/*
+			 * Make the fixed parts of the family from the seed
+			 */
+						{
+							seed_seq baseSeed { (unsigned int)seed, (unsigned int)(seed >> 32), 0u, 0u, 0u };
+							mt19937 gen(baseSeed);
+							uniform_real_distribution<float> unit(0.0, 1.0);
+							uniform_real_distribution<float> weight(-4.0, 4.0);
+							network_description net;
+							unsigned int i;
+
+							switch (family)
+							{
+								case GEN_BINARY:
+									prototypes.resize(prototypeCount * inputs);
+									codes.resize(prototypeCount * outputs);
+									for (i = 0; i < prototypes.size(); i++)
+										prototypes[i] = (unit(gen) < 0.5) ? (float)0.0 : (float)1.0;
+									for (i = 0; i < codes.size(); i++)
+										codes[i] = (unit(gen) < 0.5) ? (float)0.0 : (float)1.0;
+									break;
+								case GEN_GAUSS:
+									prototypes.resize(outputs * inputs);
+									for (i = 0; i < prototypes.size(); i++)
+										prototypes[i] = unit(gen) * 2 - 1;
+									break;
+								case GEN_TEACHER:
+									net = network_description(inputs, hidden, outputs, (float)0.1, "teacher");
+									if (teacher != NULL)
+										delete teacher;
+									teacher = new nnWeights(net);
+									for (i = 0; i < hidden * teacher->inputNodes(); i++)
+										teacher->hiddenWeights()[i] = weight(gen);
+									for (i = 0; i < hidden; i++)
+										teacher->hiddenBiases()[i] = weight(gen);
+									for (i = 0; i < outputs * hidden; i++)
+										teacher->outputWeights()[i] = weight(gen);
+									for (i = 0; i < outputs; i++)
+										teacher->outputBiases()[i] = weight(gen);
+									break;
+								case GEN_XOR:
+									break;
+							}
+						}
+
+			void		makeRow(mt19937 & gen, float * in, float * out, float * hid)
+						{
+							normal_distribution<float> jitter(0.0, (noise > 0) ? noise : (float)1.0);
+							uniform_real_distribution<float> unit(0.0, 1.0);
+							unsigned int i, j, bits;
+
+							switch (family)
+							{
+								case GEN_XOR:
+									for (i = 0; i < inputs; i++)
+										in[i] = (unit(gen) < 0.5) ? (float)0.0 : (float)1.0;
+									for (j = 0; j < outputs; j++)
+									{
+										bits = 0;
+										for (i = j % inputs; i < inputs; i++)
+											bits += (in[i] > 0.5) ? 1 : 0;
+										out[j] = (float)(bits & 1);
+									}
+									for (i = 0; i < inputs; i++)
+										in[i] += (noise > 0) ? jitter(gen) : (float)0.0;
+									break;
+								case GEN_BINARY:
+									j = (unsigned int)(unit(gen) * prototypeCount) % prototypeCount;
+									for (i = 0; i < inputs; i++)
+										in[i] = prototypes[j * inputs + i] + ((noise > 0) ? jitter(gen) : (float)0.0);
+									for (i = 0; i < outputs; i++)
+										out[i] = codes[j * outputs + i];
+									break;
+								case GEN_GAUSS:
+									j = (unsigned int)(unit(gen) * outputs) % outputs;
+									for (i = 0; i < inputs; i++)
+										in[i] = prototypes[j * inputs + i] + ((noise > 0) ? jitter(gen) : (float)0.0);
+									for (i = 0; i < outputs; i++)
+										out[i] = (i == j) ? (float)1.0 : (float)0.0;
+									break;
+								case GEN_TEACHER:
+									for (i = 0; i < inputs; i++)
+										in[i] = unit(gen) * 2 - 1;
+									teacher->run(in, hid, out);
+									break;
+							}
+						}
+
+	static	char	*	put(char * p, const char * cstr)
+						{
+							size_t len = strlen(cstr);
+
+							memcpy(p, cstr, len);
+							return p + len;
+						}
+
+	private:
+	static const size_t	maxFloatChars = 16;		// the longest shortest-form float, e.g. -1.1754944e-38
+
+	generator_family	family;
+	unsigned int		inputs;
+	unsigned int		hidden;
+	unsigned int		outputs;
+	unsigned long		seed;
+	bool				training;
+	float				noise;
+	bool				signTargets;
+	unsigned int		prototypeCount;
+
+	vector<float>		prototypes;		// binary: [prototype][input], gauss: [cluster][input]
+	vector<float>		codes;			// binary: [prototype][output]
+	nnWeights		*	teacher;
+};
+
+#endif	// _dataGenerator_h
@@ -0,0 +1,240 @@
+/*
+ * ennc - compile a trained .enn network into self-contained C++ inference code
+ *
+ * ennc %file.enn [-o %file] [-name %identifier] [-sigmoid exact|float] [-batch]
+ *
+ *	-o			output file, a header (the default) or, if it ends in .cpp, a source file (default stdout)
+ *	-name		the namespace the code goes in (default the network name, made into an identifier)
+ *	-sigmoid	exact (the default) is the same activation function as nnWeights::f() and outNode::f(), so the
+ *				results are bit for bit those of nn::run(). float uses expf() instead of exp(), which is quicker on
+ *				small cores without double precision hardware but may differ in the last bits.
+ *	-batch		also write runBatch(), which runs contiguous rows
+ *
+ * The network is read once, through networkFile, and nothing is parsed or allocated at run time. The weights become
+ * constexpr arrays and every loop is unrolled for the exact topology, the sums being made in the same order as
+ * nnWeights::run() so the compiler may fold the weights into the instructions but never reorder the arithmetic
+ * (do not build the generated code with -ffast-math if the results must match).
+ *
+ * The generated code needs only <math.h> and <stddef.h>:
+ *
+ *	namespace <name>
+ *	{
+ *		constexpr unsigned int standardInputs, hiddenNodes, outputNodes;
+ *		void run(const float * inputVector, float * outputVector);
+ *		void runBatch(const float * inputRows, size_t rows, float * outputRows);	// with -batch
+ *	}
+ *
+ * See enncheck.cpp and the enncheck target in makefile.targets for the cross check against nn::run().
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include "../nnWeights.hpp"
+#include "../networkFile.hpp"
+
+int usage()
+{
+	cerr << "ennc %file.enn [-o %file] [-name %identifier] [-sigmoid exact|float] [-batch]\n";
+	return 1;
+}
+
+string floatLiteral(float value)
+/*
+ * A literal that reads back as exactly the same float
+ */
+{
+	char cstrValue[32];
+	string literal;
+
+	if (!isfinite(value))
+		throw format_Error(ENN_ERR_CONTENT_IN_NETWORK_FILE);
+
+	snprintf(cstrValue, sizeof(cstrValue), "%.9g", (double)value);
+	literal = cstrValue;
+	if (literal.find_first_of(".e") == string::npos)
+		literal += ".0";
+	return literal + "f";
+}
+
+string identifier(const string & name)
+{
+	string ident;
+
+	for (char c : name)
+		ident += (isalnum((unsigned char)c) || (c == '_')) ? c : '_';
+	if ((ident.size() == 0) || isdigit((unsigned char)ident[0]))
+		ident = "n" + ident;
+	return ident;
+}
+
+void writeVector(ostream & out, const char * cstrName, const float * values, unsigned int columns)
+{
+	unsigned int c;
+
+	out << "\tconstexpr float " << cstrName << "[" << columns << "] = {";
+	for (c = 0; c < columns; c++)
+		out << ((c > 0) ? ", " : " ") << floatLiteral(values[c]);
+	out << " };\n";
+}
+
+void writeArray(ostream & out, const char * cstrName, const float * values, unsigned int rows, unsigned int columns)
+{
+	unsigned int r, c;
+
+	out << "\tconstexpr float " << cstrName << "[" << rows << "][" << columns << "] =\n\t{\n";
+	for (r = 0; r < rows; r++)
+	{
+		out << "\t\t{";
+		for (c = 0; c < columns; c++)
+			out << ((c > 0) ? ", " : " ") << floatLiteral(values[r * columns + c]);
+		out << " },\n";
+	}
+	out << "\t};\n";
+}
+
+void writeCode(ostream & out, nnWeights & weights, const string & source, const string & ns, bool exactSigmoid, bool batch, bool isSource)
+{
+	unsigned int stdIn = weights.standardInputNodes();
+	unsigned int inNodes = weights.inputNodes();
+	unsigned int hidNodes = weights.hiddenNodes();
+	unsigned int outNodes = weights.outputNodes();
+	const char * cstrLinkage = isSource ? "" : "inline ";
+	string guard = "_ennc_" + ns + "_h";
+	unsigned int h, i, o;
+
+	out << "/*\n * Generated by ennc from " << source << ", network " << weights.networkName() << " version " << weights.major() << "."
+			<< weights.minor() << "." << weights.revis() << ". Do not edit, compile the network again instead.\n *\n"
+			<< " * Topology " << stdIn << ", " << hidNodes << ", " << outNodes << (weights.hasInputBiasNode() ? " with an input bias node" : "")
+			<< ", " << (exactSigmoid ? "exact" : "float") << " sigmoid\n */\n\n";
+	if (!isSource)
+		out << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+	out << "#include <math.h>\n#include <stddef.h>\n\nnamespace " << ns << "\n{\n";
+	out << "\tconstexpr unsigned int standardInputs = " << stdIn << ";\n";
+	out << "\tconstexpr unsigned int hiddenNodes = " << hidNodes << ";\n";
+	out << "\tconstexpr unsigned int outputNodes = " << outNodes << ";\n\n";
+
+	writeArray(out, "hiddenWeights", weights.hiddenWeights(), hidNodes, inNodes);
+	writeVector(out, "hiddenBiases", weights.hiddenBiases(), hidNodes);
+	writeArray(out, "outputWeights", weights.outputWeights(), outNodes, hidNodes);
+	writeVector(out, "outputBiases", weights.outputBiases(), outNodes);
+
+	out << "\n\tstatic inline float f(float biasPlusActivationQuant)\n\t{\n";
+	out << "\t\tif (biasPlusActivationQuant < -50.0)\n\t\t\treturn 0.0f;\n";
+	out << "\t\tif (biasPlusActivationQuant > 50.0)\n\t\t\treturn 1.0f;\n";
+	if (exactSigmoid)
+		out << "\t\treturn (float)(1 / (1 + exp((double)(-1 * biasPlusActivationQuant))));\n\t}\n";
+	else
+		out << "\t\treturn 1.0f / (1.0f + expf(-biasPlusActivationQuant));\n\t}\n";
+
+	out << "\n\t" << cstrLinkage << "void run(const float * inputVector, float * outputVector)\n\t{\n";
+	out << "\t\tfloat a;\n\t\tfloat hiddenVector[" << hidNodes << "];\n";
+	for (h = 0; h < hidNodes; h++)
+	{
+		out << "\n\t\ta = 0.0f;\n";
+		for (i = 0; i < stdIn; i++)
+			out << "\t\ta += hiddenWeights[" << h << "][" << i << "] * inputVector[" << i << "];\n";
+		if (weights.hasInputBiasNode())
+			out << "\t\ta += hiddenWeights[" << h << "][" << stdIn << "] * 1.0f;\n";
+		out << "\t\thiddenVector[" << h << "] = f(hiddenBiases[" << h << "] + a);\n";
+	}
+	for (o = 0; o < outNodes; o++)
+	{
+		out << "\n\t\ta = 0.0f;\n";
+		for (h = 0; h < hidNodes; h++)
+			out << "\t\ta += outputWeights[" << o << "][" << h << "] * hiddenVector[" << h << "];\n";
+		out << "\t\toutputVector[" << o << "] = f(outputBiases[" << o << "] + a);\n";
+	}
+	out << "\t}\n";
+
+	if (batch)
+	{
+		out << "\n\t" << cstrLinkage << "void runBatch(const float * inputRows, size_t rows, float * outputRows)\n\t{\n";
+		out << "\t\tfor (size_t r = 0; r < rows; r++)\n";
+		out << "\t\t\trun(inputRows + r * standardInputs, outputRows + r * outputNodes);\n\t}\n";
+	}
+
+	out << "}\n";
+	if (!isSource)
+		out << "\n#endif\t// " << guard << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+	string netPath;
+	string outPath;
+	string ns;
+	string argvI;
+	bool exactSigmoid = true;
+	bool batch = false;
+	bool isSource;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		argvI = argv[i];
+		if (argvI == "-batch")
+			batch = true;
+		else if ((argvI[0] != '-') && (netPath.size() == 0))
+			netPath = argvI;
+		else if (i + 1 >= argc)
+			return usage();
+		else if (argvI == "-o")
+			outPath = argv[++i];
+		else if (argvI == "-name")
+			ns = argv[++i];
+		else if (argvI == "-sigmoid")
+		{
+			argvI = argv[++i];
+			if ((argvI != "exact") && (argvI != "float"))
+				return usage();
+			exactSigmoid = (argvI == "exact");
+		}
+		else
+			return usage();
+	}
+
+	if (netPath.size() == 0)
+		return usage();
+	isSource = (outPath.size() > 4) && (outPath.compare(outPath.size() - 4, 4, ".cpp") == 0);
+
+	try
+	{
+		ifstream netFile(netPath.c_str());
+		if (!netFile.is_open())
+			throw format_Error(ENN_ERR_NON_FILE);
+
+		networkFile nFile(&netFile);
+		nFile.readInFile();
+		nnWeights weights(&nFile);
+
+		if (ns.size() == 0)
+			ns = weights.networkName();
+		ns = identifier(ns);
+
+		if (outPath.size() == 0)
+			writeCode(cout, weights, netPath, ns, exactSigmoid, batch, false);
+		else
+		{
+			ofstream out(outPath.c_str());
+			if (!out.is_open())
+			{
+				cerr << "Could not open " << outPath << "\n";
+				return 1;
+			}
+			writeCode(out, weights, netPath, ns, exactSigmoid, batch, isSource);
+			out.close();
+			if (out.fail())
+			{
+				cerr << "Write failed\n";
+				return 1;
+			}
+		}
+	}
+	catch (format_Error & e)
+	{
+		cerr << netPath << ": " << e.mesg << "\n";
+		return 1;
+	}
+
+	return 0;
+}
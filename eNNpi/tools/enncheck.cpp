@@ -0,0 +1,132 @@
+/*
+ * enncheck - cross check the code ennc generated for a network against nn::run()
+ *
+ * enncheck %file.enn %file.tr [%file.tr ...] [-tolerance %f]
+ *
+ * Built by the enncheck target in makefile.targets, which compiles the network with
+ *	ennc %file.enn -name enncModel -batch -o ennc_model.hpp
+ * and this file against it. Every row of every training file is run through nn::run(), the generated run() and
+ * the generated runBatch(), and each output is compared. With the exact sigmoid (the ennc default) the results must
+ * be bit for bit the same, so the default tolerance is 0. The time per row of nn::run() and of the generated code are
+ * written too.
+ *
+ * Exits with 1 if any output differs by more than the tolerance or the network does not fit a file.
+ */
+
+#include <chrono>
+#include "../nn.hpp"
+#include "ennc_model.hpp"
+
+int usage()
+{
+	cerr << "enncheck %file.enn %file.tr [%file.tr ...] [-tolerance %f]\n";
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	vector<string> testPaths;
+	string netPath;
+	string argvI;
+	double tolerance = 0.0;
+	unsigned long rowsChecked = 0, mismatches = 0;
+	double maxDifference = 0.0, difference;
+	double nnNs = 0.0, compiledNs = 0.0;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		argvI = argv[i];
+		if (argvI == "-tolerance")
+		{
+			if (i + 1 >= argc)
+				return usage();
+			tolerance = atof(argv[++i]);
+		}
+		else if (netPath.size() == 0)
+			netPath = argvI;
+		else
+			testPaths.push_back(argvI);
+	}
+	if ((netPath.size() == 0) || (testPaths.size() == 0))
+		return usage();
+
+	try
+	{
+		nn theNet(netPath.c_str());
+		vector<float> outVec(enncModel::outputNodes);
+		vector<float> compiledOut(enncModel::outputNodes);
+		vector<float> batchIn;
+		vector<float> batchOut;
+		chrono::steady_clock::time_point started;
+		unsigned int row, o, rows;
+
+		if ((theNet.networkDescription()->standardInputNodes() != enncModel::standardInputs)
+				|| (theNet.networkDescription()->hiddenNodes() != enncModel::hiddenNodes)
+				|| (theNet.networkDescription()->outputNodes() != enncModel::outputNodes))
+		{
+			cerr << netPath << " is not the network ennc_model.hpp was compiled from\n";
+			return 1;
+		}
+
+		for (const string & testPath : testPaths)
+		{
+			ifstream testStream(testPath.c_str());
+			if (!testStream.is_open())
+				throw format_Error(ENN_ERR_NON_FILE);
+			trainingFile testFile(&testStream);
+			testFile.readInFile();
+
+			rows = testFile.inputLines();
+			if ((rows > 0) && (testFile.inputSet(0)->size() != enncModel::standardInputs))
+			{
+				cerr << testPath << " does not fit the network\n";
+				return 1;
+			}
+
+			batchIn.resize((size_t)rows * enncModel::standardInputs);
+			batchOut.resize((size_t)rows * enncModel::outputNodes);
+			for (row = 0; row < rows; row++)
+				copy(testFile.inputSet(row)->begin(), testFile.inputSet(row)->end(), batchIn.begin() + (size_t)row * enncModel::standardInputs);
+
+			started = chrono::steady_clock::now();
+			enncModel::runBatch(batchIn.data(), rows, batchOut.data());
+			compiledNs += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+
+			for (row = 0; row < rows; row++)
+			{
+				started = chrono::steady_clock::now();
+				theNet.run(testFile.inputSet(row), &outVec);
+				nnNs += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+
+				enncModel::run(testFile.inputSet(row)->data(), compiledOut.data());
+
+				for (o = 0; o < enncModel::outputNodes; o++)
+				{
+					difference = fmax(fabs((double)outVec[o] - compiledOut[o]), fabs((double)outVec[o] - batchOut[(size_t)row * enncModel::outputNodes + o]));
+					if (difference > maxDifference)
+						maxDifference = difference;
+					if (difference > tolerance)
+					{
+						if (mismatches < 10)
+							cerr << testPath << " row " << row << " output " << o << ": nn " << outVec[o] << " compiled " << compiledOut[o]
+									<< " batch " << batchOut[(size_t)row * enncModel::outputNodes + o] << "\n";
+						mismatches++;
+					}
+				}
+				rowsChecked++;
+			}
+		}
+	}
+	catch (format_Error & e)
+	{
+		cerr << e.mesg << "\n";
+		return 1;
+	}
+
+	cout << "Rows: " << rowsChecked << " outputs over tolerance: " << mismatches << " max difference: " << maxDifference << "\n";
+	if (rowsChecked > 0)
+		cout << "ns per row - nn::run: " << nnNs / rowsChecked << " compiled runBatch: " << compiledNs / rowsChecked << "\n";
+
+	return (mismatches == 0) ? 0 : 1;
+}
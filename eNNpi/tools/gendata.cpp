@@ -0,0 +1,222 @@
+/*
+ * gendata - write synthetic .tr and .dat files of any size for the parse, training and scaling tests
+ *
+ * gendata -family xor|binary|gauss|teacher -topology %i,%h,%o -rows %n [-seed %n] [-noise %f] [-sign]
+ *			[-prototypes %n] [-threads %n] [-dat] [-teacher %dir] [-o %file]
+ *
+ *	-family		see dataGenerator.hpp
+ *	-topology	input, hidden and output node counts written into the networkTopology line (hidden is also the
+ *				size of the teacher's hidden layer)
+ *	-rows		number of rows, up to 2^64
+ *	-seed		the same seed always gives the same file, whatever -threads is (default 1)
+ *	-noise		standard deviation of the noise added to the xor, binary and gauss inputs (default 0.05)
+ *	-sign		write desired values as -1/+1 rather than 0/1, like the Shuttle files
+ *	-prototypes	number of prototype points for the binary family (default 8)
+ *	-threads	number of generating threads, 0 = one per hardware thread (default 0)
+ *	-dat		write inputVector rows only (implied by an -o file ending in .dat)
+ *	-teacher	also save the teacher network as teacher_0_0_0.enn in an existing directory
+ *	-o			output file (default stdout)
+ *
+ * Rows are made in chunks on a threadPool. While one wave of chunks is being generated the previous wave is
+ * written out, so memory use is fixed however many rows are asked for.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "../nn.hpp"
+#include "dataGenerator.hpp"
+
+const unsigned long genChunkRows = 4096;
+
+bool writeAll(int fd, const char * buffer, size_t bytes)
+{
+	ssize_t written;
+
+	while (bytes > 0)
+	{
+		written = write(fd, buffer, bytes);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buffer += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+bool saveTeacher(dataGenerator & generator, const char * cstrPath)
+{
+	nnWeights * teacher = generator.teacherWeights();
+	nn * theNet;
+	bool ok;
+
+	if (teacher == NULL)
+		return false;
+
+	theNet = new nn(*teacher->networkDescription());
+	theNet->setWeights(teacher);
+	try
+	{
+		ok = (theNet->saveTo(cstrPath) == SUCCESS);
+	}
+	catch (format_Error & e)
+	{
+		ok = false;
+	}
+	delete theNet;
+
+	return ok;
+}
+
+int usage()
+{
+	cerr << "gendata -family xor|binary|gauss|teacher -topology %i,%h,%o -rows %n [-seed %n] [-noise %f] [-sign]\n"
+			"        [-prototypes %n] [-threads %n] [-dat] [-teacher %dir] [-o %file]\n";
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	generator_family family = GEN_XOR;
+	unsigned int inputs = 0, hidden = 0, outputs = 0;
+	unsigned long rows = 0;
+	unsigned long seed = 1;
+	float noise = (float)0.05;
+	bool isSign = false;
+	unsigned int prototypes = 8;
+	unsigned int threads = 0;
+	bool isDat = false;
+	string teacherPath;
+	string outPath;
+	string argvI;
+	int fd = 1;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		argvI = argv[i];
+		if (argvI == "-sign")
+			isSign = true;
+		else if (argvI == "-dat")
+			isDat = true;
+		else if (i + 1 >= argc)
+			return usage();
+		else if (argvI == "-family")
+		{
+			if (!dataGenerator::familyFromName(argv[++i], &family))
+				return usage();
+		}
+		else if (argvI == "-topology")
+		{
+			if (sscanf(argv[++i], "%u,%u,%u", &inputs, &hidden, &outputs) != 3)
+				return usage();
+		}
+		else if (argvI == "-rows")
+			rows = strtoul(argv[++i], NULL, 10);
+		else if (argvI == "-seed")
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (argvI == "-noise")
+			noise = (float)atof(argv[++i]);
+		else if (argvI == "-prototypes")
+			prototypes = atoi(argv[++i]);
+		else if (argvI == "-threads")
+			threads = atoi(argv[++i]);
+		else if (argvI == "-teacher")
+			teacherPath = argv[++i];
+		else if (argvI == "-o")
+			outPath = argv[++i];
+		else
+			return usage();
+	}
+
+	if ((inputs == 0) || (hidden == 0) || (outputs == 0) || (prototypes == 0))
+		return usage();
+	if ((outPath.size() > 4) && (outPath.compare(outPath.size() - 4, 4, ".dat") == 0))
+		isDat = true;
+
+	dataGenerator generator(family, inputs, hidden, outputs, seed, !isDat);
+	generator.setNoise(noise);
+	generator.setSignTargets(isSign);
+	if (family == GEN_BINARY)
+		generator.setPrototypes(prototypes);
+
+	if (teacherPath.size() > 0)
+		if (!saveTeacher(generator, teacherPath.c_str()))
+		{
+			cerr << "Could not save the teacher network in " << teacherPath << " (the family must be teacher)\n";
+			return 1;
+		}
+
+	if (outPath.size() > 0)
+		if ((fd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		{
+			cerr << "Could not open " << outPath << "\n";
+			return 1;
+		}
+
+	threadPool pool(threads);
+	unsigned long chunks = (rows + genChunkRows - 1) / genChunkRows;
+	unsigned long waveChunks = pool.workers() * 4;
+	unsigned long waves = (chunks + waveChunks - 1) / waveChunks;
+	size_t slotBytes = generator.chunkBytes(genChunkRows);
+	vector<char> buffers[2];							// one wave of chunks each, generated into one while the other is written
+	vector<size_t> used[2];
+	vector<vector<float> > inScratch(pool.workers()), outScratch(pool.workers()), hidScratch(pool.workers());
+	vector<char> header(generator.headerBytes());
+	unsigned long wave, c;
+	bool ok;
+
+	buffers[0].resize(waveChunks * slotBytes);
+	buffers[1].resize(waveChunks * slotBytes);
+	used[0].resize(waveChunks);
+	used[1].resize(waveChunks);
+
+	ok = writeAll(fd, header.data(), generator.header(header.data()));
+
+	for (wave = 0; ok && (wave <= waves); wave++)
+	{
+		if (wave < waves)
+		{
+			unsigned long first = wave * waveChunks;
+			unsigned long count = min(waveChunks, chunks - first);
+			unsigned int set = wave & 1;
+
+			pool.start(count, [&, first, count, set](unsigned int worker, size_t task)
+			{
+				unsigned long chunk = first + task;
+				unsigned long chunkRows = min(genChunkRows, rows - chunk * genChunkRows);
+
+				used[set][task] = generator.formatChunk(chunk, chunkRows, &buffers[set][task * slotBytes],
+						inScratch[worker], outScratch[worker], hidScratch[worker]);
+			});
+		}
+
+		if (wave > 0)		// write the previous wave while this one is generated
+		{
+			if (wave == waves)
+				pool.wait();
+
+			unsigned long first = (wave - 1) * waveChunks;
+			unsigned long count = min(waveChunks, chunks - first);
+			unsigned int set = (wave - 1) & 1;
+
+			for (c = 0; ok && (c < count); c++)
+				ok = writeAll(fd, &buffers[set][c * slotBytes], used[set][c]);
+		}
+	}
+	pool.wait();		// in case a write failed part way through
+
+	if ((fd != 1) && (close(fd) != 0))
+		ok = false;
+
+	if (!ok)
+	{
+		cerr << "Write failed\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+#ifndef _traceLog_h
+#define _traceLog_h
+
+/*
+ * An in-process timeline tracer for the -trace flag. The trace is written in the Chrome Trace Event JSON
+ * format, so it can be opened in chrome://tracing or https://ui.perfetto.dev to see how the phases on each
+ * thread line up.
+ *
+ * Compile with the _TRACE_ directive set to build it in. Without it the macros expand to nothing. With it,
+ * and with tracing not switched on, each macro costs one test of a flag. The Release and Debug builds leave it
+ * out; make eNNpi_instrumented builds a copy with it. Keep scopes to a pass or a chunk of rows, not one per row.
+ *
+ *	TRACE_SCOPE(name)				one event from here to the end of the enclosing block
+ *	TRACE_CHUNKS(var, name, every)	split a loop into events of every iterations, call TRACE_TICK(var) once per
+ *	TRACE_TICK(var)					iteration; the last part chunk is recorded when var goes out of scope
+ *
+ * name must be a string literal (only the pointer is stored).
+ *
+ * Every thread writes its events into its own ring buffer, so recording takes no lock. Only the newest
+ * traceRingSize events of each thread are kept. The rings are never freed, so the events of threads that have
+ * finished (e.g. a deleted threadPool) are still written out.
+ *
+ * traceLog::global().enable(file) switches tracing on and starts a thread that writes the trace to file
+ * whenever the process gets SIGUSR1. Call writeJson() on exit to write the final trace. A trace written while
+ * other threads are still recording may have a few torn events at the oldest end of a full ring.
+ */
+
+#ifdef _TRACE_
+
+#include <signal.h>		// POSIX only
+#include <pthread.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std ;
+
+const size_t traceRingSize = 1 << 16;		// events kept per thread
+
+struct traceEvent
+{
+	const char	*	name;
+	long long		startNs;		// since the trace began
+	long long		durationNs;
+};
+
+struct traceRing
+{
+	unsigned int		threadId;
+	atomic<size_t>		head;		// the number of events ever recorded, only written by the owning thread
+	traceEvent			events[traceRingSize];
+};
+
+class traceLog
+{
+	public:
+	static	traceLog &	global()
+						{
+							static traceLog theLog;
+							return theLog;
+						}
+
+			void		enable(const char * cstrFilename)
+			/*
+			 * Start tracing. Call this before any other threads are started so that they all inherit the blocked
+			 * SIGUSR1 and it is only delivered to the dump thread.
+			 */
+						{
+							sigset_t signals;
+
+							lock_guard<mutex> guard(traceLock);
+
+							fileName = cstrFilename;
+							if (enabled)
+								return;
+
+							sigemptyset(&signals);
+							sigaddset(&signals, SIGUSR1);
+							pthread_sigmask(SIG_BLOCK, &signals, NULL);
+							thread(&traceLog::signalLoop, this).detach();
+
+							enabled = true;
+						}
+
+			bool		isEnabled() { return enabled; }
+
+			long long	now() { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count(); }
+
+			void		record(const char * name, long long startNs, long long endNs)
+						{
+							traceRing * ring = threadRing();
+							size_t slot = ring->head.load(memory_order_relaxed);
+							traceEvent & event = ring->events[slot % traceRingSize];
+
+							event.name = name;
+							event.startNs = startNs;
+							event.durationNs = endNs - startNs;
+							ring->head.store(slot + 1, memory_order_release);
+						}
+
+			bool		writeJson()		// write the trace to the file given to enable()
+						{
+							lock_guard<mutex> guard(traceLock);
+							FILE * pFile;
+							size_t r, first, last, i;
+							bool isFirst = true;
+
+							if (!enabled)
+								return true;
+							if ((pFile = fopen(fileName.c_str(), "w")) == NULL)
+								return false;
+
+							fprintf(pFile, "{\"traceEvents\": [\n");
+							for (r = 0; r < rings.size(); r++)
+							{
+								fprintf(pFile, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s %u\"}}",
+										isFirst ? "" : ",\n", rings[r]->threadId, (rings[r]->threadId == 0) ? "main" : "thread", rings[r]->threadId);
+								isFirst = false;
+
+								last = rings[r]->head.load(memory_order_acquire);
+								first = (last > traceRingSize) ? last - traceRingSize : 0;
+								for (i = first; i < last; i++)
+								{
+									traceEvent & event = rings[r]->events[i % traceRingSize];
+									fprintf(pFile, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+											event.name, rings[r]->threadId, event.startNs / 1e3, event.durationNs / 1e3);
+								}
+							}
+							fprintf(pFile, "\n],\n\"displayTimeUnit\": \"ms\"}\n");
+
+							return (fclose(pFile) == 0);
+						}
+
+	private:
+						traceLog()
+						{
+							enabled = false;
+							started = chrono::steady_clock::now();
+						}
+
+			traceRing *	threadRing()	// this thread's ring, created the first time the thread records an event
+						{
+							static thread_local traceRing * ring = NULL;
+
+							if (ring == NULL)
+							{
+								lock_guard<mutex> guard(traceLock);
+								ring = new traceRing;		// kept until the process ends
+								ring->threadId = (unsigned int)rings.size();
+								ring->head = 0;
+								rings.push_back(ring);
+							}
+							return ring;
+						}
+
+			void		signalLoop()
+						{
+							sigset_t signals;
+							int sig;
+
+							sigemptyset(&signals);
+							sigaddset(&signals, SIGUSR1);
+							for (;;)
+								if (sigwait(&signals, &sig) == 0)
+									if (!writeJson())
+										fprintf(stderr, "Error: could not write the trace to %s\n", fileName.c_str());
+						}
+
+	private:
+	atomic<bool>		enabled;
+	chrono::steady_clock::time_point started;
+	string				fileName;
+	mutex				traceLock;		// guards rings, fileName and the writing of the file
+	vector<traceRing *>	rings;
+};
+
+class traceScope	// records one event from construction to destruction
+{
+	public:
+						traceScope(const char * eventName)
+						{
+							name = eventName;
+							timing = traceLog::global().isEnabled();
+							if (timing)
+								start = traceLog::global().now();
+						}
+
+						~traceScope()
+						{
+							if (timing)
+								traceLog::global().record(name, start, traceLog::global().now());
+						}
+
+	private:
+	const char		*	name;
+	bool				timing;
+	long long			start;
+};
+
+class traceChunks	// records an event for every so many calls of tick()
+{
+	public:
+						traceChunks(const char * eventName, unsigned int chunkSize)
+						{
+							name = eventName;
+							every = chunkSize;
+							ticks = 0;
+							timing = traceLog::global().isEnabled();
+							if (timing)
+								start = traceLog::global().now();
+						}
+
+						~traceChunks()
+						{
+							if (timing && (ticks > 0))
+								traceLog::global().record(name, start, traceLog::global().now());
+						}
+
+			void		tick()
+						{
+							long long end;
+
+							if (timing && (++ticks == every))
+							{
+								end = traceLog::global().now();
+								traceLog::global().record(name, start, end);
+								start = end;
+								ticks = 0;
+							}
+						}
+
+	private:
+	const char		*	name;
+	unsigned int		every;
+	unsigned int		ticks;
+	bool				timing;
+	long long			start;
+};
+
+#define TRACE_JOIN(a, b)				a##b
+#define TRACE_NAME(a, b)				TRACE_JOIN(a, b)
+#define TRACE_SCOPE(name)				traceScope TRACE_NAME(traceScope_, __LINE__)(name)
+#define TRACE_CHUNKS(var, name, every)	traceChunks var(name, every)
+#define TRACE_TICK(var)					var.tick()
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_CHUNKS(var, name, every)
+#define TRACE_TICK(var)
+
+#endif	// _TRACE_
+
+#endif	// _traceLog_h